@@ -0,0 +1,541 @@
+/** @file
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#define _GNU_SOURCE
+
+#include "allocator.h"
+#include <malloc.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Rozmiar nagłówka bloku alokatora z pamięcią podręczną
+ */
+#define SLAB_HEADER 8
+
+/** Rozmiar najmniejszego bloku
+ */
+#define SLAB_MIN_BLOCK 32
+
+/** Różnica rozmiarów bloków sąsiednich klas
+ */
+#define SLAB_GRANULE 16
+
+/** Liczba klas rozmiarów (największy blok ma 1024 bajty)
+ */
+#define SLAB_CLASSES 63
+
+/** Znacznik bloku alokowanego bezpośrednio przez malloc
+ */
+#define SLAB_BIG SIZE_MAX
+
+/** Rozmiar płyty, z której wycinane są bloki
+ */
+#define SLAB_PAGE_SIZE (64 << 10)
+
+/** Rozmiar nagłówka płyty
+ */
+#define SLAB_PAGE_HEADER 16
+
+/** Liczba bloków przenoszonych naraz między wątkiem a magazynem
+ */
+#define SLAB_BATCH 64
+
+/** Największa liczba wolnych bloków klasy trzymanych przez wątek
+ */
+#define SLAB_CACHE_BLOCKS 256
+
+/** Znacznik poprawnego bloku alokatora licznikowego
+ */
+#define COUNTING_MAGIC 0xA110CA7EDB10C4EDULL
+
+/** Znacznik zwolnionego bloku alokatora licznikowego
+ */
+#define COUNTING_FREED 0xF4EEDB10C4EDF4EEULL
+
+/** Bajt wypełniający nową pamięć alokatora licznikowego
+ */
+#define COUNTING_NEW_BYTE 0xAA
+
+/** Bajt wypełniający zwolnioną pamięć alokatora licznikowego
+ */
+#define COUNTING_FREED_BYTE 0xDD
+
+/**
+ * Nagłówek bloku alokatora licznikowego
+ */
+typedef struct CountingHeaderT {
+    size_t size;        ///< żądany rozmiar bloku
+    size_t magic;       ///< znacznik poprawności bloku
+} CountingHeaderT;
+
+/**
+ * Wolne bloki jednego wątku w alokatorze z pamięcią podręczną. Wolny blok
+ * przechowuje wskaźnik na następny wolny blok za nagłówkiem.
+ */
+typedef struct SlabCacheT {
+    void *free[SLAB_CLASSES];           ///< listy wolnych bloków klas
+    unsigned count[SLAB_CLASSES];       ///< długości list
+} SlabCacheT;
+
+_Thread_local const AllocatorT *threadAllocator;
+
+const AllocatorT *defaultAllocator = &SystemAllocator;
+
+/** Wolne bloki bieżącego wątku
+ */
+static _Thread_local SlabCacheT slabCache;
+
+/** Czy wątek zarejestrował już zwrot bloków przy zakończeniu
+ */
+static _Thread_local bool slabRegistered;
+
+/** Wolne bloki oddane przez wątki
+ */
+static void *depot[SLAB_CLASSES];
+
+/** Wszystkie płyty (nigdy nie są zwalniane)
+ */
+static void *pages;
+
+/** Chroni magazyn i listę płyt
+ */
+static pthread_mutex_t depotMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Klucz, którego destruktor oddaje bloki kończącego się wątku
+ */
+static pthread_key_t slabKey;
+
+/** Zapewnia jednokrotne utworzenie @p slabKey
+ */
+static pthread_once_t slabKeyOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Alokuje blok funkcją malloc
+ * @param[in] ctx : nieużywany kontekst
+ * @param[in] size : rozmiar bloku
+ * @return : blok lub NULL
+ */
+static void *systemAlloc(void *ctx, size_t size) {
+    (void) ctx;
+    return malloc(size);
+}
+
+/**
+ * Zmienia rozmiar bloku funkcją realloc
+ * @param[in] ctx : nieużywany kontekst
+ * @param[in] ptr : blok
+ * @param[in] size : nowy rozmiar
+ * @return : blok lub NULL
+ */
+static void *systemRealloc(void *ctx, void *ptr, size_t size) {
+    (void) ctx;
+    return realloc(ptr, size);
+}
+
+/**
+ * Zwalnia blok funkcją free
+ * @param[in] ctx : nieużywany kontekst
+ * @param[in] ptr : blok
+ */
+static void systemFree(void *ctx, void *ptr) {
+    (void) ctx;
+    free(ptr);
+}
+
+/**
+ * Zwraca użyteczny rozmiar bloku zaalokowanego funkcją malloc
+ * @param[in] ctx : nieużywany kontekst
+ * @param[in] ptr : blok
+ * @return : rozmiar bloku
+ */
+static size_t systemSize(void *ctx, const void *ptr) {
+    (void) ctx;
+    return malloc_usable_size((void *) ptr);
+}
+
+const AllocatorT SystemAllocator = {
+        .alloc = systemAlloc, .realloc = systemRealloc, .free = systemFree,
+        .size = systemSize, .ctx = NULL};
+
+/**
+ * Zwraca klasę bloku mieszczącego podany rozmiar
+ * @param[in] size : rozmiar
+ * @return : klasa lub SLAB_CLASSES, jeśli blok jest za duży
+ */
+static size_t slabClass(size_t size) {
+    if (size + SLAB_HEADER <= SLAB_MIN_BLOCK) return 0;
+    size_t c = (size + SLAB_HEADER - SLAB_MIN_BLOCK + SLAB_GRANULE - 1) /
+               SLAB_GRANULE;
+    return c < SLAB_CLASSES ? c : SLAB_CLASSES;
+}
+
+/**
+ * Zwraca rozmiar bloku klasy razem z nagłówkiem
+ * @param[in] c : klasa
+ * @return : rozmiar bloku
+ */
+static size_t slabBlockSize(size_t c) {
+    return SLAB_MIN_BLOCK + c * SLAB_GRANULE;
+}
+
+/**
+ * Zwraca następny blok na liście wolnych bloków
+ * @param[in] block : wolny blok
+ * @return : adres wskaźnika na następny blok
+ */
+static void **slabNext(void *block) {
+    return (void **) ((char *) block + SLAB_HEADER);
+}
+
+/**
+ * Odcina od listy wolnych bloków co najwyżej @p count bloków
+ * @param[in,out] list : lista wolnych bloków
+ * @param[in] count : liczba bloków
+ * @param[out] taken : liczba odciętych bloków
+ * @return : odcięte bloki
+ */
+static void *slabTake(void **list, size_t count, unsigned *taken) {
+    void *head = *list, *last = NULL;
+    *taken = 0;
+    for (void *block = head; block != NULL && *taken < count;
+         block = *slabNext(block)) {
+        last = block;
+        (*taken)++;
+    }
+    if (last != NULL) {
+        *list = *slabNext(last);
+        *slabNext(last) = NULL;
+    }
+    return *taken > 0 ? head : NULL;
+}
+
+/**
+ * Dołącza listę wolnych bloków na początek innej listy
+ * @param[in,out] list : lista docelowa
+ * @param[in] blocks : dołączana lista
+ */
+static void slabPrepend(void **list, void *blocks) {
+    if (blocks == NULL) return;
+
+    void *last = blocks;
+    while (*slabNext(last) != NULL) last = *slabNext(last);
+    *slabNext(last) = *list;
+    *list = blocks;
+}
+
+/**
+ * Oddaje do magazynu wszystkie wolne bloki kończącego się wątku
+ * @param[in] arg : wolne bloki wątku
+ */
+static void slabRelease(void *arg) {
+    SlabCacheT *cache = arg;
+    pthread_mutex_lock(&depotMutex);
+    for (size_t c = 0; c < SLAB_CLASSES; ++c) {
+        slabPrepend(&depot[c], cache->free[c]);
+        cache->free[c] = NULL;
+        cache->count[c] = 0;
+    }
+    pthread_mutex_unlock(&depotMutex);
+}
+
+/**
+ * Tworzy klucz wątku
+ */
+static void createKey(void) {
+    if (pthread_key_create(&slabKey, slabRelease) != 0) exit(1);
+}
+
+/**
+ * Uzupełnia listę wolnych bloków wątku z magazynu, a jeśli magazyn jest
+ * pusty, z nowej płyty
+ * @param[in] c : klasa
+ * @return : czy udało się uzupełnić listę
+ */
+static bool slabRefill(size_t c) {
+    if (!slabRegistered) {
+        pthread_once(&slabKeyOnce, createKey);
+        pthread_setspecific(slabKey, &slabCache);
+        slabRegistered = true;
+    }
+
+    pthread_mutex_lock(&depotMutex);
+    slabCache.free[c] = slabTake(&depot[c], SLAB_BATCH, &slabCache.count[c]);
+    pthread_mutex_unlock(&depotMutex);
+    if (slabCache.free[c] != NULL) return true;
+
+    char *page = malloc(SLAB_PAGE_SIZE);
+    if (page == NULL) return false;
+    pthread_mutex_lock(&depotMutex);
+    *(void **) page = pages;
+    pages = page;
+    pthread_mutex_unlock(&depotMutex);
+
+    size_t blockSize = slabBlockSize(c);
+    size_t count = (SLAB_PAGE_SIZE - SLAB_PAGE_HEADER) / blockSize;
+    char *block = page + SLAB_PAGE_HEADER;
+    for (size_t i = 0; i < count; ++i, block += blockSize)
+        *slabNext(block) = i + 1 < count ? block + blockSize : NULL;
+    slabCache.free[c] = page + SLAB_PAGE_HEADER;
+    slabCache.count[c] = count;
+    return true;
+}
+
+/**
+ * Alokuje blok z listy wolnych bloków klasy lub funkcją malloc
+ * @param[in] ctx : nieużywany kontekst
+ * @param[in] size : rozmiar bloku
+ * @return : blok lub NULL
+ */
+static void *slabAlloc(void *ctx, size_t size) {
+    (void) ctx;
+    size_t c = slabClass(size);
+    if (c == SLAB_CLASSES) {
+        if (size > SIZE_MAX - SLAB_HEADER) return NULL;
+        size_t *block = malloc(size + SLAB_HEADER);
+        if (block == NULL) return NULL;
+        *block = SLAB_BIG;
+        return (char *) block + SLAB_HEADER;
+    }
+
+    if (slabCache.free[c] == NULL && !slabRefill(c)) return NULL;
+    void *block = slabCache.free[c];
+    slabCache.free[c] = *slabNext(block);
+    slabCache.count[c]--;
+    *(size_t *) block = c;
+    return (char *) block + SLAB_HEADER;
+}
+
+/**
+ * Zwalnia blok: mały blok trafia na listę wolnych bloków wątku, a jej
+ * nadmiar do magazynu
+ * @param[in] ctx : nieużywany kontekst
+ * @param[in] ptr : blok
+ */
+static void slabFree(void *ctx, void *ptr) {
+    (void) ctx;
+    if (ptr == NULL) return;
+
+    void *block = (char *) ptr - SLAB_HEADER;
+    size_t c = *(size_t *) block;
+    if (c == SLAB_BIG) {
+        free(block);
+        return;
+    }
+
+    *slabNext(block) = slabCache.free[c];
+    slabCache.free[c] = block;
+    if (++slabCache.count[c] > SLAB_CACHE_BLOCKS) {
+        unsigned taken;
+        void *blocks = slabTake(&slabCache.free[c], SLAB_BATCH, &taken);
+        slabCache.count[c] -= taken;
+        pthread_mutex_lock(&depotMutex);
+        slabPrepend(&depot[c], blocks);
+        pthread_mutex_unlock(&depotMutex);
+    }
+}
+
+/**
+ * Zwraca użyteczny rozmiar bloku
+ * @param[in] ctx : nieużywany kontekst
+ * @param[in] ptr : blok
+ * @return : rozmiar bloku
+ */
+static size_t slabSize(void *ctx, const void *ptr) {
+    (void) ctx;
+    const void *block = (const char *) ptr - SLAB_HEADER;
+    size_t c = *(const size_t *) block;
+    if (c == SLAB_BIG)
+        return malloc_usable_size((void *) block) - SLAB_HEADER;
+    return slabBlockSize(c) - SLAB_HEADER;
+}
+
+/**
+ * Zmienia rozmiar bloku. Jeśli nowy rozmiar mieści się w bloku, blok się
+ * nie zmienia.
+ * @param[in] ctx : nieużywany kontekst
+ * @param[in] ptr : blok
+ * @param[in] size : nowy rozmiar
+ * @return : blok lub NULL
+ */
+static void *slabRealloc(void *ctx, void *ptr, size_t size) {
+    if (ptr == NULL) return slabAlloc(ctx, size);
+
+    size_t *block = (size_t *) ((char *) ptr - SLAB_HEADER);
+    size_t c = slabClass(size);
+    if (*block == SLAB_BIG && c == SLAB_CLASSES) {
+        block = realloc(block, size + SLAB_HEADER);
+        return block != NULL ? (char *) block + SLAB_HEADER : NULL;
+    }
+
+    size_t oldSize = slabSize(ctx, ptr);
+    if (*block != SLAB_BIG && size <= oldSize) return ptr;
+
+    void *res = slabAlloc(ctx, size);
+    if (res == NULL) return NULL;
+    memcpy(res, ptr, oldSize < size ? oldSize : size);
+    slabFree(ctx, ptr);
+    return res;
+}
+
+const AllocatorT SlabAllocator = {
+        .alloc = slabAlloc, .realloc = slabRealloc, .free = slabFree,
+        .size = slabSize, .ctx = NULL};
+
+/**
+ * Zwraca nagłówek bloku alokatora licznikowego, kończąc program, jeśli
+ * blok nie pochodzi z alokatora lub został już zwolniony
+ * @param[in] ptr : blok
+ * @return : nagłówek bloku
+ */
+static CountingHeaderT *countingHeader(const void *ptr) {
+    CountingHeaderT *header = (CountingHeaderT *) ptr - 1;
+    if (header->magic != COUNTING_MAGIC) {
+        fprintf(stderr, "ALLOCATOR ERROR %s %p\n",
+                header->magic == COUNTING_FREED ? "DOUBLE FREE"
+                                                : "INVALID BLOCK", ptr);
+        abort();
+    }
+    return header;
+}
+
+/**
+ * Zmienia liczbę bajtów w niezwolnionych blokach
+ * @param[in] counting : alokator
+ * @param[in] added : dodane bajty
+ * @param[in] removed : usunięte bajty
+ */
+static void countingBytes(CountingAllocatorT *counting, size_t added,
+                          size_t removed) {
+    if (added < removed) {
+        atomic_fetch_sub_explicit(&counting->bytes, removed - added,
+                                  memory_order_relaxed);
+        return;
+    }
+
+    size_t bytes = atomic_fetch_add_explicit(&counting->bytes, added - removed,
+                                             memory_order_relaxed) +
+                   added - removed;
+    size_t peak = atomic_load_explicit(&counting->peak, memory_order_relaxed);
+    while (bytes > peak &&
+           !atomic_compare_exchange_weak_explicit(&counting->peak, &peak, bytes,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed));
+}
+
+/**
+ * Alokuje blok alokatorem wewnętrznym i go liczy
+ * @param[in] ctx : alokator licznikowy
+ * @param[in] size : rozmiar bloku
+ * @return : blok lub NULL
+ */
+static void *countingAlloc(void *ctx, size_t size) {
+    CountingAllocatorT *counting = ctx;
+    if (size > SIZE_MAX - sizeof(CountingHeaderT)) return NULL;
+
+    CountingHeaderT *header = counting->inner->alloc(
+            counting->inner->ctx, size + sizeof(CountingHeaderT));
+    if (header == NULL) return NULL;
+    *header = (CountingHeaderT) {.size = size, .magic = COUNTING_MAGIC};
+    memset(header + 1, COUNTING_NEW_BYTE, size);
+
+    atomic_fetch_add_explicit(&counting->allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counting->live, 1, memory_order_relaxed);
+    countingBytes(counting, size, 0);
+    return header + 1;
+}
+
+/**
+ * Sprawdza blok, zamazuje go i zwalnia alokatorem wewnętrznym
+ * @param[in] ctx : alokator licznikowy
+ * @param[in] ptr : blok
+ */
+static void countingFree(void *ctx, void *ptr) {
+    CountingAllocatorT *counting = ctx;
+    if (ptr == NULL) return;
+
+    CountingHeaderT *header = countingHeader(ptr);
+    size_t size = header->size;
+    header->magic = COUNTING_FREED;
+    memset(ptr, COUNTING_FREED_BYTE, size);
+
+    atomic_fetch_add_explicit(&counting->frees, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&counting->live, 1, memory_order_relaxed);
+    countingBytes(counting, 0, size);
+    counting->inner->free(counting->inner->ctx, header);
+}
+
+/**
+ * Sprawdza blok i zmienia jego rozmiar alokatorem wewnętrznym
+ * @param[in] ctx : alokator licznikowy
+ * @param[in] ptr : blok
+ * @param[in] size : nowy rozmiar
+ * @return : blok lub NULL
+ */
+static void *countingRealloc(void *ctx, void *ptr, size_t size) {
+    CountingAllocatorT *counting = ctx;
+    if (ptr == NULL) return countingAlloc(ctx, size);
+    if (size > SIZE_MAX - sizeof(CountingHeaderT)) return NULL;
+
+    size_t oldSize = countingHeader(ptr)->size;
+    CountingHeaderT *header = counting->inner->realloc(
+            counting->inner->ctx, (CountingHeaderT *) ptr - 1,
+            size + sizeof(CountingHeaderT));
+    if (header == NULL) return NULL;
+    header->size = size;
+    if (size > oldSize)
+        memset((char *) (header + 1) + oldSize, COUNTING_NEW_BYTE,
+               size - oldSize);
+
+    atomic_fetch_add_explicit(&counting->reallocs, 1, memory_order_relaxed);
+    countingBytes(counting, size, oldSize);
+    return header + 1;
+}
+
+/**
+ * Zwraca żądany rozmiar bloku
+ * @param[in] ctx : alokator licznikowy
+ * @param[in] ptr : blok
+ * @return : rozmiar bloku
+ */
+static size_t countingSize(void *ctx, const void *ptr) {
+    (void) ctx;
+    return countingHeader(ptr)->size;
+}
+
+void CountingAllocatorInit(CountingAllocatorT *counting,
+                           const AllocatorT *inner) {
+    counting->allocator = (AllocatorT) {
+            .alloc = countingAlloc, .realloc = countingRealloc,
+            .free = countingFree, .size = countingSize, .ctx = counting};
+    counting->inner = inner != NULL ? inner : &SystemAllocator;
+    atomic_init(&counting->allocs, 0);
+    atomic_init(&counting->reallocs, 0);
+    atomic_init(&counting->frees, 0);
+    atomic_init(&counting->live, 0);
+    atomic_init(&counting->bytes, 0);
+    atomic_init(&counting->peak, 0);
+}
+
+void CountingAllocatorPrint(FILE *out, const CountingAllocatorT *counting) {
+    fprintf(out, "allocator_allocs %zu\nallocator_reallocs %zu\n"
+                 "allocator_frees %zu\nallocator_live %zu\n"
+                 "allocator_bytes %zu\nallocator_peak %zu\n",
+            atomic_load(&counting->allocs), atomic_load(&counting->reallocs),
+            atomic_load(&counting->frees), atomic_load(&counting->live),
+            atomic_load(&counting->bytes), atomic_load(&counting->peak));
+}
+
+void AllocatorSetDefault(const AllocatorT *allocator) {
+    defaultAllocator = allocator != NULL ? allocator : &SystemAllocator;
+}
+
+const AllocatorT *AllocatorSet(const AllocatorT *allocator) {
+    const AllocatorT *prev = threadAllocator;
+    threadAllocator = allocator;
+    return prev;
+}
@@ -0,0 +1,119 @@
+/** @file
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#ifndef POLYNOMIALS_ALLOCATOR_H
+#define POLYNOMIALS_ALLOCATOR_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Eksportowane z biblioteki dzielonej (zob. poly.h)
+#pragma GCC visibility push(default)
+
+/**
+ * Alokator pamięci używany przez safeMalloc, safeCalloc, safeRealloc
+ * i safeFree, a więc przez wszystkie alokacje wielomianów, stosu, parsera
+ * i źródła wejścia. Funkcje zwracają NULL, jeśli zabraknie pamięci. Blok
+ * musi zostać zwolniony alokatorem tego samego rodzaju, ale może to zrobić
+ * inny wątek. Zwracane bloki są wyrównane co najmniej do 8 bajtów.
+ */
+typedef struct AllocatorT {
+    void *(*alloc)(void *ctx, size_t size);                 ///< alokuje blok
+    void *(*realloc)(void *ctx, void *ptr, size_t size);    ///< zmienia rozmiar bloku
+    void (*free)(void *ctx, void *ptr);                     ///< zwalnia blok
+    size_t (*size)(void *ctx, const void *ptr);             ///< zwraca użyteczny rozmiar bloku
+    void *ctx;                                              ///< kontekst przekazywany do funkcji
+} AllocatorT;
+
+/**
+ * Alokator licznikowy: przekazuje alokacje do innego alokatora, liczy je
+ * i sprawdza poprawność zwalniania. Przed każdym blokiem zapisuje jego
+ * rozmiar i znacznik, więc zwolnienie bloku dwa razy lub bloku spoza
+ * alokatora kończy program z komunikatem. Nowa pamięć jest wypełniana
+ * bajtami 0xAA, a zwolniona bajtami 0xDD.
+ */
+typedef struct CountingAllocatorT {
+    AllocatorT allocator;       ///< alokator do użycia (kontekst wskazuje na tę strukturę)
+    const AllocatorT *inner;    ///< alokator, do którego trafiają alokacje
+    atomic_size_t allocs;       ///< liczba alokacji
+    atomic_size_t reallocs;     ///< liczba zmian rozmiaru
+    atomic_size_t frees;        ///< liczba zwolnień
+    atomic_size_t live;         ///< liczba niezwolnionych bloków
+    atomic_size_t bytes;        ///< liczba bajtów w niezwolnionych blokach
+    atomic_size_t peak;         ///< największa dotychczasowa wartość @p bytes
+} CountingAllocatorT;
+
+/** Alokator systemowy (malloc, realloc, free)
+ */
+extern const AllocatorT SystemAllocator;
+
+/**
+ * Alokator z pamięcią podręczną bloków w klasach rozmiarów, przeznaczony
+ * dla małych tablic jednomianów. Każdy wątek ma własne listy wolnych
+ * bloków, więc alokacja i zwolnienie nie wymagają synchronizacji. Bloki
+ * są wycinane z dużych płyt; nadmiar wolnych bloków wątku (i wszystkie
+ * jego bloki po zakończeniu wątku) trafia do wspólnego magazynu. Duże
+ * bloki są alokowane bezpośrednio przez malloc.
+ */
+extern const AllocatorT SlabAllocator;
+
+/**
+ * Inicjalizuje alokator licznikowy
+ * @param[out] counting : alokator
+ * @param[in] inner : alokator, do którego trafiają alokacje
+ */
+extern void CountingAllocatorInit(CountingAllocatorT *counting,
+                                  const AllocatorT *inner);
+
+/**
+ * Wypisuje liczniki alokatora licznikowego
+ * @param[in] out : strumień wyjściowy
+ * @param[in] counting : alokator
+ */
+extern void CountingAllocatorPrint(FILE *out,
+                                   const CountingAllocatorT *counting);
+
+/**
+ * Ustawia alokator wątków, które nie ustawiły własnego. Należy go ustawić
+ * przed uruchomieniem innych wątków i przed pierwszą alokacją.
+ * @param[in] allocator : alokator lub NULL dla alokatora systemowego
+ */
+extern void AllocatorSetDefault(const AllocatorT *allocator);
+
+/**
+ * Ustawia alokator bieżącego wątku i zwraca poprzedni. Ustawienie alokatora
+ * na czas jednego wywołania i przywrócenie poprzedniego pozwala wybrać
+ * alokator dla pojedynczej operacji:
+ * @code
+ * const AllocatorT *prev = AllocatorSet(&SlabAllocator);
+ * Poly res = PolyMul(&p, &q);
+ * AllocatorSet(prev);
+ * @endcode
+ * Wynik trzeba potem zwolnić z tym samym alokatorem.
+ * @param[in] allocator : alokator lub NULL dla alokatora domyślnego
+ * @return : poprzedni alokator wątku (NULL, jeśli był to alokator domyślny)
+ */
+extern const AllocatorT *AllocatorSet(const AllocatorT *allocator);
+
+/** Alokator ustawiony przez bieżący wątek lub NULL
+ */
+extern _Thread_local const AllocatorT *threadAllocator;
+
+/** Alokator wątków, które nie ustawiły własnego
+ */
+extern const AllocatorT *defaultAllocator;
+
+/**
+ * Zwraca alokator bieżącego wątku
+ * @return : alokator
+ */
+static inline const AllocatorT *AllocatorCurrent(void) {
+    return threadAllocator != NULL ? threadAllocator : defaultAllocator;
+}
+
+#pragma GCC visibility pop
+
+#endif //POLYNOMIALS_ALLOCATOR_H
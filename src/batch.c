@@ -0,0 +1,171 @@
+/** @file
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#define _GNU_SOURCE
+
+#include "batch.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "input.h"
+#include "poly_parser.h"
+
+/** Przyrostek nazwy pliku z wyjściem skryptu
+ */
+#define OUT_SUFFIX ".out"
+
+/** Przyrostek nazwy pliku z błędami skryptu
+ */
+#define ERR_SUFFIX ".err"
+
+/**
+ * Skrypt wykonywany w trybie wsadowym wraz z jego zbuforowanym wyjściem
+ */
+typedef struct BatchTaskT {
+    const char *path;   ///< ścieżka do pliku ze skryptem
+    char *out;          ///< zbuforowane wyjście skryptu
+    size_t outSize;     ///< rozmiar wyjścia
+    char *err;          ///< zbuforowane błędy skryptu
+    size_t errSize;     ///< rozmiar błędów
+    bool failed;        ///< czy nie udało się wykonać skryptu
+    bool done;          ///< czy skrypt został już wykonany
+} BatchTaskT;
+
+/**
+ * Stan puli wątków wykonujących skrypty
+ */
+typedef struct BatchT {
+    BatchTaskT *tasks;          ///< wykonywane skrypty
+    size_t count;               ///< liczba skryptów
+    size_t next;                ///< indeks pierwszego niepobranego skryptu
+    bool separateOutput;        ///< czy wyjście trafia do osobnych plików
+    const char *restorePath;    ///< zapisany stos lub NULL
+    size_t memLimit;            ///< limit pamięci skryptu (0 oznacza brak)
+    pthread_mutex_t mutex;      ///< chroni pola @p next i @p done skryptów
+    pthread_cond_t taskDone;    ///< sygnalizuje zakończenie skryptu
+} BatchT;
+
+/**
+ * Otwiera plik o nazwie skryptu z podanym przyrostkiem
+ * @param[in] path : ścieżka do pliku ze skryptem
+ * @param[in] suffix : przyrostek
+ * @return : otwarty plik lub NULL
+ */
+static FILE *openWithSuffix(const char *path, const char *suffix) {
+    char *name = safeMalloc(strlen(path) + strlen(suffix) + 1);
+    strcpy(name, path);
+    strcat(name, suffix);
+    FILE *file = fopen(name, "w");
+    safeFree(name);
+    return file;
+}
+
+/**
+ * Wykonuje pojedynczy skrypt na nowym stosie
+ * @param[in] batch : stan puli wątków
+ * @param[in] task : wykonywany skrypt
+ */
+static void runTask(BatchT *batch, BatchTaskT *task) {
+    MemBudgetT budget;
+    MemBudgetInit(&budget, batch->memLimit);
+    MemBudgetAttach(&budget);
+    StackT stack = StackInit(INIT_STACK_SIZE);
+
+    if (batch->separateOutput) {
+        stack.out = openWithSuffix(task->path, OUT_SUFFIX);
+        stack.err = openWithSuffix(task->path, ERR_SUFFIX);
+    } else {
+        stack.out = open_memstream(&task->out, &task->outSize);
+        stack.err = open_memstream(&task->err, &task->errSize);
+    }
+    if (stack.out == NULL || stack.err == NULL) exit(1);
+
+    InputT input;
+    if (!InputInit(&input, task->path)) {
+        fprintf(stack.err, "ERROR CANNOT OPEN %s\n", task->path);
+        task->failed = true;
+    } else {
+        if (batch->restorePath == NULL ||
+            StackLoad(&stack, batch->restorePath)) {
+            parseInput(&stack, &input);
+        } else {
+            fprintf(stack.err, "ERROR CANNOT RESTORE %s\n", batch->restorePath);
+            task->failed = true;
+        }
+        InputDestroy(&input);
+    }
+
+    StackDestroy(&stack);
+    MemBudgetAttach(NULL);
+    fclose(stack.out);
+    fclose(stack.err);
+}
+
+/**
+ * Pętla wątku z puli: pobiera kolejne skrypty i je wykonuje
+ * @param[in] arg : stan puli wątków
+ * @return : NULL
+ */
+static void *batchWorker(void *arg) {
+    BatchT *batch = arg;
+
+    while (true) {
+        pthread_mutex_lock(&batch->mutex);
+        size_t i = batch->next++;
+        pthread_mutex_unlock(&batch->mutex);
+        if (i >= batch->count) break;
+
+        runTask(batch, &batch->tasks[i]);
+
+        pthread_mutex_lock(&batch->mutex);
+        batch->tasks[i].done = true;
+        pthread_cond_broadcast(&batch->taskDone);
+        pthread_mutex_unlock(&batch->mutex);
+    }
+    return NULL;
+}
+
+bool runBatch(char *const paths[], size_t count, size_t threads,
+              bool separateOutput, const char *restorePath, size_t memLimit) {
+    BatchT batch = {.count = count, .separateOutput = separateOutput,
+                    .restorePath = restorePath, .memLimit = memLimit};
+    batch.tasks = safeCalloc(count, sizeof(BatchTaskT));
+    for (size_t i = 0; i < count; ++i) batch.tasks[i].path = paths[i];
+    pthread_mutex_init(&batch.mutex, NULL);
+    pthread_cond_init(&batch.taskDone, NULL);
+
+    if (threads > count) threads = count;
+    pthread_t *workers = safeMalloc(threads * sizeof(pthread_t));
+    for (size_t i = 0; i < threads; ++i) {
+        if (pthread_create(&workers[i], NULL, batchWorker, &batch) != 0)
+            exit(1);
+    }
+
+    // Wypisujemy wyjście skryptów w kolejności plików, gdy tylko kolejny
+    // skrypt zostanie wykonany
+    bool res = true;
+    for (size_t i = 0; i < count; ++i) {
+        BatchTaskT *task = &batch.tasks[i];
+        pthread_mutex_lock(&batch.mutex);
+        while (!task->done) pthread_cond_wait(&batch.taskDone, &batch.mutex);
+        pthread_mutex_unlock(&batch.mutex);
+
+        if (!separateOutput) {
+            fwrite(task->out, 1, task->outSize, stdout);
+            fwrite(task->err, 1, task->errSize, stderr);
+            free(task->out);
+            free(task->err);
+        }
+        if (task->failed) res = false;
+    }
+
+    for (size_t i = 0; i < threads; ++i) pthread_join(workers[i], NULL);
+    safeFree(workers);
+    pthread_cond_destroy(&batch.taskDone);
+    pthread_mutex_destroy(&batch.mutex);
+    safeFree(batch.tasks);
+    return res;
+}
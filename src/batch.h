@@ -0,0 +1,30 @@
+/** @file
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#ifndef POLYNOMIALS_BATCH_H
+#define POLYNOMIALS_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Wykonuje niezależne skrypty z podanych plików na puli wątków. Każdy
+ * skrypt jest wykonywany na osobnym stosie. Jeśli @p separateOutput jest
+ * fałszem, wyjście i błędy skryptów są wypisywane na standardowe wyjście
+ * i standardowe wyjście błędów w kolejności plików, wpp. są zapisywane do
+ * plików o nazwach skryptów z przyrostkami ".out" i ".err".
+ * @param[in] paths : ścieżki do plików ze skryptami
+ * @param[in] count : liczba skryptów
+ * @param[in] threads : liczba wątków
+ * @param[in] separateOutput : czy zapisywać wyjście skryptów do osobnych plików
+ * @param[in] restorePath : zapisany stos wczytywany przed każdym skryptem lub NULL
+ * @param[in] memLimit : limit pamięci każdego skryptu w bajtach (0 oznacza brak limitu)
+ * @return : czy udało się wykonać wszystkie skrypty
+ */
+extern bool runBatch(char *const paths[], size_t count, size_t threads,
+                     bool separateOutput, const char *restorePath,
+                     size_t memLimit);
+
+#endif //POLYNOMIALS_BATCH_H
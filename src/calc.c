@@ -6,55 +6,241 @@
 #define _GNU_SOURCE
 
 #include "poly_stack.h"
+#include <getopt.h>
+#include <stdint.h>
 #include <string.h>
+#include "allocator.h"
+#include "batch.h"
+#include "poly_fingerprint.h"
 #include "poly_parser.h"
 #include "input.h"
+#include "pipeline.h"
+#include "server.h"
+#include "stats.h"
+#include "trace.h"
 
-/** Niepoprawny char
-*/
-#define INVALID_CHAR '@'
+/** Domyślny limit pamięci sesji serwera (1 GiB)
+ */
+#define DEFAULT_SESSION_MEM (1ULL << 30)
 
-/** Znak oznaczający komentarz
+/** Domyślny limit bezczynności sesji serwera w sekundach
  */
-#define COMMENT_CHAR '#'
+#define DEFAULT_IDLE_TIMEOUT 300
 
-/** Znak oznaczjący nową linie
+/** Opcje programu
  */
-#define NEW_LINE_CHAR '\n'
+static const struct option options[] = {
+        {"restore", required_argument, NULL, 'r'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"separate-output", no_argument, NULL, 's'},
+        {"serve", required_argument, NULL, 'S'},
+        {"session-mem", required_argument, NULL, 'm'},
+        {"idle-timeout", required_argument, NULL, 't'},
+        {"pipeline", no_argument, NULL, 'p'},
+        {"stats", no_argument, NULL, 'T'},
+        {"trace", required_argument, NULL, 'R'},
+        {"max-mem", required_argument, NULL, 'M'},
+        {"allocator", required_argument, NULL, 'A'},
+        {"hash-cons", no_argument, NULL, 'H'},
+        {"eq-seed", required_argument, NULL, 'E'},
+        {"eq-exact", no_argument, NULL, 'X'},
+        {NULL, 0, NULL, 0}
+};
 
-/** Początkowy rozmiar stosu
+/**
+ * Wczytuje początkową liczbę nieujemną z parametru opcji
+ * @param[in] str : parametr opcji
+ * @param[out] endPtr : wskaźnik za ostatnią cyfrą liczby
+ * @param[out] num : wczytana liczba
+ * @return : czy parametr zaczyna się od liczby w zakresie size_t
  */
-#define INIT_STACK_SIZE 16
+static bool parseLeadingNumber(const char *str, char **endPtr, size_t *num) {
+    unsigned long long res;
+    if (!isdigit(str[0]) || !strToULL(str, endPtr, &res) || res > SIZE_MAX)
+        return false;
+    *num = (size_t) res;
+    return true;
+}
 
-/** Początkowy rozmiar bufora w którym przechoywana jest wczytywana linia
+/**
+ * Wczytuje nieujemną liczbę całkowitą będącą parametrem opcji
+ * @param[in] str : parametr opcji
+ * @param[out] num : wczytana liczba
+ * @return : czy parametr jest liczbą w zakresie size_t
  */
-#define INIT_BUFFER_SIZE 16
+static bool parseNumber(const char *str, size_t *num) {
+    char *endPtr;
+    return parseLeadingNumber(str, &endPtr, num) && *endPtr == '\0';
+}
 
+/**
+ * Wczytuje rozmiar pamięci z opcjonalnym przyrostkiem K, M lub G
+ * @param[in] str : parametr opcji
+ * @param[out] size : rozmiar w bajtach
+ * @return : czy parametr jest poprawnym rozmiarem mieszczącym się w size_t
+ */
+static bool parseSize(const char *str, size_t *size) {
+    char *endPtr;
+    if (!parseLeadingNumber(str, &endPtr, size)) return false;
 
-int main(void) {
+    unsigned shift = 0;
+    switch (*endPtr) {
+        case 'G': shift += 10; // fall through
+        case 'M': shift += 10; // fall through
+        case 'K': shift += 10; endPtr++; break;
+        default: break;
+    }
+    if (*size > SIZE_MAX >> shift) return false;
+    *size <<= shift;
+    return *endPtr == '\0';
+}
 
-    StackT stack = StackInit(INIT_STACK_SIZE);
-    char *buffer = safeMalloc(INIT_BUFFER_SIZE * sizeof (char));
-    size_t bufSize = 1, currLine = 1;
-    ssize_t lineLen;
-
-    char c;
-    while ((c = getchar()) != EOF) {
-        ungetc(c, stdin);
-        lineLen = safeGetline(&buffer, &bufSize);
-        if (c != COMMENT_CHAR && c != NEW_LINE_CHAR) {
-
-            size_t len = strlen(buffer);
-            if (len != (size_t) lineLen) buffer[len] = INVALID_CHAR;
-            if (isalpha(buffer[0]))
-                parseCommand(&stack, currLine, buffer, lineLen);
-            else
-                parsePoly(&stack, currLine, buffer, lineLen);
+/** Budżet pamięci stosu w trybie jednego skryptu
+ */
+static MemBudgetT budget;
+
+/** Alokator licznikowy wybrany opcją --allocator
+ */
+static CountingAllocatorT countingAllocator;
+
+/**
+ * Wypisuje liczniki alokatora licznikowego przy zakończeniu programu
+ */
+static void printAllocator(void) {
+    CountingAllocatorPrint(stderr, &countingAllocator);
+}
+
+/**
+ * Ustawia alokator wszystkich wątków
+ * @param[in] name : nazwa alokatora: system, slab lub counting
+ * @return : czy nazwa jest poprawna
+ */
+static bool setAllocator(const char *name) {
+    if (strcmp(name, "system") == 0) {
+        AllocatorSetDefault(&SystemAllocator);
+    } else if (strcmp(name, "slab") == 0) {
+        AllocatorSetDefault(&SlabAllocator);
+    } else if (strcmp(name, "counting") == 0) {
+        CountingAllocatorInit(&countingAllocator, &SystemAllocator);
+        AllocatorSetDefault(&countingAllocator.allocator);
+        atexit(printAllocator);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Wypisuje statystyki wykonania przy zakończeniu programu
+ */
+static void printStats(void) {
+    StatsPrint(stderr, CommandNames, COMMAND_KINDS);
+}
+
+int main(int argc, char **argv) {
+
+    const char *restorePath = NULL, *socketPath = NULL;
+    size_t threads = 0, sessionMem = DEFAULT_SESSION_MEM;
+    size_t idleTimeout = DEFAULT_IDLE_TIMEOUT, maxMem = 0;
+    size_t eqSeed = FINGERPRINT_DEFAULT_SEED;
+    bool separateOutput = false, pipelined = false, hashCons = false;
+    bool eqExact = false;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:", options, NULL)) != -1) {
+        if (opt == 'r') {
+            restorePath = optarg;
+        } else if (opt == 'j') {
+            if (!parseNumber(optarg, &threads) || threads == 0) {
+                fprintf(stderr, "ERROR WRONG JOBS NUMBER %s\n", optarg);
+                return 1;
+            }
+        } else if (opt == 's') {
+            separateOutput = true;
+        } else if (opt == 'R') {
+            if (!TraceStart(optarg)) {
+                fprintf(stderr, "ERROR CANNOT OPEN %s\n", optarg);
+                return 1;
+            }
+            atexit(TraceStop);
+        } else if (opt == 'T') {
+            atexit(printStats);
+        } else if (opt == 'A') {
+            if (!setAllocator(optarg)) {
+                fprintf(stderr, "ERROR WRONG ALLOCATOR %s\n", optarg);
+                return 1;
+            }
+        } else if (opt == 'p') {
+            pipelined = true;
+        } else if (opt == 'H') {
+            hashCons = true;
+        } else if (opt == 'X') {
+            eqExact = true;
+        } else if (opt == 'S') {
+            socketPath = optarg;
+        } else if (opt == 'm' || opt == 'M' || opt == 't' || opt == 'E') {
+            bool correct = opt == 'm' ? parseSize(optarg, &sessionMem)
+                         : opt == 'M' ? parseSize(optarg, &maxMem)
+                         : opt == 'E' ? parseNumber(optarg, &eqSeed)
+                                      : parseNumber(optarg, &idleTimeout) &&
+                                        idleTimeout <= UINT_MAX;
+            if (!correct) {
+                fprintf(stderr, "ERROR WRONG VALUE %s\n", optarg);
+                return 1;
+            }
+        } else {
+            return 1;
         }
-        currLine++;
     }
 
-    free(buffer);
+    SetEqFastOptions(eqSeed, eqExact);
+
+    // Skrypty wsadowe i sesje serwera mają osobne budżety pamięci, a tablice
+    // internowane przez jeden skrypt mógłby zwolnić inny
+    if (hashCons && (socketPath != NULL || threads > 0)) {
+        fprintf(stderr, "ERROR HASH-CONS NEEDS SINGLE SCRIPT\n");
+        return 1;
+    }
+
+    if (socketPath != NULL) {
+        if (runServer(socketPath, sessionMem, idleTimeout, restorePath))
+            return 0;
+        fprintf(stderr, "ERROR CANNOT SERVE %s\n", socketPath);
+        return 1;
+    }
+
+    // Tryb wsadowy: każdy plik jest osobnym skryptem
+    if (threads > 0 && optind == argc) {
+        fprintf(stderr, "ERROR NO SCRIPTS\n");
+        return 1;
+    }
+    if (threads > 0)
+        return runBatch(&argv[optind], argc - optind, threads, separateOutput,
+                        restorePath, maxMem) ? 0 : 1;
+
+    // Komendy przekraczające limit są wycofywane z błędem OUT OF MEMORY
+    MemBudgetInit(&budget, maxMem);
+    MemBudgetAttach(&budget);
+
+    const char *path = optind < argc ? argv[optind] : NULL;
+    InputT input;
+    if (!InputInit(&input, path)) {
+        fprintf(stderr, "ERROR CANNOT OPEN %s\n", path);
+        return 1;
+    }
+
+    StackT stack = StackInit(INIT_STACK_SIZE);
+    stack.hashCons = hashCons;
+    if (restorePath != NULL && !StackLoad(&stack, restorePath)) {
+        fprintf(stderr, "ERROR CANNOT RESTORE %s\n", restorePath);
+        InputDestroy(&input);
+        StackDestroy(&stack);
+        return 1;
+    }
+
+    if (pipelined) parseInputPipelined(&stack, &input);
+    else parseInput(&stack, &input);
+
+    InputDestroy(&input);
     StackDestroy(&stack);
 
     return 0;
@@ -5,23 +5,493 @@
 #define _GNU_SOURCE
 
 #include "input.h"
+#include "allocator.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#define CHECK_PTR(p)  \
-  do {                \
-    if (p == NULL) {  \
-      exit(1);        \
-    }                 \
-  } while (0)
+/** Rozmiar bloku czytanego jednym wywołaniem read
+ */
+#define INPUT_BLOCK_SIZE (1 << 20)
+
+/** Co ile przeczytanych bajtów zwalniamy przeczytaną część mapowania
+ */
+#define INPUT_RELEASE_SIZE (64 << 20)
+
+/** Maksymalne zagnieżdżenie transakcji pamięci
+ */
+#define MEM_TXN_DEPTH 4
+
+/** Początkowa liczba miejsc w tablicy alokacji transakcji
+ */
+#define TRACK_INIT_SLOTS 64
+
+/** Największa liczba miejsc tablicy alokacji zachowywana po zakończeniu
+ * transakcji
+ */
+#define TRACK_KEEP_SLOTS 4096
+
+bool InputInit(InputT *input, const char *path) {
+    int fd = STDIN_FILENO;
+    if (path != NULL) {
+        fd = open(path, O_RDONLY);
+        if (fd < 0) return false;
+    }
+
+    InputInitFd(input, fd);
+    return true;
+}
+
+void InputInitFd(InputT *input, int fd) {
+    struct stat st;
+
+    *input = (InputT) {.fd = fd};
+
+    // Plik regularny mapujemy prywatnie: parser może pisać po linii,
+    // a kopiowane są tylko zmodyfikowane strony
+    if (fstat(input->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_NORESERVE, input->fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+            input->data = data;
+            input->dataSize = input->capacity = st.st_size;
+            input->mapped = input->eof = true;
+            return;
+        }
+    }
+
+    input->capacity = INPUT_BLOCK_SIZE;
+    input->data = safeMalloc(input->capacity + 1);
+}
+
+/**
+ * Zwalnia już przeczytaną część zmapowanego pliku, dzięki czemu zużycie
+ * pamięci nie rośnie wraz z długością pliku
+ * @param[in] input : źródło wejścia
+ */
+static void releaseMapped(InputT *input) {
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t end = input->pos / page * page;
+
+    if (end - input->released >= INPUT_RELEASE_SIZE) {
+        madvise(input->data + input->released, end - input->released,
+                MADV_DONTNEED);
+        input->released = end;
+    }
+}
+
+/**
+ * Doczytuje kolejny blok wejścia do bufora. Nieprzeczytana część bufora
+ * jest przesuwana na jego początek, a jeśli wypełnia cały bufor, bufor jest
+ * powiększany dwukrotnie.
+ * @param[in] input : źródło wejścia
+ */
+static void readBlock(InputT *input) {
+    size_t rest = input->dataSize - input->pos;
+
+    memmove(input->data, input->data + input->pos, rest);
+    input->pos = 0;
+    input->dataSize = rest;
+    if (rest == input->capacity) {
+        input->capacity *= 2;
+        input->data = safeRealloc(input->data, input->capacity + 1);
+    }
+
+    ssize_t readLen;
+    do {
+        readLen = read(input->fd, input->data + rest, input->capacity - rest);
+    } while (readLen < 0 && errno == EINTR);
+
+    if (readLen <= 0) input->eof = true;
+    else input->dataSize += readLen;
+}
+
+ssize_t InputGetLine(InputT *input, char **line) {
+    char *newLine;
+
+    while ((newLine = memchr(input->data + input->pos, '\n',
+                             input->dataSize - input->pos)) == NULL) {
+        if (input->eof) break;
+        readBlock(input);
+    }
+
+    size_t start = input->pos;
+    size_t len = newLine != NULL ? (size_t) (newLine - (input->data + start)) + 1
+                                 : input->dataSize - start;
+    if (len == 0) return -1;
+    input->pos += len;
+
+    if (newLine == NULL) {
+        // Ostatnia linia bez znaku '\n' musi zostać zakończona znakiem '\0'
+        if (input->mapped) {
+            safeFree(input->tail);
+            input->tail = safeMalloc(len + 1);
+            memcpy(input->tail, input->data + start, len);
+            input->tail[len] = '\0';
+            *line = input->tail;
+            return (ssize_t) len;
+        }
+        input->data[start + len] = '\0';
+    }
+
+    if (input->mapped) releaseMapped(input);
+    *line = input->data + start;
+    return (ssize_t) len;
+}
+
+void InputDestroy(InputT *input) {
+    if (input->mapped) munmap(input->data, input->capacity);
+    else safeFree(input->data);
+    safeFree(input->tail);
+    if (input->fd != STDIN_FILENO) close(input->fd);
+}
+
+/**
+ * Miejsce w tablicy alokacji transakcji. Miejsce z innym numerem pokolenia
+ * niż tablica jest puste, a miejsce z bieżącym pokoleniem i wskaźnikiem
+ * NULL jest usuniętym wpisem.
+ */
+typedef struct TrackSlotT {
+    void *ptr;          ///< zaalokowana pamięć
+    unsigned gen;       ///< pokolenie tablicy, w którym wpisano alokację
+} TrackSlotT;
+
+/**
+ * Zbiór alokacji jednego poziomu transakcji (tablica z haszowaniem
+ * otwartym). Opróżnienie tablicy zwiększa tylko numer pokolenia.
+ */
+typedef struct TrackTableT {
+    TrackSlotT *slots;  ///< miejsca tablicy
+    size_t mask;        ///< liczba miejsc minus 1
+    size_t used;        ///< liczba zajętych i usuniętych miejsc
+    unsigned gen;       ///< bieżące pokolenie
+} TrackTableT;
+
+/** Własny budżet bieżącego wątku
+ */
+static _Thread_local MemBudgetT localBudget;
+
+/** Podłączony budżet bieżącego wątku lub NULL
+ */
+static _Thread_local MemBudgetT *threadBudget;
+
+/** Bieżąca transakcja wątku lub NULL
+ */
+static _Thread_local MemTxnT *currentTxn;
+
+/** Alokacje kolejnych poziomów transakcji wątku
+ */
+static _Thread_local TrackTableT trackTables[MEM_TXN_DEPTH];
+
+/** Liczba alokacji wykonanych przez bieżący wątek
+ */
+static _Thread_local size_t allocations;
+
+/** Klucz, którego destruktor zwalnia tablice alokacji kończącego się wątku
+ */
+static pthread_key_t trackKey;
+
+/** Zapewnia jednokrotne utworzenie @p trackKey
+ */
+static pthread_once_t trackKeyOnce = PTHREAD_ONCE_INIT;
+
+void MemBudgetInit(MemBudgetT *budget, size_t limit) {
+    atomic_init(&budget->used, 0);
+    atomic_init(&budget->peak, 0);
+    budget->limit = limit;
+}
+
+void MemBudgetAttach(MemBudgetT *budget) {
+    threadBudget = budget;
+}
+
+MemBudgetT *MemBudgetCurrent(void) {
+    return threadBudget != NULL ? threadBudget : &localBudget;
+}
+
+/**
+ * Dolicza bajty do budżetu wątku i aktualizuje najwyższe zużycie
+ * @param[in] bytes : liczba bajtów
+ */
+static void charge(size_t bytes) {
+    MemBudgetT *budget = MemBudgetCurrent();
+    size_t used = atomic_fetch_add_explicit(&budget->used, bytes,
+                                            memory_order_relaxed) + bytes;
+    size_t peak = atomic_load_explicit(&budget->peak, memory_order_relaxed);
+    while (used > peak &&
+           !atomic_compare_exchange_weak_explicit(&budget->peak, &peak, used,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed));
+}
 
-ssize_t safeGetline(char **line, size_t *length) {
-    errno = 0;
-    ssize_t lineLen = getline(line, length, stdin);
-    if (errno == ENOMEM) exit(1);
-    return lineLen;
+/**
+ * Odlicza bajty od budżetu wątku
+ * @param[in] bytes : liczba bajtów
+ */
+static void discharge(size_t bytes) {
+    atomic_fetch_sub_explicit(&MemBudgetCurrent()->used, bytes,
+                              memory_order_relaxed);
+}
+
+/**
+ * Sprawdza, czy alokacje bieżącego wątku są śledzone
+ * @return : czy wątek jest w śledzonej transakcji
+ */
+static bool tracking(void) {
+    return currentTxn != NULL && currentTxn->tracked;
+}
+
+/**
+ * Wycofuje bieżącą transakcję, jeśli alokacja przekroczyłaby limit budżetu
+ * @param[in] bytes : liczba alokowanych bajtów
+ */
+static void reserve(size_t bytes) {
+    MemBudgetT *budget = MemBudgetCurrent();
+    size_t used = atomic_load_explicit(&budget->used, memory_order_relaxed);
+    if (bytes > budget->limit || used > budget->limit - bytes) MemFail();
+}
+
+/**
+ * Zwraca miejsce startowe wskaźnika w tablicy alokacji
+ * @param[in] table : tablica alokacji
+ * @param[in] ptr : wskaźnik
+ * @return : indeks miejsca
+ */
+static size_t trackHash(const TrackTableT *table, const void *ptr) {
+    return (size_t) (((uintptr_t) ptr >> 4) * 0x9E3779B97F4A7C15ULL) &
+           table->mask;
+}
+
+/**
+ * Opróżnia tablicę alokacji. Duże tablice są zwalniane, żeby jedna duża
+ * komenda nie zajmowała pamięci do końca działania wątku.
+ * @param[in] table : tablica alokacji
+ */
+static void trackClear(TrackTableT *table) {
+    table->used = 0;
+    if (table->mask + 1 > TRACK_KEEP_SLOTS) {
+        free(table->slots);
+        *table = (TrackTableT) {0};
+    } else if (++table->gen == 0) {
+        memset(table->slots, 0, (table->mask + 1) * sizeof(TrackSlotT));
+        table->gen = 1;
+    }
+}
+
+static void trackInsert(TrackTableT *table, void *ptr);
+
+/**
+ * Zwalnia tablice alokacji kończącego się wątku
+ * @param[in] arg : tablice alokacji wątku
+ */
+static void releaseTables(void *arg) {
+    TrackTableT *tables = arg;
+    for (int i = 0; i < MEM_TXN_DEPTH; ++i) {
+        free(tables[i].slots);
+        tables[i] = (TrackTableT) {0};
+    }
+}
+
+/**
+ * Tworzy klucz wątku
+ */
+static void createKey(void) {
+    if (pthread_key_create(&trackKey, releaseTables) != 0) exit(1);
+}
+
+/**
+ * Powiększa dwukrotnie tablicę alokacji, pomijając usunięte wpisy. Tablica
+ * jest alokowana bezpośrednio przez malloc, bo nie należy do budżetu.
+ * @param[in] table : tablica alokacji
+ */
+static void trackGrow(TrackTableT *table) {
+    TrackTableT old = *table;
+    size_t slots = old.slots != NULL ? 2 * (old.mask + 1) : TRACK_INIT_SLOTS;
+
+    table->slots = calloc(slots, sizeof(TrackSlotT));
+    if (table->slots == NULL) exit(1);
+    if (old.slots == NULL) {
+        pthread_once(&trackKeyOnce, createKey);
+        pthread_setspecific(trackKey, trackTables);
+    }
+    table->mask = slots - 1;
+    table->used = 0;
+    table->gen = 1;
+
+    for (size_t i = 0; old.slots != NULL && i <= old.mask; ++i) {
+        if (old.slots[i].gen == old.gen && old.slots[i].ptr != NULL)
+            trackInsert(table, old.slots[i].ptr);
+    }
+    free(old.slots);
+}
+
+/**
+ * Wpisuje alokację do tablicy
+ * @param[in] table : tablica alokacji
+ * @param[in] ptr : zaalokowana pamięć
+ */
+static void trackInsert(TrackTableT *table, void *ptr) {
+    if (table->slots == NULL || 2 * (table->used + 1) > table->mask + 1)
+        trackGrow(table);
+
+    size_t i = trackHash(table, ptr);
+    while (table->slots[i].gen == table->gen && table->slots[i].ptr != NULL)
+        i = (i + 1) & table->mask;
+    if (table->slots[i].gen != table->gen) table->used++;
+    table->slots[i] = (TrackSlotT) {.ptr = ptr, .gen = table->gen};
+}
+
+/**
+ * Usuwa alokację z tablicy
+ * @param[in] table : tablica alokacji
+ * @param[in] ptr : zwalniana pamięć
+ * @return : czy alokacja była w tablicy
+ */
+static bool trackRemove(TrackTableT *table, const void *ptr) {
+    if (table->slots == NULL) return false;
+
+    size_t i = trackHash(table, ptr);
+    while (table->slots[i].gen == table->gen) {
+        if (table->slots[i].ptr == ptr) {
+            table->slots[i].ptr = NULL;
+            return true;
+        }
+        i = (i + 1) & table->mask;
+    }
+    return false;
+}
+
+/**
+ * Usuwa alokację z tablic bieżącej i zewnętrznych transakcji
+ * @param[in] ptr : zwalniana pamięć
+ * @return : poziom transakcji, do którego należała alokacja, lub -1
+ */
+static int untrack(const void *ptr) {
+    for (int depth = (int) currentTxn->depth; depth >= 0; --depth) {
+        if (trackRemove(&trackTables[depth], ptr)) return depth;
+    }
+    return -1;
+}
+
+void MemTxnBegin(MemTxnT *txn) {
+    txn->outer = currentTxn;
+    txn->depth = currentTxn != NULL ? currentTxn->depth + 1 : 0;
+    txn->tracked = currentTxn != NULL ? currentTxn->tracked
+                                      : MemBudgetCurrent()->limit != 0;
+    if (txn->depth >= MEM_TXN_DEPTH) exit(1);
+    currentTxn = txn;
+}
+
+void MemTxnEnd(MemTxnT *txn) {
+    TrackTableT *table = &trackTables[txn->depth];
+    if (txn->tracked && txn->outer != NULL && table->used > 0) {
+        for (size_t i = 0; i <= table->mask; ++i) {
+            if (table->slots[i].gen == table->gen &&
+                table->slots[i].ptr != NULL)
+                trackInsert(&trackTables[txn->depth - 1], table->slots[i].ptr);
+        }
+    }
+    MemTxnKeep(txn);
+}
+
+void MemTxnKeep(MemTxnT *txn) {
+    if (txn->tracked) trackClear(&trackTables[txn->depth]);
+    currentTxn = txn->outer;
+}
+
+_Noreturn void MemFail(void) {
+    MemTxnT *txn = currentTxn;
+    if (txn == NULL || !txn->tracked) exit(1);
+
+    TrackTableT *table = &trackTables[txn->depth];
+    for (size_t i = 0; table->used > 0 && i <= table->mask; ++i) {
+        void *ptr = table->slots[i].ptr;
+        if (table->slots[i].gen == table->gen && ptr != NULL) {
+            const AllocatorT *allocator = AllocatorCurrent();
+            STAT_INC(STAT_FREES);
+            discharge(allocator->size(allocator->ctx, ptr));
+            allocator->free(allocator->ctx, ptr);
+        }
+    }
+    trackClear(table);
+    currentTxn = txn->outer;
+    longjmp(txn->env, 1);
 }
 
 void *safeMalloc(size_t size) {
-    void *res = malloc(size);
-    CHECK_PTR(res);
+    const AllocatorT *allocator = AllocatorCurrent();
+    if (tracking()) reserve(size);
+    void *res = allocator->alloc(allocator->ctx, size);
+    if (res == NULL) MemFail();
+
+    allocations++;
+    STAT_INC(STAT_ALLOCS);
+    STAT_ADD(STAT_ALLOC_BYTES, size);
+    charge(allocator->size(allocator->ctx, res));
+    if (tracking()) trackInsert(&trackTables[currentTxn->depth], res);
     return res;
 }
+
+void *safeCalloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) MemFail();
+    void *res = safeMalloc(count * size);
+    memset(res, 0, count * size);
+    return res;
+}
+
+void *safeRealloc(void *ptr, size_t size) {
+    if (size == 0) {
+        safeFree(ptr);
+        return NULL;
+    }
+    if (ptr == NULL) return safeMalloc(size);
+
+    const AllocatorT *allocator = AllocatorCurrent();
+    size_t oldSize = allocator->size(allocator->ctx, ptr);
+    int depth = -1;
+    if (tracking()) {
+        if (size > oldSize) reserve(size - oldSize);
+        depth = untrack(ptr);
+    }
+    void *res = allocator->realloc(allocator->ctx, ptr, size);
+    if (res == NULL) {
+        if (depth >= 0) trackInsert(&trackTables[depth], ptr);
+        MemFail();
+    }
+
+    allocations++;
+    STAT_INC(STAT_ALLOCS);
+    STAT_ADD(STAT_ALLOC_BYTES, size);
+    discharge(oldSize);
+    charge(allocator->size(allocator->ctx, res));
+
+    // Przeniesiona pamięć należy do tej samej transakcji co poprzednia
+    if (depth >= 0) trackInsert(&trackTables[depth], res);
+    return res;
+}
+
+void safeFree(void *ptr) {
+    if (ptr == NULL) return;
+
+    const AllocatorT *allocator = AllocatorCurrent();
+    STAT_INC(STAT_FREES);
+    if (tracking()) untrack(ptr);
+    discharge(allocator->size(allocator->ctx, ptr));
+    allocator->free(allocator->ctx, ptr);
+}
+
+size_t memoryUsage(void) {
+    return atomic_load_explicit(&MemBudgetCurrent()->used,
+                                memory_order_relaxed);
+}
+
+size_t allocationCount(void) {
+    return allocations;
+}
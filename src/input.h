@@ -8,26 +8,205 @@
 
 #include "ctype.h"
 #include <sys/types.h>
+#include <setjmp.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <errno.h>
 
 /**
- * Zapewnia bezpieczne wczytanie linii, jeśli zabraknie pamięci program
- * zakończy się z kodem 1. Zwraca -1 jeśli wczytanie się nie uda
- * @param[in] line : tablica charów w której przechowywana będzie wczytana linia
- * @param[in] length : rozmiar tablicy
- * @return : długość wczytanej linii
+ * Struktura źródła wejścia kalkulatora. Plik regularny jest mapowany
+ * w całości do pamięci, pozostałe źródła (np. standardowe wejście) są
+ * czytane dużymi blokami do wewnętrznego bufora. Linie są zwracane jako
+ * wskaźniki do tego obszaru, bez kopiowania.
  */
-extern ssize_t safeGetline(char **line, size_t *length);
+typedef struct InputT {
+    char *data;        ///< zmapowany plik lub bufor bloków
+    size_t dataSize;   ///< liczba poprawnych bajtów w @p data
+    size_t capacity;   ///< rozmiar bufora (bez bajtu na znak '\0')
+    size_t pos;        ///< początek pierwszego nieprzeczytanego bajtu
+    size_t released;   ///< początek obszaru mapowania, który nie został zwolniony
+    char *tail;        ///< kopia ostatniej linii zmapowanego pliku bez '\n'
+    int fd;            ///< deskryptor czytanego pliku
+    bool mapped;       ///< czy @p data jest zmapowanym plikiem
+    bool eof;          ///< czy przeczytano już cały plik do bufora
+} InputT;
 
 /**
- * Zapewnia bezpieczną alokację pamięci, jeśli zabraknie pamięci program
- * zakończy się z kodem 1.
+ * Otwiera źródło wejścia. Jeśli @p path jest równe NULL, czyta standardowe
+ * wejście.
+ * @param[out] input : inicjalizowane źródło wejścia
+ * @param[in] path : ścieżka do pliku lub NULL
+ * @return : czy udało się otworzyć plik
+ */
+extern bool InputInit(InputT *input, const char *path);
+
+/**
+ * Inicjalizuje źródło wejścia czytające z otwartego deskryptora, np. gniazda.
+ * Źródło przejmuje deskryptor na własność.
+ * @param[out] input : inicjalizowane źródło wejścia
+ * @param[in] fd : deskryptor pliku
+ */
+extern void InputInitFd(InputT *input, int fd);
+
+/**
+ * Zwraca kolejną linię wejścia razem z kończącym ją znakiem '\n' (o ile
+ * występuje). Linia bez znaku '\n' jest zakończona znakiem '\0'. Zwrócony
+ * wskaźnik jest ważny do następnego wywołania i można go modyfikować
+ * w obrębie linii. Jeśli zabraknie pamięci program zakończy się z kodem 1.
+ * @param[in] input : źródło wejścia
+ * @param[out] line : wczytana linia
+ * @return : długość wczytanej linii lub -1, jeśli wejście się skończyło
+ */
+extern ssize_t InputGetLine(InputT *input, char **line);
+
+/**
+ * Zamyka źródło wejścia i zwalnia zaalokowaną pamięć
+ * @param[in] input : źródło wejścia
+ */
+extern void InputDestroy(InputT *input);
+
+/**
+ * Budżet pamięci, z którego korzystają funkcje safeMalloc, safeCalloc
+ * i safeRealloc. Wątek, który nie podłączył żadnego budżetu, korzysta
+ * z własnego budżetu bez limitu. Z jednego budżetu może korzystać kilka
+ * wątków (np. etapy potoku), które zwalniają nawzajem swoją pamięć.
+ */
+typedef struct MemBudgetT {
+    atomic_size_t used;     ///< liczba zaalokowanych i niezwolnionych bajtów
+    atomic_size_t peak;     ///< największa dotychczasowa wartość @p used
+    size_t limit;           ///< limit w bajtach (0 oznacza brak limitu)
+} MemBudgetT;
+
+/**
+ * Transakcja pamięci obejmująca jedną komendę lub jej fragment. Jeśli
+ * alokacja w transakcji przekroczyłaby limit budżetu (lub zabraknie pamięci),
+ * cała pamięć zaalokowana w transakcji i jeszcze niezwolniona jest zwalniana,
+ * a wykonanie wraca do punktu zapisanego w @p env przez setjmp z wartością 1:
+ * @code
+ * MemTxnT txn;
+ * MemTxnBegin(&txn);
+ * if (setjmp(txn.env) == 0) {
+ *     ...
+ *     MemTxnEnd(&txn);
+ * } else {
+ *     // transakcja została już wycofana
+ * }
+ * @endcode
+ * Kod wykonywany w transakcji nie może zwalniać ani modyfikować istniejących
+ * struktur przed ostatnią alokacją, ani dołączać do nich pamięci
+ * zaalokowanej w transakcji, jeśli później jeszcze alokuje. Limit nie
+ * dotyczy alokacji poza transakcjami. Gdy budżet nie ma limitu, alokacje nie
+ * są śledzone, a brak pamięci kończy program z kodem 1.
+ */
+typedef struct MemTxnT {
+    jmp_buf env;                ///< punkt powrotu po wycofaniu transakcji
+    struct MemTxnT *outer;      ///< transakcja zewnętrzna lub NULL
+    unsigned depth;             ///< poziom zagnieżdżenia
+    bool tracked;               ///< czy alokacje są śledzone
+} MemTxnT;
+
+/**
+ * Inicjalizuje budżet pamięci
+ * @param[out] budget : budżet
+ * @param[in] limit : limit w bajtach (0 oznacza brak limitu)
+ */
+extern void MemBudgetInit(MemBudgetT *budget, size_t limit);
+
+/**
+ * Podłącza budżet do bieżącego wątku. Budżet musi zostać odłączony
+ * (przez podłączenie NULL) dopiero po zwolnieniu pamięci z niego
+ * zaalokowanej przez ten wątek.
+ * @param[in] budget : budżet lub NULL dla własnego budżetu wątku
+ */
+extern void MemBudgetAttach(MemBudgetT *budget);
+
+/**
+ * Zwraca budżet bieżącego wątku
+ * @return : budżet
+ */
+extern MemBudgetT *MemBudgetCurrent(void);
+
+/**
+ * Rozpoczyna transakcję pamięci, zagnieżdżoną w bieżącej transakcji wątku
+ * @param[out] txn : transakcja
+ */
+extern void MemTxnBegin(MemTxnT *txn);
+
+/**
+ * Kończy transakcję. Pamięć zaalokowana w transakcji przechodzi do
+ * transakcji zewnętrznej, więc zostanie zwolniona, jeśli ta zostanie wycofana.
+ * @param[in] txn : transakcja
+ */
+extern void MemTxnEnd(MemTxnT *txn);
+
+/**
+ * Kończy transakcję. Pamięć zaalokowana w transakcji nie zostanie zwolniona
+ * nawet po wycofaniu transakcji zewnętrznej (np. wielomian odczytany z pliku
+ * i od razu zapisany na stosie).
+ * @param[in] txn : transakcja
+ */
+extern void MemTxnKeep(MemTxnT *txn);
+
+/**
+ * Wycofuje bieżącą transakcję wątku i wraca do jej punktu powrotu. Poza
+ * transakcją (lub gdy alokacje nie są śledzone) kończy program z kodem 1.
+ * Służy też do przekazania błędu do transakcji zewnętrznej po sprzątnięciu
+ * zasobów innych niż pamięć.
+ */
+extern _Noreturn void MemFail(void);
+
+/**
+ * Zapewnia bezpieczną alokację pamięci alokatorem bieżącego wątku (zob.
+ * AllocatorT), jeśli zabraknie pamięci lub zostanie przekroczony limit
+ * budżetu, wycofuje bieżącą transakcję (zob. MemTxnT).
  * @param[in] size : wielkość zaalokowanej pamięci
  * @return : wskaźnik na zaalokwaną pamięć
  */
 extern void *safeMalloc(size_t size);
 
+/**
+ * Zapewnia bezpieczną alokację wyzerowanej pamięci na tablicę, jeśli
+ * zabraknie pamięci lub zostanie przekroczony limit budżetu, wycofuje
+ * bieżącą transakcję.
+ * @param[in] count : liczba elementów tablicy
+ * @param[in] size : wielkość elementu tablicy
+ * @return : wskaźnik na zaalokwaną pamięć
+ */
+extern void *safeCalloc(size_t count, size_t size);
+
+/**
+ * Zapewnia bezpieczną zmianę rozmiaru zaalokowanej pamięci, jeśli
+ * zabraknie pamięci lub zostanie przekroczony limit budżetu, wycofuje
+ * bieżącą transakcję, a pamięć pod @p ptr pozostaje bez zmian. Dla
+ * rozmiaru 0 zwalnia pamięć i zwraca NULL.
+ * @param[in] ptr : wskaźnik na zaalokowaną pamięć lub NULL
+ * @param[in] size : nowa wielkość pamięci
+ * @return : wskaźnik na zaalokwaną pamięć
+ */
+extern void *safeRealloc(void *ptr, size_t size);
+
+/**
+ * Zwalnia pamięć zaalokowaną przez safeMalloc, safeCalloc lub safeRealloc.
+ * Bieżący wątek musi używać alokatora tego samego rodzaju co wątek, który
+ * zaalokował pamięć.
+ * @param[in] ptr : wskaźnik na zaalokowaną pamięć lub NULL
+ */
+extern void safeFree(void *ptr);
+
+/**
+ * Zwraca liczbę bajtów zaalokowanych z budżetu bieżącego wątku funkcjami
+ * safeMalloc, safeCalloc i safeRealloc, a jeszcze niezwolnionych
+ * @return : liczba zaalokowanych bajtów
+ */
+extern size_t memoryUsage(void);
+
+/**
+ * Zwraca liczbę wywołań safeMalloc, safeCalloc i safeRealloc wykonanych
+ * przez bieżący wątek
+ * @return : liczba alokacji
+ */
+extern size_t allocationCount(void);
+
 
 #endif //POLYNOMIALS_INPUT_H
@@ -0,0 +1,202 @@
+/** @file
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#define _GNU_SOURCE
+
+#include "pipeline.h"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include "input.h"
+
+/** Pojemność kolejek między etapami
+ */
+#define RING_CAPACITY 1024
+
+/** Liczba prób przed oddaniem procesora przez czekający wątek
+ */
+#define SPIN_COUNT 128
+
+/** Liczba oddań procesora, po których czekający wątek zaczyna zasypiać
+ */
+#define YIELD_COUNT 256
+
+/** Czas uśpienia czekającego wątku w nanosekundach
+ */
+#define SLEEP_NS 50000
+
+void RingInit(RingT *ring, size_t capacity, size_t elemSize) {
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->head, 0);
+    ring->headCache = ring->tailCache = 0;
+    ring->data = safeMalloc(capacity * elemSize);
+    ring->mask = capacity - 1;
+    ring->elemSize = elemSize;
+}
+
+void RingDestroy(RingT *ring) {
+    safeFree(ring->data);
+}
+
+/**
+ * Czeka na drugą stronę kolejki. Krótko czeka aktywnie, potem oddaje
+ * procesor, a jeśli druga strona długo nic nie robi (np. wykonuje długie
+ * mnożenie), zasypia, żeby nie zajmować rdzenia.
+ * @param[in,out] tries : liczba dotychczasowych prób
+ */
+static void backoff(unsigned *tries) {
+    if (*tries < SPIN_COUNT) {
+        (*tries)++;
+    } else if (*tries < SPIN_COUNT + YIELD_COUNT) {
+        (*tries)++;
+        sched_yield();
+    } else {
+        struct timespec ts = {.tv_sec = 0, .tv_nsec = SLEEP_NS};
+        nanosleep(&ts, NULL);
+    }
+}
+
+void RingPush(RingT *ring, const void *elem) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned tries = 0;
+
+    while (tail - ring->headCache > ring->mask) {
+        ring->headCache = atomic_load_explicit(&ring->head,
+                                               memory_order_acquire);
+        if (tail - ring->headCache > ring->mask) backoff(&tries);
+    }
+
+    memcpy(ring->data + (tail & ring->mask) * ring->elemSize, elem,
+           ring->elemSize);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+void RingPop(RingT *ring, void *elem) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned tries = 0;
+
+    while (head == ring->tailCache) {
+        ring->tailCache = atomic_load_explicit(&ring->tail,
+                                               memory_order_acquire);
+        if (head == ring->tailCache) backoff(&tries);
+    }
+
+    memcpy(elem, ring->data + (head & ring->mask) * ring->elemSize,
+           ring->elemSize);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * Stan potoku: kolejka komend między parserem a wątkiem wykonującym
+ * i kolejka wyników między wątkiem wykonującym a wątkiem wypisującym
+ */
+typedef struct PipelineT {
+    StackT *stack;          ///< stos
+    MemBudgetT *budget;     ///< budżet pamięci wspólny dla wszystkich etapów
+    RingT commands;         ///< sparsowane komendy
+    RingT outputs;          ///< wyniki komend
+    OutputT pending;        ///< wynik wykonywanej komendy
+} PipelineT;
+
+/**
+ * Wątek wykonujący komendy na stosie. Wynik komendy trafia do kolejki
+ * dopiero po jej zakończeniu, bo pamięć wycofanej komendy jest zwalniana
+ * przez ten wątek.
+ * @param[in] arg : stan potoku
+ * @return : NULL
+ */
+static void *executeStage(void *arg) {
+    PipelineT *pipeline = arg;
+    CommandT comm;
+
+    MemBudgetAttach(pipeline->budget);
+    do {
+        RingPop(&pipeline->commands, &comm);
+        executeCommand(pipeline->stack, &comm);
+        if (pipeline->pending.kind != OUT_NONE) {
+            RingPush(&pipeline->outputs, &pipeline->pending);
+            pipeline->pending.kind = OUT_NONE;
+        }
+    } while (comm.kind != COMM_END);
+
+    OutputT end = {.kind = OUT_END};
+    RingPush(&pipeline->outputs, &end);
+    return NULL;
+}
+
+/**
+ * Wątek wypisujący wyniki komend
+ * @param[in] arg : stan potoku
+ * @return : NULL
+ */
+static void *printStage(void *arg) {
+    PipelineT *pipeline = arg;
+    StackT *stack = pipeline->stack;
+    OutputT item;
+
+    MemBudgetAttach(pipeline->budget);
+    while (true) {
+        RingPop(&pipeline->outputs, &item);
+        switch (item.kind) {
+            case OUT_NONE:
+                break;
+            case OUT_END:
+                return NULL;
+            case OUT_NUMBER:
+                fprintf(stack->out, "%ld\n", item.num);
+                break;
+            case OUT_POLY:
+                PrintPoly(stack->out, &item.p);
+                fputc('\n', stack->out);
+                PolyDestroy(&item.p);
+                break;
+            case OUT_ERROR:
+                fprintf(stack->err, "ERROR %zu %s\n", item.line, item.error);
+                break;
+            case OUT_TEXT:
+                fputs(item.text, stack->err);
+                free(item.text);
+                break;
+            case OUT_NUMBERS:
+                fputs(item.text, stack->out);
+                free(item.text);
+                break;
+        }
+    }
+}
+
+void parseInputPipelined(StackT *stack, InputT *input) {
+    PipelineT pipeline = {.stack = stack, .budget = MemBudgetCurrent(),
+                          .pending = {.kind = OUT_NONE}};
+    RingInit(&pipeline.commands, RING_CAPACITY, sizeof(CommandT));
+    RingInit(&pipeline.outputs, RING_CAPACITY, sizeof(OutputT));
+    stack->output = &pipeline.pending;
+
+    pthread_t executor, printer;
+    if (pthread_create(&executor, NULL, executeStage, &pipeline) != 0 ||
+        pthread_create(&printer, NULL, printStage, &pipeline) != 0)
+        exit(1);
+
+    // Bieżący wątek czyta i parsuje wejście
+    size_t currLine = 1;
+    ssize_t lineLen;
+    char *buffer;
+    CommandT comm;
+
+    while ((lineLen = InputGetLine(input, &buffer)) != -1) {
+        parseLine(buffer, lineLen, currLine, &comm);
+        if (comm.kind != COMM_NONE) RingPush(&pipeline.commands, &comm);
+        currLine++;
+    }
+    comm.kind = COMM_END;
+    RingPush(&pipeline.commands, &comm);
+
+    pthread_join(executor, NULL);
+    pthread_join(printer, NULL);
+    stack->output = NULL;
+    RingDestroy(&pipeline.commands);
+    RingDestroy(&pipeline.outputs);
+}
@@ -0,0 +1,102 @@
+/** @file
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#ifndef POLYNOMIALS_PIPELINE_H
+#define POLYNOMIALS_PIPELINE_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include "poly_parser.h"
+
+/** Rozmiar linii pamięci podręcznej procesora
+ */
+#define CACHE_LINE_SIZE 64
+
+/**
+ * Ograniczona kolejka cykliczna bez blokad dla jednego producenta i jednego
+ * konsumenta. Indeksy producenta i konsumenta leżą w osobnych liniach
+ * pamięci podręcznej, a każda strona pamięta ostatnio odczytany indeks
+ * drugiej strony, więc w typowym przypadku wstawienie i pobranie elementu
+ * nie odczytują współdzielonej linii.
+ */
+typedef struct RingT {
+    alignas(CACHE_LINE_SIZE) atomic_size_t tail;    ///< indeks następnego wstawianego elementu
+    size_t headCache;                               ///< ostatnio odczytany indeks konsumenta
+    alignas(CACHE_LINE_SIZE) atomic_size_t head;    ///< indeks następnego pobieranego elementu
+    size_t tailCache;                               ///< ostatnio odczytany indeks producenta
+    alignas(CACHE_LINE_SIZE) unsigned char *data;   ///< elementy kolejki
+    size_t mask;                                    ///< pojemność kolejki minus 1
+    size_t elemSize;                                ///< rozmiar elementu
+} RingT;
+
+/**
+ * Rodzaj wyniku przekazywanego do wątku wypisującego
+ */
+typedef enum OutputKindT {
+    OUT_NONE,       ///< brak wyniku
+    OUT_END,        ///< koniec wyników
+    OUT_NUMBER,     ///< liczba
+    OUT_POLY,       ///< wielomian
+    OUT_ERROR,      ///< komunikat o błędzie
+    OUT_TEXT,       ///< gotowy tekst do wypisania na wyjście błędów
+    OUT_NUMBERS,    ///< gotowy tekst z liczbami do wypisania na wyjście
+} OutputKindT;
+
+/**
+ * Wynik komendy przekazywany do wątku wypisującego
+ */
+typedef struct OutputT {
+    OutputKindT kind;           ///< rodzaj wyniku
+    size_t line;                ///< nr linii dla #OUT_ERROR
+    union {
+        long num;               ///< liczba dla #OUT_NUMBER
+        Poly p;                 ///< wielomian dla #OUT_POLY (na własność)
+        const char *error;      ///< komunikat dla #OUT_ERROR
+        char *text;             ///< tekst dla #OUT_TEXT i #OUT_NUMBERS
+                                ///< (zwalniany przez free)
+    };
+} OutputT;
+
+/**
+ * Inicjalizuje kolejkę
+ * @param[out] ring : kolejka
+ * @param[in] capacity : pojemność kolejki, potęga dwójki
+ * @param[in] elemSize : rozmiar elementu
+ */
+extern void RingInit(RingT *ring, size_t capacity, size_t elemSize);
+
+/**
+ * Zwalnia pamięć kolejki
+ * @param[in] ring : kolejka
+ */
+extern void RingDestroy(RingT *ring);
+
+/**
+ * Wstawia element do kolejki, czekając, jeśli kolejka jest pełna. Może być
+ * wywoływana tylko przez wątek producenta.
+ * @param[in] ring : kolejka
+ * @param[in] elem : wstawiany element
+ */
+extern void RingPush(RingT *ring, const void *elem);
+
+/**
+ * Pobiera element z kolejki, czekając, jeśli kolejka jest pusta. Może być
+ * wywoływana tylko przez wątek konsumenta.
+ * @param[in] ring : kolejka
+ * @param[out] elem : pobrany element
+ */
+extern void RingPop(RingT *ring, void *elem);
+
+/**
+ * Odpowiednik parseInput, w którym czytanie i parsowanie wejścia, wykonywanie
+ * komend oraz wypisywanie wyników odbywają się na trzech osobnych wątkach
+ * połączonych kolejkami. Kolejność wyników i numery linii w komunikatach
+ * o błędach są takie same jak w parseInput.
+ * @param[in] stack : stos
+ * @param[in] input : źródło wejścia
+ */
+extern void parseInputPipelined(StackT *stack, InputT *input);
+
+#endif //POLYNOMIALS_PIPELINE_H
@@ -4,41 +4,333 @@
  */
 
 #include "poly.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdlib.h>
-#include <errno.h>
+#include <string.h>
 #include "input.h"
+#include "poly_internal.h"
+#include "stats.h"
+#include "trace.h"
 
 /** Poczatkowy rozmiar tablicy monosow w PolyMul
  */
 #define INIT_MONOS_SIZE 16
 
-/** Sprawdza poprawność alokacji
-*/
-#define CHECK_PTR(p)  \
-  do {                \
-    if (p == NULL) {  \
-      exit(1);        \
-    }                 \
-  } while (0)
+/** Początkowa liczba miejsc w tablicy internowanych wielomianów
+ */
+#define INTERN_INIT_SLOTS 1024
+
+/** Mnożnik funkcji skrótu tablicy internowanych wielomianów
+ */
+#define INTERN_HASH_MUL 0x9E3779B97F4A7C15ULL
+
+/**
+ * Tablica jednomianów z licznikiem odwołań. Wielomiany wskazują na pole
+ * monos. Tablica wskazywana przez więcej niż jeden wielomian lub
+ * internowana jest niezmienna, przed zmianą trzeba zrobić jej prywatną
+ * kopię (zob. makeUnique).
+ */
+typedef struct MonoArrT {
+    atomic_size_t refs;     ///< liczba wielomianów wskazujących na tablicę
+    bool interned;          ///< czy tablica jest w tablicy internowanych
+    Mono monos[];           ///< jednomiany
+} MonoArrT;
+
+/**
+ * Miejsce w tablicy internowanych wielomianów. Puste miejsce ma @p arr
+ * równe NULL.
+ */
+typedef struct InternSlotT {
+    MonoArrT *arr;      ///< internowana tablica jednomianów
+    size_t size;        ///< liczba jednomianów
+    size_t hash;        ///< skrót jednomianów
+} InternSlotT;
+
+/**
+ * Zbiór internowanych tablic jednomianów (tablica z haszowaniem otwartym).
+ * Tablica nie zwiększa liczników odwołań, internowana tablica jest z niej
+ * usuwana, gdy zwalnia ją ostatni wielomian.
+ */
+typedef struct InternTableT {
+    InternSlotT *slots; ///< miejsca tablicy
+    size_t mask;        ///< liczba miejsc minus 1
+    size_t used;        ///< liczba zajętych miejsc
+} InternTableT;
+
+/** Tablica internowanych wielomianów wspólna dla wszystkich wątków
+ */
+static InternTableT internTable;
+
+/** Chroni @p internTable i zmniejszanie liczników internowanych tablic do 0
+ */
+static pthread_mutex_t internMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Zwraca nagłówek tablicy jednomianów
+ * @param[in] arr : tablica jednomianów
+ * @return : nagłówek tablicy
+ */
+static MonoArrT *arrHeader(const Mono *arr) {
+    return (MonoArrT *) ((char *) arr - offsetof(MonoArrT, monos));
+}
+
+Mono *MonoArrAlloc(size_t count) {
+    STAT_INC(STAT_NODES_ALLOCATED);
+    MonoArrT *header = safeMalloc(sizeof(MonoArrT) + count * sizeof(Mono));
+    atomic_init(&header->refs, 1);
+    header->interned = false;
+    return header->monos;
+}
+
+void MonoArrFree(Mono *arr) {
+    STAT_INC(STAT_NODES_FREED);
+    safeFree(arrHeader(arr));
+}
+
+/**
+ * Zmienia rozmiar tablicy jednomianów, na którą wskazuje tylko jeden
+ * wielomian
+ * @param[in] arr : tablica jednomianów
+ * @param[in] count : nowa liczba jednomianów
+ * @return : tablica o nowym rozmiarze
+ */
+static Mono *monoArrResize(Mono *arr, size_t count) {
+    MonoArrT *header = safeRealloc(arrHeader(arr),
+                                   sizeof(MonoArrT) + count * sizeof(Mono));
+    return header->monos;
+}
+
+/**
+ * Liczy skrót tablicy jednomianów, których współczynniki są internowane.
+ * Niestałe współczynniki są rozróżniane po adresie tablicy.
+ * @param[in] count : liczba jednomianów
+ * @param[in] monos : jednomiany
+ * @return : skrót
+ */
+static size_t hashMonos(size_t count, const Mono *monos) {
+    uint64_t hash = count;
+    for (size_t i = 0; i < count; ++i) {
+        const Poly *p = &monos[i].p;
+        hash = (hash ^ (uint64_t) monos[i].exp) * INTERN_HASH_MUL;
+        hash = (hash ^ (PolyIsCoeff(p) ? (uint64_t) p->coeff
+                                       : (uint64_t) (uintptr_t) p->arr)) *
+               INTERN_HASH_MUL;
+    }
+    return (size_t) (hash ^ (hash >> 32));
+}
+
+/**
+ * Sprawdza, czy dwie tablice jednomianów o internowanych współczynnikach
+ * są równe. Internowane współczynniki są równe, gdy są tą samą tablicą.
+ * @param[in] count : liczba jednomianów
+ * @param[in] a : jednomiany
+ * @param[in] b : jednomiany
+ * @return : czy tablice są równe
+ */
+static bool sameMonos(size_t count, const Mono *a, const Mono *b) {
+    for (size_t i = 0; i < count; ++i) {
+        if (a[i].exp != b[i].exp || a[i].p.arr != b[i].p.arr) return false;
+        if (PolyIsCoeff(&a[i].p) && a[i].p.coeff != b[i].p.coeff)
+            return false;
+    }
+    return true;
+}
+
+static void internInsert(MonoArrT *arr, size_t size, size_t hash);
+
+/**
+ * Powiększa dwukrotnie tablicę internowanych wielomianów. Tablica jest
+ * alokowana bezpośrednio przez calloc, bo nie należy do budżetu żadnej
+ * komendy.
+ */
+static void internGrow(void) {
+    InternTableT old = internTable;
+    size_t slots = old.slots != NULL ? 2 * (old.mask + 1) : INTERN_INIT_SLOTS;
+
+    internTable.slots = calloc(slots, sizeof(InternSlotT));
+    if (internTable.slots == NULL) exit(1);
+    internTable.mask = slots - 1;
+    internTable.used = 0;
+
+    for (size_t i = 0; old.slots != NULL && i <= old.mask; ++i) {
+        if (old.slots[i].arr != NULL)
+            internInsert(old.slots[i].arr, old.slots[i].size,
+                         old.slots[i].hash);
+    }
+    free(old.slots);
+}
+
+/**
+ * Wpisuje tablicę jednomianów do tablicy internowanych wielomianów
+ * @param[in] arr : tablica jednomianów
+ * @param[in] size : liczba jednomianów
+ * @param[in] hash : skrót jednomianów
+ */
+static void internInsert(MonoArrT *arr, size_t size, size_t hash) {
+    if (internTable.slots == NULL ||
+        2 * (internTable.used + 1) > internTable.mask + 1)
+        internGrow();
+
+    size_t i = hash & internTable.mask;
+    while (internTable.slots[i].arr != NULL) i = (i + 1) & internTable.mask;
+    internTable.slots[i] = (InternSlotT) {.arr = arr, .size = size,
+                                          .hash = hash};
+    internTable.used++;
+}
+
+/**
+ * Szuka w tablicy internowanych wielomianów tablicy równej podanej
+ * @param[in] size : liczba jednomianów
+ * @param[in] monos : jednomiany o internowanych współczynnikach
+ * @param[in] hash : skrót jednomianów
+ * @return : znaleziona tablica lub NULL
+ */
+static MonoArrT *internFind(size_t size, const Mono *monos, size_t hash) {
+    if (internTable.slots == NULL) return NULL;
+
+    size_t i = hash & internTable.mask;
+    for (InternSlotT *slot; (slot = &internTable.slots[i])->arr != NULL;
+         i = (i + 1) & internTable.mask) {
+        if (slot->hash == hash && slot->size == size &&
+            sameMonos(size, slot->arr->monos, monos))
+            return slot->arr;
+    }
+    return NULL;
+}
+
+/**
+ * Usuwa tablicę jednomianów z tablicy internowanych wielomianów, przesuwając
+ * wstecz dalsze wpisy tego samego ciągu, żeby nie zostawiać usuniętych
+ * miejsc. Pusta tablica jest zwalniana.
+ * @param[in] arr : tablica jednomianów
+ * @param[in] hash : skrót jednomianów
+ */
+static void internRemove(const MonoArrT *arr, size_t hash) {
+    size_t mask = internTable.mask, i = hash & mask;
+    while (internTable.slots[i].arr != arr) i = (i + 1) & mask;
+
+    for (size_t j = (i + 1) & mask; internTable.slots[j].arr != NULL;
+         j = (j + 1) & mask) {
+        // Wpis może zająć zwolnione miejsce, jeśli nie leży ono między
+        // miejscem startowym wpisu a jego obecnym miejscem
+        size_t home = internTable.slots[j].hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            internTable.slots[i] = internTable.slots[j];
+            i = j;
+        }
+    }
+    internTable.slots[i].arr = NULL;
+
+    if (--internTable.used == 0) {
+        free(internTable.slots);
+        internTable = (InternTableT) {0};
+    }
+}
+
+/**
+ * Zmniejsza licznik odwołań internowanej tablicy jednomianów. Licznik jest
+ * zmniejszany do 0 tylko pod blokadą tablicy internowanych, żeby inny wątek
+ * nie znalazł w niej zwalnianej tablicy.
+ * @param[in] p : wielomian wskazujący na internowaną tablicę
+ * @return : czy był to ostatni wielomian wskazujący na tablicę
+ */
+static bool internRelease(const Poly *p) {
+    MonoArrT *header = arrHeader(p->arr);
+    size_t refs = atomic_load_explicit(&header->refs, memory_order_relaxed);
+    while (refs > 1) {
+        if (atomic_compare_exchange_weak_explicit(&header->refs, &refs,
+                                                  refs - 1,
+                                                  memory_order_acq_rel,
+                                                  memory_order_relaxed))
+            return false;
+    }
+
+    pthread_mutex_lock(&internMutex);
+    bool last = atomic_fetch_sub_explicit(&header->refs, 1,
+                                          memory_order_acq_rel) == 1;
+    if (last) internRemove(header, hashMonos(p->size, p->arr));
+    pthread_mutex_unlock(&internMutex);
+    return last;
+}
+
+void PolyIntern(Poly *p) {
+    if (PolyIsCoeff(p) || arrHeader(p->arr)->interned) return;
+
+    for (size_t i = 0; i < p->size; ++i) {
+        PolyIntern(&p->arr[i].p);
+    }
+
+    size_t hash = hashMonos(p->size, p->arr);
+    pthread_mutex_lock(&internMutex);
+    MonoArrT *found = internFind(p->size, p->arr, hash);
+    if (found != NULL) {
+        atomic_fetch_add_explicit(&found->refs, 1, memory_order_relaxed);
+    } else {
+        internInsert(arrHeader(p->arr), p->size, hash);
+        arrHeader(p->arr)->interned = true;
+    }
+    pthread_mutex_unlock(&internMutex);
+
+    if (found != NULL) {
+        STAT_INC(STAT_INTERN_HITS);
+        PolyDestroy(p);
+        p->arr = found->monos;
+    } else {
+        STAT_INC(STAT_INTERNED);
+    }
+}
 
 void PolyDestroy(Poly *p) {
     if (p->arr) {
+        // Jedyny właściciel nie musi zmniejszać licznika atomowo, bo nikt
+        // inny nie może go już zwiększyć
+        MonoArrT *header = arrHeader(p->arr);
+        if (header->interned) {
+            if (!internRelease(p)) return;
+        } else if (atomic_load_explicit(&header->refs,
+                                        memory_order_acquire) != 1 &&
+                   atomic_fetch_sub_explicit(&header->refs, 1,
+                                             memory_order_acq_rel) != 1) {
+            return;
+        }
+
         for (size_t i = 0; i < p->size; ++i) {
             MonoDestroy(&p->arr[i]);
         }
-        free(p->arr);
+        MonoArrFree(p->arr);
     }
 }
 
 Poly PolyClone(const Poly *p) {
     if (PolyIsCoeff(p)) return PolyFromCoeff(p->coeff);
 
-    Poly clone = {.size = p->size, .arr = calloc(p->size, sizeof(Mono))};
-    CHECK_PTR(&clone.arr);
+    STAT_INC(STAT_POLY_CLONE);
+    atomic_fetch_add_explicit(&arrHeader(p->arr)->refs, 1,
+                              memory_order_relaxed);
+    return *p;
+}
+
+/**
+ * Zapewnia, że tablica jednomianów wielomianu nie jest współdzielona ani
+ * internowana, robiąc w razie potrzeby jej prywatną kopię. Kopia współdzieli
+ * jednomiany z oryginałem, więc kopiowany jest tylko jeden poziom.
+ * @param[in,out] p : wielomian
+ */
+static void makeUnique(Poly *p) {
+    if (PolyIsCoeff(p) || (!arrHeader(p->arr)->interned &&
+                           atomic_load_explicit(&arrHeader(p->arr)->refs,
+                                                memory_order_acquire) == 1))
+        return;
+
+    STAT_INC(STAT_COW_COPIES);
+    Poly copy = {.size = p->size, .arr = MonoArrAlloc(p->size)};
     for (size_t i = 0; i < p->size; ++i) {
-        clone.arr[i] = MonoClone(&p->arr[i]);
+        copy.arr[i] = MonoClone(&p->arr[i]);
     }
-    return clone;
+    PolyDestroy(p);
+    *p = copy;
 }
 
 /**
@@ -53,141 +345,119 @@ static int CmpMonos(const void *a, const void *b) {
     return -1;
 }
 
-/**
- * Sortuje wielomian w porządku rosnącym względem współczynnika potęgowego
- * przy zmienne x_0
- * @param[in] p : wielomian
- */
-static void PolySort(Poly *p) {
-    if (!PolyIsCoeff(p)) {
-        for (size_t i = 0; i < p->size; ++i) {
-            PolySort(&p->arr[i].p);
-        }
-        qsort(p->arr, p->size, sizeof(Mono), CmpMonos);
-    }
-}
-
 /**
  * Sortuje tablice jednomianów w porządku rosnącym względem wspólczynnika
- * potęgowego przy zmiennej x_0
+ * potęgowego przy zmiennej x_0. Współczynniki jednomianów są poprawnymi
+ * wielomianami, więc są już posortowane (i mogą być współdzielone).
  * @param[in] count : długość tablicy @monos
  * @param[in] monos : tablica jednomianów
  */
 static void SortMonos(size_t count, Mono monos[]) {
+    STAT_INC(STAT_SORTS);
+    STAT_ADD(STAT_SORTED_MONOS, count);
+    STAT_MAX(STAT_MAX_SORT, count);
     qsort(monos, count, sizeof(Mono), CmpMonos);
-    for (size_t i = 0; i < count; ++i) {
-        PolySort(&monos[i].p);
-    }
 }
 
+static Poly addSigned(const Poly *p, const Poly *q, bool subtract);
+
 /**
- * Sprawdza czy suma dwóch wielomianów da wielomian zerowy
- * @param[in] p : wielomian
- * @param[in] q : wielomian
- * @return Czy suma dwóch wielomianów da wielomian zerowy
- */
-static bool isAddResEqZero(Poly *p, Poly *q) {
-    Poly pCopy = PolyClone(p), qCopy = PolyClone(q);
-    Poly sum = PolyAdd(&pCopy, &qCopy);
-    bool res = false;
-    if (isPolyZeroRec(&sum)) res = true;
-    PolyDestroy(&pCopy);
-    PolyDestroy(&qCopy);
-    PolyDestroy(&sum);
-    return res;
+ * Kopiuje jednomian, w razie potrzeby zmieniając jego znak
+ * @param[in] m : jednomian
+ * @param[in] negate : czy zmienić znak
+ * @return : @f$m@f$ lub @f$-m@f$
+ */
+static Mono monoSigned(const Mono *m, bool negate) {
+    if (!negate) return MonoClone(m);
+    return (Mono) {.p = PolyNeg(&m->p), .exp = m->exp};
 }
 
 /**
- * Dodaje do siebie dwa wielomiany spośród których p jest wielomianem stałym
- * a q jest wielomianem nie stałym
- * @param p : wielomian
- * @param q : wielomian
- * @return @f$p + q@f$
+ * Zamienia wielomian na współczynnik, jeśli ma tylko wyraz wolny będący
+ * stałą (zob. isPolyCoeffRec)
+ * @param[in,out] p : niepusty wielomian
  */
-static Poly AddPolyAndCoeff(const Poly *p, const Poly *q) {
-    assert(PolyIsCoeff(p) && !PolyIsCoeff(q));
-    Poly r = {.size = q->size + 1, .arr = calloc((q->size + 1), sizeof(Mono))};
-    CHECK_PTR(&r.arr);
-
-    for (size_t i = 0; i < q->size; ++i) {
-        r.arr[i] = MonoClone(&q->arr[i]);
+static void collapseCoeff(Poly *p) {
+    if (p->size == 1 && p->arr[0].exp == 0 && isPolyCoeffRec(&p->arr[0].p)) {
+        poly_coeff_t coeff = getCoeff(&p->arr[0].p);
+        PolyDestroy(p);
+        *p = PolyFromCoeff(coeff);
     }
+}
 
-    if (!PolyIsZero(p)) {
-        r.arr[q->size] = MonoFromPoly(p, 0);
-    } else {
-        r.size--;
-        r.arr = realloc(r.arr, r.size * sizeof(Mono));
-        CHECK_PTR(&r.arr);
+/**
+ * Dodaje do współczynnika wielomian nie stały lub go od niego odejmuje
+ * @param coeff : współczynnik
+ * @param q : wielomian
+ * @param subtract : czy odjąć @p q
+ * @return @f$coeff \pm q@f$
+ */
+static Poly AddPolyAndCoeff(poly_coeff_t coeff, const Poly *q, bool subtract) {
+    assert(!PolyIsCoeff(q));
+    if (coeff == 0) return subtract ? PolyNeg(q) : PolyClone(q);
+
+    // Jednomiany q są posortowane, więc wyraz wolny może być tylko pierwszy
+    if (q->arr[0].exp != 0) {
+        Poly r = {.size = q->size + 1, .arr = MonoArrAlloc(q->size + 1)};
+        r.arr[0] = (Mono) {.p = PolyFromCoeff(coeff), .exp = 0};
+        for (size_t i = 0; i < q->size; ++i) {
+            r.arr[i + 1] = monoSigned(&q->arr[i], subtract);
+        }
         return r;
     }
 
-    if (r.arr[0].exp == r.arr[q->size].exp) {
-        Poly temp = r.arr[0].p;
-        if (isAddResEqZero(&r.arr[0].p, &r.arr[q->size].p)) {
-            for (size_t i = 0; i < r.size - 2; ++i) {
-                Mono tempor = r.arr[i];
-                r.arr[i] = MonoClone(&r.arr[i + 1]);
-                MonoDestroy(&tempor);
-            }
-            r.size -= 2;
-            r.arr = realloc(r.arr, r.size * sizeof(Mono));
-            CHECK_PTR(&r.arr);
-        } else {
-            r.arr[0].p = PolyAdd(&r.arr[0].p, &r.arr[q->size].p);
-            r.arr[0].exp = 0;
-            r.size--;
-            r.arr = realloc(r.arr, r.size * sizeof(Mono));
-            CHECK_PTR(&r.arr);
-        }
-        PolyDestroy(&temp);
-    } else PolySort(&r);
+    Poly c = PolyFromCoeff(coeff);
+    Poly first = addSigned(&c, &q->arr[0].p, subtract);
+    size_t skip = PolyIsCoeff(&first) && first.coeff == 0 ? 1 : 0;
+    if (q->size == skip) return PolyZero();
+
+    Poly r = {.size = q->size - skip, .arr = MonoArrAlloc(q->size - skip)};
+    if (skip == 0) r.arr[0] = MonoFromPoly(&first, 0);
+    for (size_t i = 1; i < q->size; ++i) {
+        r.arr[i - skip] = monoSigned(&q->arr[i], subtract);
+    }
 
+    collapseCoeff(&r);
     return r;
 }
 
 /**
  * Łączy ze sobą 2 wielomiany dodając je w kolejności rosnącej do tablicy
  * wielomianu res, jeśli exp jednomianów w p i q są takie same to je dodaje
- * a wynik wpisuje do tablicy wielomianu res.
+ * (lub odejmuje) a wynik wpisuje do tablicy wielomianu res. Wielomiany są
+ * w postaci kanonicznej, więc zerem może być tylko suma współczynników
+ * równa współczynnikowi 0 i tylko takie sumy są pomijane już przy łączeniu.
  * @param res : wielomian
  * @param p : wielomian
  * @param q : wielomian
+ * @param subtract : czy odjąć @p q
  * @return : rozmiar tablicy wielomianu res
  */
-static int merge2Polys(Poly *res, const Poly *p, const Poly *q) {
+static size_t merge2Polys(Poly *res, const Poly *p, const Poly *q,
+                          bool subtract) {
     size_t pInd = 0, qInd = 0, i = 0;
 
     while (pInd < p->size && qInd < q->size) {
         poly_exp_t p_exp = p->arr[pInd].exp, q_exp = q->arr[qInd].exp;
 
         if (p_exp < q_exp) {
-            res->arr[i] = MonoClone(&p->arr[pInd]);
-            pInd++;
-            i++;
+            res->arr[i++] = MonoClone(&p->arr[pInd++]);
         } else if (p_exp > q_exp) {
-            res->arr[i] = MonoClone(&q->arr[qInd]);
-            qInd++;
-            i++;
+            res->arr[i++] = monoSigned(&q->arr[qInd++], subtract);
         } else {
-            res->arr[i].p = PolyAdd(&p->arr[pInd].p, &q->arr[qInd].p);
-            res->arr[i].exp = p_exp;
-            i++;
-            pInd++;
-            qInd++;
+            Poly sum = addSigned(&p->arr[pInd++].p, &q->arr[qInd++].p,
+                                 subtract);
+            if (!PolyIsCoeff(&sum) || sum.coeff != 0)
+                res->arr[i++] = (Mono) {.p = sum, .exp = p_exp};
         }
     }
 
     while (pInd < p->size) {
-        res->arr[i] = MonoClone(&p->arr[pInd]);
-        i++;
-        pInd++;
+        res->arr[i++] = MonoClone(&p->arr[pInd++]);
     }
 
     while (qInd < q->size) {
-        res->arr[i] = MonoClone(&q->arr[qInd]);
-        i++;
-        qInd++;
+        res->arr[i++] = monoSigned(&q->arr[qInd++], subtract);
     }
 
     return i;
@@ -195,58 +465,51 @@ static int merge2Polys(Poly *res, const Poly *p, const Poly *q) {
 
 /**
  * Dodaje do siebie dwa wielomiany które nie są wielomianami stałymi
+ * lub odejmuje jeden od drugiego. Tablica wyniku jest alokowana na zapas
+ * i zmniejszana co najwyżej raz.
  * @param p : wielomian
  * @param q : wielomian
- * @return @f$p + q@f$
+ * @param subtract : czy odjąć @p q
+ * @return @f$p \pm q@f$
  */
-static Poly Add2Polys(const Poly *p, const Poly *q) {
-    Poly res;
-    res.size = p->size + q->size;
-    res.arr = calloc(res.size, sizeof(Mono));
-    CHECK_PTR(&res.arr);
-
-    size_t corrSize = merge2Polys(&res, p, q);
-
-    if (corrSize < p->size + q->size) {
-        if (corrSize == 0) { PolyDestroy(&res); return PolyZero(); }
+static Poly Add2Polys(const Poly *p, const Poly *q, bool subtract) {
+    Poly res = {.arr = MonoArrAlloc(p->size + q->size)};
+    res.size = merge2Polys(&res, p, q, subtract);
 
-        res.arr = realloc(res.arr, corrSize * sizeof(Mono));
-        CHECK_PTR(&res.arr);
-        res.size = corrSize;
-        if (res.size == 1 && res.arr[0].exp == 0) {
-            poly_coeff_t resCoeff = res.arr[0].p.coeff;
-            PolyDestroy(&res);
-            return PolyFromCoeff(resCoeff);
-        }
-    }
-
-    for (size_t i = 0; i < res.size; ++i) {
-        if (isPolyZeroRec(&res.arr[i].p)) {
-            for (size_t j = i; j < res.size - 1; ++j) {
-                Mono tempor = res.arr[j];
-                res.arr[j] = MonoClone(&res.arr[j + 1]);
-                MonoDestroy(&tempor);
-            }
-            res.size--;
-        }
+    if (res.size == 0) {
+        PolyDestroy(&res);
+        return PolyZero();
     }
-
-    res.arr = realloc(res.arr, res.size * sizeof(Mono));
-    CHECK_PTR(&res.arr);
-    if (res.size == 0) return PolyZero();
+    collapseCoeff(&res);
+    if (!PolyIsCoeff(&res) && res.size < p->size + q->size)
+        res.arr = monoArrResize(res.arr, res.size);
 
     return res;
 }
 
-
-Poly PolyAdd(const Poly *p, const Poly *q) {
+/**
+ * Dodaje do siebie dwa wielomiany lub odejmuje jeden od drugiego. Przy
+ * odejmowaniu jednomiany @p q zmieniają znak w trakcie łączenia, bez
+ * kopiowania całego @p q.
+ * @param p : wielomian
+ * @param q : wielomian
+ * @param subtract : czy odjąć @p q
+ * @return @f$p \pm q@f$
+ */
+static Poly addSigned(const Poly *p, const Poly *q, bool subtract) {
+    STAT_INC(STAT_POLY_ADD);
     if (PolyIsCoeff(p) && PolyIsCoeff(q))
-        return PolyFromCoeff(p->coeff + q->coeff);
-    if (PolyIsCoeff(p)) return AddPolyAndCoeff(p, q);
-    if (PolyIsCoeff(q)) return AddPolyAndCoeff(q, p);
-    return Add2Polys(p, q);
+        return PolyFromCoeff(subtract ? p->coeff - q->coeff
+                                      : p->coeff + q->coeff);
+    if (PolyIsCoeff(p)) return AddPolyAndCoeff(p->coeff, q, subtract);
+    if (PolyIsCoeff(q))
+        return AddPolyAndCoeff(subtract ? -q->coeff : q->coeff, p, false);
+    return Add2Polys(p, q, subtract);
 }
 
+Poly PolyAdd(const Poly *p, const Poly *q) {
+    return addSigned(p, q, false);
+}
 
 bool isPolyZeroRec(const Poly *p) {
     if (PolyIsCoeff(p) && p->coeff == 0) return true;
@@ -276,7 +539,7 @@ bool isPolyCoeffRec(const Poly *p) {
     return true;
 }
 
-poly_coeff_t getCoeff(Poly *p) {
+poly_coeff_t getCoeff(const Poly *p) {
     assert(isPolyCoeffRec(p));
     if (PolyIsCoeff(p)) return p->coeff;
     return getCoeff(&p->arr[0].p);
@@ -297,49 +560,56 @@ static void makeMonoCopy(size_t count, const Mono *monos, Mono *monosCopy) {
 
 Poly PolyAddMonos(size_t count, const Mono monos[]) {
 
+    STAT_INC(STAT_POLY_ADD_MONOS);
     if (count == 0) return PolyZero();
 
-    Poly p = {.size = count, .arr = calloc(count, sizeof(Mono))};
-    CHECK_PTR(&p.arr);
+    Poly p = {.size = count, .arr = MonoArrAlloc(count)};
 
     Mono *monosCopy = safeMalloc(count * sizeof(Mono));
+    TRACE_BEGIN(TRACE_SORT, sortMark);
     makeMonoCopy(count, monos, monosCopy);
+    TRACE_END(TRACE_SORT, sortMark);
 
+    // Jednomiany są przenoszone do wyniku, a te o powtarzających się
+    // wykładnikach są do nich dodawane i zwalniane
+    TRACE_BEGIN(TRACE_COMBINE, combineMark);
     size_t index = 0;
-    p.arr[0] = MonoClone(&monosCopy[0]);
+    p.arr[0] = monosCopy[0];
     for (size_t i = 1; i < count; i++) {
-        if (monosCopy[i - 1].exp == monosCopy[i].exp) {
+        if (p.arr[index].exp == monosCopy[i].exp) {
             Poly temp = p.arr[index].p;
             p.arr[index].p = PolyAdd(&monosCopy[i].p, &temp);
             PolyDestroy(&temp);
+            MonoDestroy(&monosCopy[i]);
         } else {
             if (isPolyZeroRec(&p.arr[index].p)) {
                 MonoDestroy(&p.arr[index]);
             } else {
                 index++;
             }
-            p.arr[index] = MonoClone(&monosCopy[i]);
+            p.arr[index] = monosCopy[i];
         }
     }
-
-    for (size_t i = 0; i < count; ++i) {
-        MonoDestroy(&monosCopy[i]);
+    p.size = index + 1;
+    if (isPolyZeroRec(&p.arr[index].p)) {
+        MonoDestroy(&p.arr[index]);
+        p.size--;
     }
-    free(monosCopy);
-
-    if (isPolyZeroRec(&p)) { PolyDestroy(&p); return PolyZero(); }
+    safeFree(monosCopy);
+    TRACE_END(TRACE_COMBINE, combineMark);
 
-    if (isPolyCoeffRec(&p)) {
+    TRACE_BEGIN(TRACE_CANONICALISE, canonMark);
+    if (p.size == 0) {
+        PolyDestroy(&p);
+        p = PolyZero();
+    } else if (isPolyCoeffRec(&p)) {
         poly_coeff_t coeff = getCoeff(&p);
         PolyDestroy(&p);
-        return PolyFromCoeff(coeff);
-    }
-
-    if (index + 1 != count) {
-        p.size = index + 1;
-        p.arr = realloc(p.arr, p.size * sizeof(Mono));
-        CHECK_PTR(&p.arr);
+        p = PolyFromCoeff(coeff);
+    } else if (p.size != count) {
+        p.arr = monoArrResize(p.arr, p.size);
     }
+    TRACE_END(TRACE_CANONICALISE, canonMark);
 
     return p;
 }
@@ -365,6 +635,7 @@ static void MulMonoByNum(Mono *m, poly_coeff_t x) {
             }
         }
     } else {
+        makeUnique(&m->p);
         for (size_t i = 0; i < m->p.size; ++i) {
             MulMonoByNum(&m->p.arr[i], x);
         }
@@ -378,8 +649,7 @@ static void MulMonoByNum(Mono *m, poly_coeff_t x) {
  * @return @f$p * num
  */
 static Poly MulPolyByCoeff(const Poly *p, poly_coeff_t num) {
-    Poly new = {.size = p->size, .arr = calloc(p->size, sizeof(Mono))};
-    CHECK_PTR(&new.arr);
+    Poly new = {.size = p->size, .arr = MonoArrAlloc(p->size)};
     for (size_t i = 0; i < p->size; ++i) {
         new.arr[i] = MonoClone(&p->arr[i]);
 
@@ -396,11 +666,38 @@ static Poly MulPolyByCoeff(const Poly *p, poly_coeff_t num) {
 
 void ExpandMonoArr(unsigned long int *monosSize, Mono **monosArr) {
     *monosSize *= 2;
-    *monosArr = realloc(*monosArr, (*monosSize) * sizeof(Mono));
-    CHECK_PTR(monosArr);
+    *monosArr = safeRealloc(*monosArr, (*monosSize) * sizeof(Mono));
+}
+
+/**
+ * Mnoży wielomian nie stały przez jednomian jednym przejściem po jego
+ * jednomianach. Przesunięcie wykładników o ten sam wykładnik nie zmienia ich
+ * kolejności, więc wynik nie wymaga sortowania ani łączenia jednomianów.
+ * @param[in] p : wielomian nie stały
+ * @param[in] m : jednomian
+ * @return @f$p * m@f$
+ */
+static Poly mulByMono(const Poly *p, const Mono *m) {
+    assert(!PolyIsCoeff(p));
+    Poly res = {.size = 0, .arr = MonoArrAlloc(p->size)};
+    for (size_t i = 0; i < p->size; ++i) {
+        Poly coeff = PolyMul(&p->arr[i].p, &m->p);
+        if (PolyIsCoeff(&coeff) && coeff.coeff == 0) continue;
+        res.arr[res.size++] = (Mono) {.p = coeff, .exp = p->arr[i].exp + m->exp};
+    }
+
+    if (res.size == 0) {
+        PolyDestroy(&res);
+        return PolyZero();
+    }
+    collapseCoeff(&res);
+    if (!PolyIsCoeff(&res) && res.size < p->size)
+        res.arr = monoArrResize(res.arr, res.size);
+    return res;
 }
 
 Poly PolyMul(const Poly *p, const Poly *q) {
+    STAT_INC(STAT_POLY_MUL);
     if (isPolyZeroRec(p) || isPolyZeroRec(q)) return PolyZero();
 
     if (PolyIsCoeff(p) && PolyIsCoeff(q))
@@ -410,9 +707,13 @@ Poly PolyMul(const Poly *p, const Poly *q) {
 
     if (PolyIsCoeff(q)) return MulPolyByCoeff(p, q->coeff);
 
+    if (q->size == 1) return mulByMono(p, &q->arr[0]);
+
+    if (p->size == 1) return mulByMono(q, &p->arr[0]);
+
+    TRACE_BEGIN(TRACE_MULTIPLY, mark);
     unsigned long int monosSize = INIT_MONOS_SIZE, k = 0;
     Mono *monos = safeMalloc(monosSize * sizeof(Mono));
-    CHECK_PTR(monos);
 
     for (size_t i = 0; i < p->size; i++) {
         for (size_t j = 0; j < q->size; j++) {
@@ -430,16 +731,356 @@ Poly PolyMul(const Poly *p, const Poly *q) {
         }
     }
     Poly res = PolyAddMonos(k, monos);
-    free(monos);
+    safeFree(monos);
+    TRACE_END(TRACE_MULTIPLY, mark);
     return res;
 }
 
+/**
+ * Mnoży wielomian przez liczbę w miejscu, z tą samą obsługą przepełnień co
+ * PolyMul
+ * @param[in,out] p : wielomian
+ * @param[in] num : liczba przez którą mnożymy wielomian
+ */
+static void mulByCoeffInPlace(Poly *p, poly_coeff_t num) {
+    if (PolyIsCoeff(p)) {
+        p->coeff *= num;
+        return;
+    }
+    if (num != 0) {
+        makeUnique(p);
+        for (size_t i = 0; i < p->size; ++i) {
+            MulMonoByNum(&p->arr[i], num);
+        }
+    }
+    if (num == 0 || isPolyZeroRec(p)) {
+        PolyDestroy(p);
+        *p = PolyZero();
+    }
+}
+
+void PolyMulByMonoInPlace(Poly *p, const Mono *m) {
+    STAT_INC(STAT_POLY_MUL);
+    if (PolyIsCoeff(p)) {
+        Poly coeff = PolyMul(p, &m->p);
+        PolyDestroy(p);
+        if (PolyIsCoeff(&coeff) && coeff.coeff == 0) {
+            *p = PolyZero();
+            return;
+        }
+        *p = (Poly) {.size = 1, .arr = MonoArrAlloc(1)};
+        p->arr[0] = (Mono) {.p = coeff, .exp = m->exp};
+        collapseCoeff(p);
+        return;
+    }
+
+    makeUnique(p);
+    size_t size = p->size, k = 0;
+    for (size_t i = 0; i < size; ++i) {
+        Mono mono = p->arr[i];
+        if (PolyIsCoeff(&m->p)) {
+            mulByCoeffInPlace(&mono.p, m->p.coeff);
+        } else {
+            Poly coeff = PolyMul(&mono.p, &m->p);
+            PolyDestroy(&mono.p);
+            mono.p = coeff;
+        }
+        if (PolyIsCoeff(&mono.p) && mono.p.coeff == 0) continue;
+        mono.exp += m->exp;
+        p->arr[k++] = mono;
+    }
+    p->size = k;
+
+    if (k == 0) {
+        PolyDestroy(p);
+        *p = PolyZero();
+        return;
+    }
+    collapseCoeff(p);
+    if (!PolyIsCoeff(p) && k < size) p->arr = monoArrResize(p->arr, k);
+}
+
+/**
+ * Zwraca tablicę jednomianów wielomianu, traktując współczynnik @f$c@f$ jak
+ * jednomian @f$c x^0@f$
+ * @param[in] p : wielomian
+ * @param[out] coeffMono : miejsce na jednomian ze współczynnikiem
+ * @param[out] size : liczba jednomianów
+ * @return : tablica jednomianów
+ */
+static const Mono *monosOf(const Poly *p, Mono *coeffMono, size_t *size) {
+    if (!PolyIsCoeff(p)) {
+        *size = p->size;
+        return p->arr;
+    }
+    *coeffMono = (Mono) {.p = *p, .exp = 0};
+    *size = 1;
+    return coeffMono;
+}
+
+/**
+ * Mnoży wielomiany, pomijając jednomiany o stopniu większym od @p bound.
+ * Wykładniki są posortowane rosnąco, więc na każdym obcinanym poziomie pary
+ * jednomianów przekraczające ograniczenie są pomijane bez mnożenia, a praca
+ * jest proporcjonalna do liczby zachowanych jednomianów.
+ * @param[in] p : wielomian @f$p@f$
+ * @param[in] q : wielomian @f$q@f$
+ * @param[in] bound : nieujemne ograniczenie stopnia
+ * @param[in] var_idx : indeks obcinanej zmiennej względem tego poziomu
+ * (nieużywany dla stopnia łącznego)
+ * @param[in] total : czy ograniczenie dotyczy stopnia łącznego
+ * @return : obcięty iloczyn @f$p * q@f$
+ */
+static Poly mulTrunc(const Poly *p, const Poly *q, poly_exp_t bound,
+                     size_t var_idx, bool total) {
+    assert(bound >= 0);
+    if (isPolyZeroRec(p) || isPolyZeroRec(q)) return PolyZero();
+
+    if (PolyIsCoeff(p) && PolyIsCoeff(q))
+        return PolyFromCoeff((q->coeff) * (p->coeff));
+
+    bool cut = total || var_idx == 0;
+    Mono pCoeff, qCoeff;
+    size_t pSize, qSize;
+    const Mono *pArr = monosOf(p, &pCoeff, &pSize);
+    const Mono *qArr = monosOf(q, &qCoeff, &qSize);
+
+    unsigned long int monosSize = INIT_MONOS_SIZE, k = 0;
+    Mono *monos = safeMalloc(monosSize * sizeof(Mono));
+    for (size_t i = 0; i < pSize && (!cut || pArr[i].exp <= bound); ++i) {
+        for (size_t j = 0; j < qSize; ++j) {
+            if (cut && qArr[j].exp > bound - pArr[i].exp) break;
+
+            poly_exp_t exp = pArr[i].exp + qArr[j].exp;
+            Poly coeff;
+            if (total)
+                coeff = mulTrunc(&pArr[i].p, &qArr[j].p, bound - exp, 0, true);
+            else if (var_idx == 0)
+                coeff = PolyMul(&pArr[i].p, &qArr[j].p);
+            else
+                coeff = mulTrunc(&pArr[i].p, &qArr[j].p, bound, var_idx - 1,
+                                 false);
+
+            if (isPolyZeroRec(&coeff)) {
+                PolyDestroy(&coeff);
+                continue;
+            }
+            if (monosSize == k) ExpandMonoArr(&monosSize, &monos);
+            monos[k++] = (Mono) {.p = coeff, .exp = exp};
+        }
+    }
+    Poly res = PolyAddMonos(k, monos);
+    safeFree(monos);
+    return res;
+}
+
+Poly PolyMulTrunc(const Poly *p, const Poly *q, poly_exp_t deg) {
+    STAT_INC(STAT_POLY_MUL_TRUNC);
+    if (deg < 0) return PolyZero();
+
+    TRACE_BEGIN(TRACE_MULTIPLY, mark);
+    Poly res = mulTrunc(p, q, deg, 0, true);
+    TRACE_END(TRACE_MULTIPLY, mark);
+    return res;
+}
+
+Poly PolyMulTruncBy(const Poly *p, const Poly *q, size_t var_idx,
+                    poly_exp_t deg) {
+    STAT_INC(STAT_POLY_MUL_TRUNC);
+    if (deg < 0) return PolyZero();
+
+    TRACE_BEGIN(TRACE_MULTIPLY, mark);
+    Poly res = mulTrunc(p, q, deg, var_idx, false);
+    TRACE_END(TRACE_MULTIPLY, mark);
+    return res;
+}
+
+/**
+ * Iloczyn jednomianu ilorazu i jednomianu dzielnika w kopcu dzielenia
+ */
+typedef struct DivHeapT {
+    poly_exp_t exp; ///< wykładnik iloczynu
+    size_t quot;    ///< numer jednomianu ilorazu
+    size_t div;     ///< numer jednomianu dzielnika (od najwyższego)
+} DivHeapT;
+
+/**
+ * Wstawia iloczyn do kopca, w którego korzeniu jest największy wykładnik
+ * @param[in,out] heap : kopiec
+ * @param[in,out] size : liczba elementów kopca
+ * @param[in] item : wstawiany iloczyn
+ */
+static void divHeapPush(DivHeapT heap[], size_t *size, DivHeapT item) {
+    size_t i = (*size)++;
+    while (i > 0 && heap[(i - 1) / 2].exp < item.exp) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = item;
+}
+
+/**
+ * Usuwa z kopca iloczyn o największym wykładniku
+ * @param[in,out] heap : niepusty kopiec
+ * @param[in,out] size : liczba elementów kopca
+ * @return : usunięty iloczyn
+ */
+static DivHeapT divHeapPop(DivHeapT heap[], size_t *size) {
+    DivHeapT top = heap[0], last = heap[--(*size)];
+    size_t i = 0;
+    while (2 * i + 1 < *size) {
+        size_t child = 2 * i + 1;
+        if (child + 1 < *size && heap[child + 1].exp > heap[child].exp)
+            child++;
+        if (heap[child].exp <= last.exp) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+/**
+ * Dzieli liczby, jeśli dzielenie jest dokładne. Dzielenie przez -1 jest
+ * liczone jak negacja, bo @f$-2^{63} / (-1)@f$ nie mieści się w zakresie.
+ * @param[in] p : dzielna
+ * @param[in] q : niezerowy dzielnik
+ * @param[out] res : iloraz
+ * @return : czy @p q dzieli @p p
+ */
+static bool coeffDivExact(poly_coeff_t p, poly_coeff_t q, Poly *res) {
+    if (q == -1) {
+        *res = PolyFromCoeff((poly_coeff_t) (0 - (uint64_t) p));
+        return true;
+    }
+    if (p % q != 0) return false;
+    *res = PolyFromCoeff(p / q);
+    return true;
+}
+
+/**
+ * Dzieli wielomian przez niezerowy wielomian algorytmem Johnsona, traktując
+ * oba jako wielomiany jednej zmiennej o współczynnikach z dalszych zmiennych.
+ * Jednomiany reszty są wyznaczane od najwyższego wykładnika. Iloczyny
+ * jednomianów ilorazu i dzielnika są scalane kopcem, w którym każdy jednomian
+ * ilorazu ma jeden iloczyn, przechodzący po jednomianach dzielnika
+ * w malejącej kolejności wykładników, więc kopiec ma rozmiar ilorazu.
+ * Współczynnik kolejnego jednomianu ilorazu jest dzielony rekurencyjnie przez
+ * współczynnik wiodący dzielnika. Dzielenie kończy się od razu, gdy jednomian
+ * reszty nie dzieli się przez jednomian wiodący.
+ * @param[in] p : dzielna
+ * @param[in] q : niezerowy dzielnik
+ * @param[out] res : iloraz, jeśli dzielenie jest dokładne
+ * @return : czy @p q dzieli @p p
+ */
+static bool divExact(const Poly *p, const Poly *q, Poly *res) {
+    if (PolyIsZero(p)) {
+        *res = PolyZero();
+        return true;
+    }
+    if (PolyIsCoeff(p) && PolyIsCoeff(q))
+        return coeffDivExact(p->coeff, q->coeff, res);
+
+    Mono pCoeff, qCoeff;
+    size_t pSize, qSize;
+    const Mono *pArr = monosOf(p, &pCoeff, &pSize);
+    const Mono *qArr = monosOf(q, &qCoeff, &qSize);
+    // Najniższe jednomiany dzielnej i iloczynu się nie redukują
+    if (pArr[0].exp < qArr[0].exp) return false;
+
+    // Jednomiany są numerowane od najwyższego wykładnika
+    const Mono *lead = &qArr[qSize - 1];
+    unsigned long int quotSize = INIT_MONOS_SIZE, quotCount = 0;
+    Mono *quot = safeMalloc(quotSize * sizeof(Mono));
+    unsigned long int heapCap = INIT_MONOS_SIZE;
+    size_t heapSize = 0;
+    DivHeapT *heap = safeMalloc(heapCap * sizeof(DivHeapT));
+    size_t next = 0;
+    bool exact = true;
+
+    while (exact && (next < pSize || heapSize > 0)) {
+        poly_exp_t exp = next < pSize ? pArr[pSize - 1 - next].exp : -1;
+        if (heapSize > 0 && heap[0].exp > exp) exp = heap[0].exp;
+
+        // Współczynnik reszty przy x^exp
+        const Poly *coeff = NULL;
+        Poly diff = PolyZero();
+        if (next < pSize && pArr[pSize - 1 - next].exp == exp)
+            coeff = &pArr[pSize - 1 - next++].p;
+        while (heapSize > 0 && heap[0].exp == exp) {
+            DivHeapT top = divHeapPop(heap, &heapSize);
+            Poly prod = PolyMul(&quot[top.quot].p,
+                                &qArr[qSize - 1 - top.div].p);
+            if (coeff != NULL) {
+                diff = PolySub(coeff, &prod);
+                coeff = NULL;
+            } else {
+                PolySubInPlace(&diff, &prod);
+            }
+            PolyDestroy(&prod);
+            if (top.div + 1 < qSize) {
+                top.div++;
+                top.exp = quot[top.quot].exp + qArr[qSize - 1 - top.div].exp;
+                divHeapPush(heap, &heapSize, top);
+            }
+        }
+        if (coeff == NULL) coeff = &diff;
+        if (PolyIsZero(coeff)) continue;
+
+        Poly quotCoeff;
+        if (exp < lead->exp || !divExact(coeff, &lead->p, &quotCoeff)) {
+            PolyDestroy(&diff);
+            exact = false;
+            break;
+        }
+        PolyDestroy(&diff);
+
+        if (quotCount == quotSize) ExpandMonoArr(&quotSize, &quot);
+        quot[quotCount] = (Mono) {.p = quotCoeff, .exp = exp - lead->exp};
+        if (qSize > 1) {
+            if (heapSize == heapCap) {
+                heapCap *= 2;
+                heap = safeRealloc(heap, heapCap * sizeof(DivHeapT));
+            }
+            divHeapPush(heap, &heapSize, (DivHeapT) {
+                    .exp = exp - lead->exp + qArr[qSize - 2].exp,
+                    .quot = quotCount, .div = 1});
+        }
+        quotCount++;
+    }
+    safeFree(heap);
+
+    if (!exact) {
+        for (size_t i = 0; i < quotCount; ++i) MonoDestroy(&quot[i]);
+        safeFree(quot);
+        return false;
+    }
+
+    // Iloraz jest niezerowy, bo dzielna jest niezerowa
+    if (quotCount == 1 && quot[0].exp == 0 && PolyIsCoeff(&quot[0].p)) {
+        *res = quot[0].p;
+    } else {
+        *res = (Poly) {.size = quotCount, .arr = MonoArrAlloc(quotCount)};
+        for (size_t i = 0; i < quotCount; ++i)
+            res->arr[i] = quot[quotCount - 1 - i];
+    }
+    safeFree(quot);
+    return true;
+}
+
+bool PolyDivExact(const Poly *p, const Poly *q, Poly *res) {
+    STAT_INC(STAT_POLY_DIV);
+    if (PolyIsZero(q)) return false;
+    return divExact(p, q, res);
+}
+
 void PolyNegHelp(Poly *p) {
     if (PolyIsCoeff(p)) {
         p->coeff = -(p->coeff);
         return;
     }
 
+    makeUnique(p);
     for (size_t i = 0; i < p->size; ++i) {
         PolyNegHelp(&p->arr[i].p);
     }
@@ -455,11 +1096,59 @@ Poly PolyNeg(const Poly *p) {
 }
 
 Poly PolySub(const Poly *p, const Poly *q) {
-    Poly neg_q = PolyNeg(q);
-    Poly diff = PolyAdd(p, &neg_q);
-    PolyDestroy(&neg_q);
-    if (isPolyZeroRec(&diff)) { PolyDestroy(&diff); return PolyZero(); }
-    return diff;
+    return addSigned(p, q, true);
+}
+
+void PolySubInPlace(Poly *p, const Poly *q) {
+    if (PolyIsCoeff(p) || PolyIsCoeff(q)) {
+        Poly res = addSigned(p, q, true);
+        PolyDestroy(p);
+        *p = res;
+        return;
+    }
+
+    makeUnique(p);
+    size_t extra = 0;
+    for (size_t i = 0, j = 0; j < q->size; ) {
+        if (i < p->size && p->arr[i].exp < q->arr[j].exp) i++;
+        else if (i < p->size && p->arr[i].exp == q->arr[j].exp) i++, j++;
+        else extra++, j++;
+    }
+
+    // Jeśli q ma jednomiany o wykładnikach, których nie ma w p, jednomiany
+    // p są przenoszone do nowej tablicy, w przeciwnym razie zostają na
+    // miejscu. Współczynniki o wspólnych wykładnikach są odejmowane w miejscu.
+    Mono *src = p->arr;
+    Mono *dst = extra == 0 ? p->arr : MonoArrAlloc(p->size + extra);
+    size_t i = 0, j = 0, k = 0;
+    while (i < p->size || j < q->size) {
+        if (j == q->size || (i < p->size && src[i].exp < q->arr[j].exp)) {
+            dst[k++] = src[i++];
+        } else if (i == p->size || src[i].exp > q->arr[j].exp) {
+            dst[k++] = monoSigned(&q->arr[j++], true);
+        } else {
+            Mono m = src[i++];
+            const Poly *qChild = &q->arr[j++].p;
+            if (PolyIsCoeff(&m.p) && PolyIsCoeff(qChild))
+                m.p.coeff -= qChild->coeff;
+            else
+                PolySubInPlace(&m.p, qChild);
+            if (!PolyIsCoeff(&m.p) || m.p.coeff != 0) dst[k++] = m;
+        }
+    }
+
+    size_t capacity = p->size + extra;
+    if (dst != src) MonoArrFree(src);
+    p->arr = dst;
+    p->size = k;
+
+    if (k == 0) {
+        PolyDestroy(p);
+        *p = PolyZero();
+        return;
+    }
+    collapseCoeff(p);
+    if (!PolyIsCoeff(p) && k < capacity) p->arr = monoArrResize(p->arr, k);
 }
 
 poly_exp_t PolyDegBy(const Poly *p, size_t var_idx) {
@@ -508,15 +1197,31 @@ poly_exp_t PolyDeg(const Poly *p) {
     return max;
 }
 
-bool MonoIsEq(Mono *m, const Mono *n) {
+size_t PolyDepth(const Poly *p) {
+    if (PolyIsCoeff(p)) return 0;
+
+    size_t res = 0;
+    for (size_t i = 0; i < p->size; ++i) {
+        size_t depth = PolyDepth(&p->arr[i].p);
+        if (depth > res) res = depth;
+    }
+    return res + 1;
+}
+
+bool MonoIsEq(const Mono *m, const Mono *n) {
     if (m->exp != n->exp) return false;
 
     return PolyIsEq(&m->p, &n->p);
 }
 
 bool PolyIsEq(const Poly *p, const Poly *q) {
+    STAT_INC(STAT_POLY_IS_EQ);
     if (PolyIsCoeff(p) && PolyIsCoeff(q)) return (p->coeff == q->coeff);
     if (PolyIsCoeff(p) || PolyIsCoeff(q)) return false;
+    if (p->arr == q->arr) return true;
+    // Równe internowane wielomiany są zawsze tą samą tablicą
+    if (arrHeader(p->arr)->interned && arrHeader(q->arr)->interned)
+        return false;
     if (p->size != q->size) return false;
 
     for (size_t i = 0; i < p->size; ++i) {
@@ -537,61 +1242,271 @@ static poly_coeff_t longAbs(poly_coeff_t num) {
 }
 
 /**
- * Zwraca base podniosioną do potęgi exp
+ * Podnosi base do potęgi exp
  * @param[in] base : podstawa potęgi
  * @param[in] exp : wykładnik potęgi
- * @return base podniesiona do potęgi exp
+ * @param[out] res : base podniesiona do potęgi exp
+ * @return czy wynik mieści się w zakresie poly_coeff_t (dla base równego 0
+ * i dodatniego exp zwracany jest fałsz)
  */
-static poly_coeff_t ipow(poly_coeff_t base, poly_exp_t exp) {
+static bool ipow(poly_coeff_t base, poly_exp_t exp, poly_coeff_t *res) {
     long long int result = 1;
     for (int i = 0; i < exp; ++i) {
-        if (base == 0) {
-            errno = ERANGE;
-            return -1;
-        }
+        if (base == 0) return false;
         if ((LONG_MAX % longAbs(base) == 0) &&
-            result > LONG_MAX / longAbs(base)) {
-            errno = ERANGE;
-            return -1;
-        }
+            result > LONG_MAX / longAbs(base))
+            return false;
         if ((LONG_MAX % longAbs(base) != 0) &&
-            result >= LONG_MAX / longAbs(base) + 1) {
-            errno = ERANGE;
-            return -1;
-        }
+            result >= LONG_MAX / longAbs(base) + 1)
+            return false;
         result *= base;
     }
-    return result;
+    *res = result;
+    return true;
 }
 
 Poly PolyAt(const Poly *p, poly_coeff_t x) {
+    STAT_INC(STAT_POLY_AT);
     if (PolyIsCoeff(p)) return PolyFromCoeff(p->coeff);
-    Mono new[p->size];
-    Poly polys[p->size];
 
+    // Wyniki są sumowane na bieżąco, bez tablic na stosie o rozmiarze
+    // wielomianu, które mogłyby przepełnić mniejszy stos wątku roboczego
+    Poly res = PolyZero();
     for (size_t i = 0; i < p->size; ++i) {
+        poly_coeff_t mulNum;
+        if (!ipow(x, p->arr[i].exp, &mulNum)) continue;
+
+        Mono m = MonoClone(&p->arr[i]);
+        MulMonoByNum(&m, mulNum);
+        if (isPolyZeroRec(&m.p)) {
+            MonoDestroy(&m);
+        } else if (PolyIsZero(&res)) {
+            res = m.p;
+        } else {
+            Poly sum = PolyAdd(&res, &m.p);
+            PolyDestroy(&res);
+            MonoDestroy(&m);
+            res = sum;
+        }
+    }
+    return res;
+}
 
-        new[i] = MonoClone(&p->arr[i]);
-        poly_coeff_t mulNum = ipow(x, new[i].exp);
+/**
+ * Zapamiętane potęgi wielomianu podstawianego za jedną zmienną, posortowane
+ * rosnąco według wykładnika
+ */
+typedef struct PowCacheT {
+    const Poly *base;       ///< wielomian podstawiany za zmienną
+    bool mono;              ///< czy @p base jest stałą lub jednomianem
+    unsigned long int size; ///< rozmiar tablicy @p pows
+    size_t count;           ///< liczba zapamiętanych potęg
+    Mono *pows;             ///< potęgi od drugiej: jednomian @f$(base^{exp}, exp)@f$
+} PowCacheT;
 
-        if (errno == ERANGE) {
-            errno = 0;
-            MonoDestroy(&new[i]);
-            polys[i] = PolyZero();
-        } else {
+/**
+ * Wyszukuje binarnie miejsce potęgi w tablicy zapamiętanych potęg
+ * @param[in] cache : zapamiętane potęgi
+ * @param[in] exp : wykładnik
+ * @return : indeks pierwszej potęgi o wykładniku nie mniejszym niż @p exp
+ */
+static size_t powIndex(const PowCacheT *cache, poly_exp_t exp) {
+    size_t lo = 0, hi = cache->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cache->pows[mid].exp < exp)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
 
-            MulMonoByNum(&new[i], mulNum);
-            polys[i] = new[i].p;
+/**
+ * Sprawdza, czy wielomian jest stałą lub jednomianem, czyli czy na każdym
+ * poziomie ma co najwyżej jeden jednomian
+ * @param[in] p : wielomian
+ * @return : czy @p p jest stałą lub jednomianem
+ */
+static bool isMonoRec(const Poly *p) {
+    while (!PolyIsCoeff(p)) {
+        if (p->size != 1) return false;
+        p = &p->arr[0].p;
+    }
+    return true;
+}
+
+/**
+ * Podnosi stałą lub jednomian do potęgi bez mnożenia wielomianów: wykładniki
+ * jednomianu są mnożone przez @p exp, a współczynnik jest podnoszony do
+ * potęgi modulo @f$2^{64}@f$, tak jak przy kolejnych mnożeniach
+ * @param[in] p : stała lub jednomian
+ * @param[in] exp : wykładnik
+ * @return : @f$p^{exp}@f$
+ */
+static Poly monoPow(const Poly *p, poly_exp_t exp) {
+    if (PolyIsCoeff(p)) {
+        uint64_t base = (uint64_t) p->coeff, res = 1;
+        for (poly_exp_t e = exp; e > 0; e >>= 1) {
+            if (e & 1) res *= base;
+            base *= base;
         }
+        return PolyFromCoeff((poly_coeff_t) res);
     }
 
-    for (size_t i = 1; i < p->size; ++i) {
-        if (!isPolyZeroRec(&polys[i])) {
-            Poly temp = polys[0];
-            polys[0] = PolyAdd(&polys[0], &polys[i]);
-            PolyDestroy(&temp);
-            PolyDestroy(&polys[i]);
+    Poly coeff = monoPow(&p->arr[0].p, exp);
+    if (PolyIsZero(&coeff)) return coeff;
+    Mono m = MonoFromPoly(&coeff, p->arr[0].exp * exp);
+    return PolyAddMonos(1, &m);
+}
+
+/**
+ * Zwraca potęgę podstawianego wielomianu, wyliczając ją przy pierwszym
+ * użyciu. Potęga stałej lub jednomianu jest wyliczana bezpośrednio, a innego
+ * wielomianu przez podniesienie do kwadratu potęgi o połowę mniejszej, która
+ * również zostaje zapamiętana. Wskaźnik jest ważny do następnego wywołania.
+ * @param[in,out] cache : zapamiętane potęgi
+ * @param[in] exp : dodatni wykładnik
+ * @return : @f$base^{exp}@f$
+ */
+static const Poly *powCached(PowCacheT *cache, poly_exp_t exp) {
+    assert(exp > 0);
+    if (exp == 1) return cache->base;
+
+    size_t i = powIndex(cache, exp);
+    if (i < cache->count && cache->pows[i].exp == exp) {
+        STAT_INC(STAT_COMPOSE_POW_HITS);
+        return &cache->pows[i].p;
+    }
+
+    Poly res;
+    if (cache->mono) {
+        res = monoPow(cache->base, exp);
+    } else {
+        const Poly *half = powCached(cache, exp / 2);
+        res = PolyMul(half, half);
+        if (exp % 2 == 1) {
+            Poly tmp = PolyMul(&res, cache->base);
+            PolyDestroy(&res);
+            res = tmp;
         }
+        // Mniejsze potęgi mogły zostać wstawione przed szukane miejsce
+        i = powIndex(cache, exp);
     }
-    return polys[0];
-}
\ No newline at end of file
+
+    if (cache->pows == NULL) {
+        cache->size = INIT_MONOS_SIZE;
+        cache->pows = safeMalloc(cache->size * sizeof(Mono));
+    } else if (cache->count == cache->size) {
+        ExpandMonoArr(&cache->size, &cache->pows);
+    }
+    memmove(&cache->pows[i + 1], &cache->pows[i],
+            (cache->count - i) * sizeof(Mono));
+    cache->pows[i] = (Mono) {.p = res, .exp = exp};
+    cache->count++;
+    return &cache->pows[i].p;
+}
+
+/**
+ * Podstawia wielomiany za zmienne @f$x_{var}, x_{var+1}, \ldots@f$
+ * schematem Hornera: wynik częściowy jest mnożony przez potęgę podstawianego
+ * wielomianu o wykładniku równym różnicy kolejnych wykładników, więc każda
+ * potęga jest wyliczana raz dla całego wielomianu.
+ * @param[in] p : wielomian
+ * @param[in] var : numer pierwszej zmiennej wielomianu
+ * @param[in] k : liczba podstawianych wielomianów
+ * @param[in,out] caches : zapamiętane potęgi kolejnych wielomianów
+ * @return : wielomian po podstawieniu
+ */
+static Poly compose(const Poly *p, size_t var, size_t k, PowCacheT caches[]);
+
+/**
+ * Podstawia za zmienną @f$x_{var}@f$ stałą lub jednomian. Potęgi są wtedy
+ * jednomianami, więc każdy jednomian wielomianu przechodzi na iloczyn
+ * złożenia współczynnika i jednomianu. Jednomiany iloczynów są zbierane do
+ * jednej tablicy i sumowane raz przez PolyAddMonos, bez kwadratowej liczby
+ * dodawań schematu Hornera.
+ * @param[in] p : wielomian
+ * @param[in] var : numer pierwszej zmiennej wielomianu
+ * @param[in] k : liczba podstawianych wielomianów
+ * @param[in,out] caches : zapamiętane potęgi kolejnych wielomianów
+ * @return : wielomian po podstawieniu
+ */
+static Poly composeByMono(const Poly *p, size_t var, size_t k,
+                          PowCacheT caches[]) {
+    unsigned long int monosSize = INIT_MONOS_SIZE, count = 0;
+    Mono *monos = safeMalloc(monosSize * sizeof(Mono));
+    for (size_t i = 0; i < p->size; ++i) {
+        Poly term = compose(&p->arr[i].p, var + 1, k, caches);
+        if (p->arr[i].exp > 0) {
+            Poly shifted = PolyMul(&term, powCached(&caches[var],
+                                                    p->arr[i].exp));
+            PolyDestroy(&term);
+            term = shifted;
+        }
+        if (PolyIsZero(&term)) continue;
+
+        Mono termCoeff;
+        size_t termSize;
+        const Mono *termMonos = monosOf(&term, &termCoeff, &termSize);
+        for (size_t j = 0; j < termSize; ++j) {
+            if (monosSize == count) ExpandMonoArr(&monosSize, &monos);
+            monos[count++] = MonoClone(&termMonos[j]);
+        }
+        PolyDestroy(&term);
+    }
+    Poly res = PolyAddMonos(count, monos);
+    safeFree(monos);
+    return res;
+}
+
+static Poly compose(const Poly *p, size_t var, size_t k, PowCacheT caches[]) {
+    if (PolyIsCoeff(p)) return PolyFromCoeff(p->coeff);
+
+    // Zmienna zastąpiona zerem: zostaje tylko współczynnik przy x^0
+    if (var >= k || PolyIsZero(caches[var].base)) {
+        if (p->arr[0].exp != 0) return PolyZero();
+        return compose(&p->arr[0].p, var + 1, k, caches);
+    }
+
+    PowCacheT *cache = &caches[var];
+    if (cache->mono) return composeByMono(p, var, k, caches);
+
+    Poly res = compose(&p->arr[p->size - 1].p, var + 1, k, caches);
+    for (size_t i = p->size - 1; i-- > 0;) {
+        Poly shifted = PolyMul(&res, powCached(cache, p->arr[i + 1].exp -
+                                                      p->arr[i].exp));
+        Poly coeff = compose(&p->arr[i].p, var + 1, k, caches);
+        PolyDestroy(&res);
+        res = PolyAdd(&shifted, &coeff);
+        PolyDestroy(&shifted);
+        PolyDestroy(&coeff);
+    }
+    if (p->arr[0].exp > 0) {
+        Poly shifted = PolyMul(&res, powCached(cache, p->arr[0].exp));
+        PolyDestroy(&res);
+        res = shifted;
+    }
+    return res;
+}
+
+Poly PolyCompose(const Poly *p, size_t k, const Poly q[]) {
+    STAT_INC(STAT_POLY_COMPOSE);
+    PowCacheT *caches = NULL;
+    if (k > 0) {
+        caches = safeMalloc(k * sizeof(PowCacheT));
+        for (size_t i = 0; i < k; ++i) {
+            caches[i] = (PowCacheT) {.base = &q[i], .mono = isMonoRec(&q[i])};
+        }
+    }
+
+    Poly res = compose(p, 0, k, caches);
+
+    for (size_t i = 0; i < k; ++i) {
+        for (size_t j = 0; j < caches[i].count; ++j)
+            PolyDestroy(&caches[i].pows[j].p);
+        safeFree(caches[i].pows);
+    }
+    safeFree(caches);
+    return res;
+}
@@ -1,6 +1,16 @@
 /** @file
   Interfejs klasy wielomianów rzadkich wielu zmiennych
 
+  Wszystkie funkcje są wielobieżne: nie używają zmiennych globalnych ani
+  errno do przekazywania wyników, więc można je wywoływać współbieżnie
+  z wielu wątków, o ile żaden wątek nie modyfikuje ani nie zwalnia
+  wielomianu, który inny wątek w tym czasie czyta. Wielomiany tylko do odczytu
+  mogą być wspólne dla wielu wątków. Wyjątkiem jest PolyAddMonos, która
+  przejmuje na własność zawartość przekazanej tablicy. Kopie wielomianu
+  (PolyClone) mogą być używane i zwalniane przez różne wątki niezależnie,
+  bo liczniki odwołań są atomowe. Tablica internowanych wielomianów (zob.
+  PolyIntern) jest wspólna dla wszystkich wątków i chroniona blokadą.
+
   @authors Jakub Pawlewicz <pan@mimuw.edu.pl>, Marcin Peczarski <marpe@mimuw.edu.pl>
   @copyright Uniwersytet Warszawski
   @date 2021
@@ -14,6 +24,20 @@
 #include <stddef.h>
 #include <limits.h>
 
+// Biblioteka dzielona jest kompilowana z -fvisibility=hidden, więc
+// eksportuje tylko funkcje i zmienne zadeklarowane w jej publicznych plikach
+// nagłówkowych, między tymi dyrektywami.
+#pragma GCC visibility push(default)
+
+/**
+ * Główny numer wersji interfejsu biblioteki libpoly. Zmienia się przy
+ * zmianach niezgodnych z poprzednimi wersjami.
+ */
+#define POLY_VERSION_MAJOR 1
+
+/** Poboczny numer wersji interfejsu biblioteki libpoly. */
+#define POLY_VERSION_MINOR 0
+
 /** To jest typ reprezentujący współczynniki. */
 typedef long poly_coeff_t;
 
@@ -71,15 +95,6 @@ static inline Poly PolyFromCoeff(poly_coeff_t c) {
   return (Poly) {.coeff = c, .arr = NULL};
 }
 
-extern bool isPolyCoeffRec(const Poly *p);
-
-/**
- * Zwraca w postaci liczby stałą, którą jest wielomian
- * @param[in] p : wielomian
- * @return liczba którą jest wielomian
- */
-extern poly_coeff_t getCoeff(Poly *p);
-
 /**
  * Tworzy wielomian tożsamościowo równy zeru.
  * @return wielomian
@@ -112,7 +127,8 @@ static inline bool PolyIsCoeff(const Poly *p) {
 }
 
 /**
- * Sprawdza dogłębnie, czy wielomian jest tożsamościowo równy zeru.
+ * Sprawdza dogłębnie, czy wielomian jest tożsamościowo równy zeru. Należy do
+ * interfejsu biblioteki, bo wywołuje ją PolyIsZero.
  * @param[in] p : wielomian
  * @return Czy wielomian jest równy zeru?
  */
@@ -144,14 +160,17 @@ static inline void MonoDestroy(Mono *m) {
 }
 
 /**
- * Robi pełną, głęboką kopię wielomianu.
+ * Robi kopię wielomianu w czasie stałym. Kopia współdzieli tablicę
+ * jednomianów z oryginałem, zwiększając jej licznik odwołań. Współdzielone
+ * tablice nie są zmieniane, operacje zmieniające wielomian kopiują tylko
+ * te tablice, które zmieniają.
  * @param[in] p : wielomian
  * @return skopiowany wielomian
  */
 Poly PolyClone(const Poly *p);
 
 /**
- * Robi pełną, głęboką kopię jednomianu.
+ * Robi kopię jednomianu w czasie stałym (zob. PolyClone).
  * @param[in] m : jednomian
  * @return skopiowany jednomian
  */
@@ -184,6 +203,52 @@ Poly PolyAddMonos(size_t count, const Mono monos[]);
  */
 Poly PolyMul(const Poly *p, const Poly *q);
 
+/**
+ * Mnoży wielomian przez jednomian w miejscu. Jednomiany @p p są przesuwane
+ * i skalowane w jego własnej tablicy, bez sortowania. Jeśli tablica jest
+ * współdzielona, najpierw jest kopiowana.
+ * @param[in,out] p : wielomian @f$p@f$, zamieniany na @f$p * m@f$
+ * @param[in] m : jednomian @f$m@f$
+ */
+void PolyMulByMonoInPlace(Poly *p, const Mono *m);
+
+/**
+ * Mnoży dwa wielomiany, zachowując tylko jednomiany stopnia łącznego
+ * (zob. MonoDeg) co najwyżej @p deg. Jednomiany o większym stopniu nie są
+ * w ogóle wyliczane.
+ * @param[in] p : wielomian @f$p@f$
+ * @param[in] q : wielomian @f$q@f$
+ * @param[in] deg : ograniczenie stopnia łącznego
+ * @return @f$p * q@f$ bez jednomianów stopnia większego niż @p deg
+ */
+Poly PolyMulTrunc(const Poly *p, const Poly *q, poly_exp_t deg);
+
+/**
+ * Mnoży dwa wielomiany, zachowując tylko jednomiany, w których zmienna
+ * o indeksie @p var_idx (zob. PolyDegBy) występuje w potędze co najwyżej
+ * @p deg. Jednomiany o większym stopniu nie są w ogóle wyliczane.
+ * @param[in] p : wielomian @f$p@f$
+ * @param[in] q : wielomian @f$q@f$
+ * @param[in] var_idx : indeks zmiennej
+ * @param[in] deg : ograniczenie stopnia ze względu na zmienną
+ * @return @f$p * q@f$ bez jednomianów stopnia większego niż @p deg
+ * ze względu na zmienną @p var_idx
+ */
+Poly PolyMulTruncBy(const Poly *p, const Poly *q, size_t var_idx,
+                    poly_exp_t deg);
+
+/**
+ * Dzieli wielomian przez wielomian, jeśli dzielenie jest dokładne, czyli
+ * istnieje wielomian @f$r@f$ taki, że @f$p = q * r@f$. Koszt zależy od
+ * rozmiarów ilorazu i dzielnika, a nie od kwadratu rozmiaru dzielnej.
+ * Obliczenia kończą się wcześnie, gdy dzielenie okazuje się niedokładne.
+ * @param[in] p : wielomian @f$p@f$
+ * @param[in] q : wielomian @f$q@f$
+ * @param[out] res : iloraz @f$p / q@f$, jeśli dzielenie jest dokładne
+ * @return : czy @f$q@f$ jest niezerowy i dzieli @f$p@f$
+ */
+bool PolyDivExact(const Poly *p, const Poly *q, Poly *res);
+
 /**
  * Zwraca przeciwny wielomian.
  * @param[in] p : wielomian @f$p@f$
@@ -199,6 +264,17 @@ Poly PolyNeg(const Poly *p);
  */
 Poly PolySub(const Poly *p, const Poly *q);
 
+/**
+ * Odejmuje wielomian od wielomianu w miejscu. Przejmuje na własność
+ * zawartość @p p i zapisuje w nim wynik. Jednomiany @p p nie są kopiowane,
+ * a jeśli @p q nie ma wykładników, których nie ma @p p, wynik zajmuje
+ * tablice jednomianów @p p. Jeśli zabraknie pamięci w transakcji pamięci,
+ * @p p może zostać częściowo zmieniony.
+ * @param[in,out] p : wielomian @f$p@f$, zastępowany przez @f$p - q@f$
+ * @param[in] q : wielomian @f$q@f$
+ */
+void PolySubInPlace(Poly *p, const Poly *q);
+
 /**
  * Zwraca stopień wielomianu ze względu na zadaną zmienną (-1 dla wielomianu
  * tożsamościowo równego zeru). Zmienne indeksowane są od 0.
@@ -218,6 +294,15 @@ poly_exp_t PolyDegBy(const Poly *p, size_t var_idx);
  */
 poly_exp_t PolyDeg(const Poly *p);
 
+/**
+ * Zwraca głębokość wielomianu, czyli liczbę poziomów drzewa nad
+ * współczynnikami. Wielomian zależy tylko od zmiennych o indeksach mniejszych
+ * od głębokości.
+ * @param[in] p : wielomian
+ * @return : głębokość wielomianu (0 dla wielomianu stałego)
+ */
+size_t PolyDepth(const Poly *p);
+
 /**
  * Sprawdza równość dwóch wielomianów.
  * @param[in] p : wielomian @f$p@f$
@@ -240,10 +325,17 @@ bool PolyIsEq(const Poly *p, const Poly *q);
 Poly PolyAt(const Poly *p, poly_coeff_t x);
 
 /**
- * Zamienia przekazany wielomian na wielomian przeciwny
- * @param[in] p : wielomian
+ * Składa wielomiany: podstawia wielomian @f$q_i@f$ za zmienną @f$x_i@f$
+ * dla @f$i < k@f$ i zero za pozostałe zmienne. Formalnie dla wielomianu
+ * @f$p(x_0, x_1, \ldots)@f$ wynikiem jest wielomian
+ * @f$p(q_0, q_1, \ldots, q_{k-1}, 0, 0, \ldots)@f$. Potęgi podstawianych
+ * wielomianów są wyliczane raz i używane ponownie we wszystkich jednomianach.
+ * @param[in] p : wielomian @f$p@f$
+ * @param[in] k : liczba podstawianych wielomianów
+ * @param[in] q : tablica @p k podstawianych wielomianów
+ * @return @f$p(q_0, q_1, \ldots, q_{k-1}, 0, \ldots)@f$
  */
-void PolyNegHelp(Poly *p);
+Poly PolyCompose(const Poly *p, size_t k, const Poly q[]);
 
 /**
  * Sprawdza równość dwóch jednomianów
@@ -251,13 +343,40 @@ void PolyNegHelp(Poly *p);
  * @param[in] n : jednomian
  * @return @f$m = nC@f$
  */
-bool MonoIsEq(Mono *m, const Mono *n);
+bool MonoIsEq(const Mono *m, const Mono *n);
+
+/**
+ * Alokuje tablicę jednomianów wielomianu z licznikiem odwołań równym 1.
+ * Wszystkie tablice wskazywane przez pole arr wielomianu muszą być
+ * zaalokowane tą funkcją.
+ * @param[in] count : liczba jednomianów
+ * @return : niezainicjalizowana tablica jednomianów
+ */
+Mono *MonoArrAlloc(size_t count);
+
+/**
+ * Zwalnia tablicę zaalokowaną przez MonoArrAlloc, nie zwalniając jej
+ * jednomianów
+ * @param[in] arr : tablica jednomianów
+ */
+void MonoArrFree(Mono *arr);
 
 /**
- * Zwieksza dwukrotnie liczbę alokowanej pamięci przez tablicę Monosow
- * @param monosSize : obecny rozmiar tablicy Monosow
- * @param monosArr : tablica Monosow
+ * Internuje wielomian: zastępuje każdą jego tablicę jednomianów równą
+ * tablicą z globalnej tablicy internowanych wielomianów albo, jeśli takiej
+ * nie ma, wpisuje ją tam. Strukturalnie równe internowane poddrzewa
+ * współdzielą więc pamięć, a PolyIsEq porównuje dwa internowane wielomiany
+ * w czasie stałym. Funkcja nie alokuje pamięci przez safeMalloc, więc może
+ * być ostatnim krokiem komendy wykonywanej w transakcji pamięci. Zmienia
+ * w miejscu współczynniki tablic współdzielonych przez kopie (nie zmieniając
+ * ich wartości), więc żaden inny wątek nie może w tym czasie używać kopii
+ * @p p, które nie są jeszcze internowane. Internowaną tablicę może zwolnić
+ * dowolny wątek, więc wszystkie internujące wątki muszą używać alokatora
+ * tego samego rodzaju.
+ * @param[in,out] p : wielomian
  */
-void ExpandMonoArr(unsigned long int *monosSize, Mono **monosArr);
+void PolyIntern(Poly *p);
+
+#pragma GCC visibility pop
 
 #endif /* __POLY_H__ */
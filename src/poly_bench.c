@@ -0,0 +1,593 @@
+/** @file
+ * Pomiar wydajności funkcji z poly.c, parsera i wypisywania wielomianów.
+ * Dla każdej pary (operacja, kształt wielomianu) liczba powtórzeń jest
+ * dobierana tak, by jeden pomiar trwał co najmniej zadany czas, a wynikiem
+ * jest mediana i minimum czasu na operację z kilku pomiarów oraz liczba
+ * alokacji na operację.
+ *
+ * Użycie: poly_bench [--seed N] [--repeats N] [--min-time MS] [--json] [FILTR]
+ *
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#define _GNU_SOURCE
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "poly.h"
+#include "input.h"
+#include "poly_parser.h"
+#include "poly_eval.h"
+#include "poly_permute.h"
+
+/** Domyślne ziarno generatora liczb losowych
+ */
+#define DEFAULT_SEED 2021
+
+/** Domyślna liczba pomiarów każdej operacji
+ */
+#define DEFAULT_REPEATS 5
+
+/** Domyślny minimalny czas jednego pomiaru w milisekundach
+ */
+#define DEFAULT_MIN_TIME_MS 50
+
+/** Maksymalna liczba pomiarów
+ */
+#define MAX_REPEATS 101
+
+/** Liczba punktów, w których PolyEvalBatch oblicza wartość
+ */
+#define EVAL_POINTS 1024
+
+/** Liczba nanosekund w milisekundzie
+ */
+#define NS_PER_MS 1000000ULL
+
+/**
+ * Parametry generowanych wielomianów danego kształtu
+ */
+typedef struct ShapeT {
+    const char *name;   ///< nazwa kształtu
+    int depth;          ///< liczba zmiennych
+    size_t width;       ///< liczba jednomianów na każdym poziomie
+    int maxGap;         ///< największa różnica sąsiednich wykładników
+} ShapeT;
+
+/** Kształty wielomianów: rzadki, gęsty, głęboki i szeroki
+ */
+static const ShapeT shapes[] = {
+        {"sparse", 3, 6, 1000},
+        {"dense", 1, 256, 1},
+        {"deep", 8, 2, 3},
+        {"wide", 2, 24, 2},
+};
+
+/**
+ * Dane wejściowe mierzonych operacji dla jednego kształtu
+ */
+typedef struct BenchDataT {
+    Poly p;             ///< pierwszy argument
+    Poly q;             ///< drugi argument
+    Poly pCopy;         ///< kopia @p p
+    Poly prod;          ///< iloczyn @p p i @p q dzielony przez PolyDivExact
+    Poly mono;          ///< pojedynczy jednomian @f$c x^{e}@f$
+    poly_exp_t truncDeg;  ///< ograniczenie stopnia dla PolyMulTrunc
+    size_t nvars;       ///< liczba zmiennych w punktach dla PolyEvalBatch
+    poly_coeff_t *points; ///< wartości zmiennych w punktach, kolumnami
+    poly_coeff_t *values; ///< wartości @p p w punktach
+    Poly *substs;       ///< wielomiany @f$c_i x_i@f$ podstawiane przez PolyCompose
+    size_t *reversed;   ///< permutacja odwracająca kolejność zmiennych
+    size_t *order;      ///< bufor na permutację z PolyBestOrder
+    char *text;         ///< zapis tekstowy @p p zakończony znakiem '\n'
+    size_t textLen;     ///< długość zapisu
+    char *line;         ///< bufor na kopię zapisu dla parsera
+    Mono *monos;        ///< jednomiany o stałych współczynnikach w losowej kolejności
+    size_t monosCount;  ///< liczba jednomianów
+    Mono *monosArg;     ///< bufor na kopię @p monos dla PolyAddMonos
+    FILE *devNull;      ///< strumień, do którego wypisujemy wielomiany
+} BenchDataT;
+
+/**
+ * Mierzona operacja
+ */
+typedef struct BenchT {
+    const char *name;                   ///< nazwa operacji
+    void (*run)(BenchDataT *data);      ///< pojedyncze wykonanie operacji
+} BenchT;
+
+/** Zapobiega usunięciu przez kompilator obliczeń, których wynik nie jest
+ * używany
+ */
+static volatile long sink;
+
+/** Stan generatora liczb losowych
+ */
+static uint64_t rngState;
+
+/**
+ * Generator liczb pseudolosowych splitmix64
+ * @return : kolejna liczba losowa
+ */
+static uint64_t nextRandom(void) {
+    uint64_t z = (rngState += UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
+
+/**
+ * Losuje liczbę z przedziału [0, n)
+ * @param[in] n : długość przedziału
+ * @return : wylosowana liczba
+ */
+static uint64_t randomBelow(uint64_t n) {
+    return nextRandom() % n;
+}
+
+/**
+ * Losuje niezerowy współczynnik z przedziału [-9, 9]
+ * @return : wylosowany współczynnik
+ */
+static poly_coeff_t randomCoeff(void) {
+    poly_coeff_t c = (poly_coeff_t) randomBelow(18) - 9;
+    return c >= 0 ? c + 1 : c;
+}
+
+/**
+ * Generuje wielomian o zadanym kształcie
+ * @param[in] depth : liczba zmiennych
+ * @param[in] width : liczba jednomianów na każdym poziomie
+ * @param[in] maxGap : największa różnica sąsiednich wykładników
+ * @return : wygenerowany wielomian
+ */
+static Poly genPoly(int depth, size_t width, int maxGap) {
+    if (depth == 0) return PolyFromCoeff(randomCoeff());
+
+    Mono *monos = safeMalloc(width * sizeof(Mono));
+    poly_exp_t exp = (poly_exp_t) randomBelow(maxGap);
+    for (size_t i = 0; i < width; ++i) {
+        Poly p = genPoly(depth - 1, width, maxGap);
+        monos[i] = MonoFromPoly(&p, exp);
+        exp += 1 + (poly_exp_t) randomBelow(maxGap);
+    }
+    Poly res = PolyAddMonos(width, monos);
+    safeFree(monos);
+    return res;
+}
+
+/**
+ * Generuje wielomian @f$c x_{idx}@f$
+ * @param[in] idx : indeks zmiennej
+ * @param[in] c : współczynnik
+ * @return : wygenerowany wielomian
+ */
+static Poly genVar(size_t idx, poly_coeff_t c) {
+    Poly res = PolyFromCoeff(c);
+    for (size_t i = 0; i <= idx; ++i) {
+        Mono m = MonoFromPoly(&res, i == 0 ? 1 : 0);
+        res = PolyAddMonos(1, &m);
+    }
+    return res;
+}
+
+/**
+ * Przygotowuje dane wejściowe dla danego kształtu
+ * @param[in] shape : kształt wielomianów
+ * @param[out] data : dane wejściowe
+ */
+static void initData(const ShapeT *shape, BenchDataT *data) {
+    data->p = genPoly(shape->depth, shape->width, shape->maxGap);
+    data->q = genPoly(shape->depth, shape->width, shape->maxGap);
+    data->pCopy = PolyClone(&data->p);
+    data->prod = PolyMul(&data->p, &data->q);
+    Poly monoCoeff = PolyFromCoeff(randomCoeff());
+    Mono mono = MonoFromPoly(&monoCoeff, (poly_exp_t) shape->maxGap);
+    data->mono = PolyAddMonos(1, &mono);
+    // Iloczyn ma stopień około 2 deg p, więc obcinana jest mniej więcej
+    // połowa zakresu stopni
+    data->truncDeg = PolyDeg(&data->p);
+
+    data->nvars = (size_t) shape->depth;
+    data->points = safeMalloc(data->nvars * EVAL_POINTS * sizeof(poly_coeff_t));
+    for (size_t i = 0; i < data->nvars * EVAL_POINTS; ++i) {
+        data->points[i] = randomCoeff();
+    }
+    data->values = safeMalloc(EVAL_POINTS * sizeof(poly_coeff_t));
+    // Przeskalowanie zmiennych nie zmienia kształtu wielomianu
+    data->substs = safeMalloc(data->nvars * sizeof(Poly));
+    for (size_t i = 0; i < data->nvars; ++i) {
+        data->substs[i] = genVar(i, randomCoeff());
+    }
+    data->reversed = safeMalloc(data->nvars * sizeof(size_t));
+    data->order = safeMalloc(data->nvars * sizeof(size_t));
+    for (size_t i = 0; i < data->nvars; ++i) {
+        data->reversed[i] = data->nvars - 1 - i;
+    }
+
+    FILE *text = open_memstream(&data->text, &data->textLen);
+    if (text == NULL) exit(1);
+    PrintPoly(text, &data->p);
+    fputc('\n', text);
+    fclose(text);
+    data->line = safeMalloc(data->textLen + 1);
+
+    // Jednomiany ze stałymi współczynnikami można kopiować bez alokacji,
+    // więc pomiar PolyAddMonos nie obejmuje kopiowania argumentów
+    data->monosCount = shape->width * (size_t) shape->depth;
+    data->monos = safeMalloc(data->monosCount * sizeof(Mono));
+    data->monosArg = safeMalloc(data->monosCount * sizeof(Mono));
+    for (size_t i = 0; i < data->monosCount; ++i) {
+        Poly c = PolyFromCoeff(randomCoeff());
+        data->monos[i] = MonoFromPoly(&c, (poly_exp_t) randomBelow(
+                data->monosCount * shape->maxGap));
+    }
+
+    data->devNull = fopen("/dev/null", "w");
+    if (data->devNull == NULL) exit(1);
+}
+
+/**
+ * Zwalnia dane wejściowe
+ * @param[in] data : dane wejściowe
+ */
+static void destroyData(BenchDataT *data) {
+    PolyDestroy(&data->p);
+    PolyDestroy(&data->q);
+    PolyDestroy(&data->pCopy);
+    PolyDestroy(&data->prod);
+    PolyDestroy(&data->mono);
+    free(data->text);
+    safeFree(data->line);
+    safeFree(data->monos);
+    safeFree(data->monosArg);
+    safeFree(data->points);
+    safeFree(data->values);
+    for (size_t i = 0; i < data->nvars; ++i) PolyDestroy(&data->substs[i]);
+    safeFree(data->substs);
+    safeFree(data->reversed);
+    safeFree(data->order);
+    fclose(data->devNull);
+}
+
+/**
+ * Mierzy PolyAdd
+ * @param[in] data : dane wejściowe
+ */
+static void benchAdd(BenchDataT *data) {
+    Poly res = PolyAdd(&data->p, &data->q);
+    PolyDestroy(&res);
+}
+
+/**
+ * Mierzy PolySub
+ * @param[in] data : dane wejściowe
+ */
+static void benchSub(BenchDataT *data) {
+    Poly res = PolySub(&data->p, &data->q);
+    PolyDestroy(&res);
+}
+
+/**
+ * Mierzy PolySubInPlace na kopii @p p, więc razem z kopiowaniem
+ * współdzielonych tablic, które odejmowanie zmienia
+ * @param[in] data : dane wejściowe
+ */
+static void benchSubInPlace(BenchDataT *data) {
+    Poly res = PolyClone(&data->p);
+    PolySubInPlace(&res, &data->q);
+    PolyDestroy(&res);
+}
+
+/**
+ * Mierzy PolyMul
+ * @param[in] data : dane wejściowe
+ */
+static void benchMul(BenchDataT *data) {
+    Poly res = PolyMul(&data->p, &data->q);
+    PolyDestroy(&res);
+}
+
+/**
+ * Mierzy PolyMul przez jednomian
+ * @param[in] data : dane wejściowe
+ */
+static void benchMulMono(BenchDataT *data) {
+    Poly res = PolyMul(&data->p, &data->mono);
+    PolyDestroy(&res);
+}
+
+/**
+ * Mierzy PolyMulByMonoInPlace na kopii @p p, więc razem z kopiowaniem
+ * współdzielonych tablic, które mnożenie zmienia
+ * @param[in] data : dane wejściowe
+ */
+static void benchMulMonoInPlace(BenchDataT *data) {
+    Poly res = PolyClone(&data->p);
+    PolyMulByMonoInPlace(&res, &data->mono.arr[0]);
+    PolyDestroy(&res);
+}
+
+/**
+ * Mierzy PolyMulTrunc
+ * @param[in] data : dane wejściowe
+ */
+static void benchMulTrunc(BenchDataT *data) {
+    Poly res = PolyMulTrunc(&data->p, &data->q, data->truncDeg);
+    PolyDestroy(&res);
+}
+
+/**
+ * Mierzy PolyDivExact dzielący iloczyn @p p i @p q przez @p q
+ * @param[in] data : dane wejściowe
+ */
+static void benchDiv(BenchDataT *data) {
+    Poly res;
+    if (!PolyDivExact(&data->prod, &data->q, &res)) exit(1);
+    PolyDestroy(&res);
+}
+
+/**
+ * Mierzy PolyAddMonos na nieposortowanych jednomianach
+ * @param[in] data : dane wejściowe
+ */
+static void benchAddMonos(BenchDataT *data) {
+    memcpy(data->monosArg, data->monos, data->monosCount * sizeof(Mono));
+    Poly res = PolyAddMonos(data->monosCount, data->monosArg);
+    PolyDestroy(&res);
+}
+
+/**
+ * Mierzy PolyAt
+ * @param[in] data : dane wejściowe
+ */
+static void benchAt(BenchDataT *data) {
+    Poly res = PolyAt(&data->p, 3);
+    PolyDestroy(&res);
+}
+
+/**
+ * Mierzy PolyEvalBatch w #EVAL_POINTS punktach
+ * @param[in] data : dane wejściowe
+ */
+static void benchEvalBatch(BenchDataT *data) {
+    PolyEvalBatch(&data->p, data->nvars, data->points, EVAL_POINTS,
+                  data->values);
+    sink += data->values[0];
+}
+
+/**
+ * Mierzy PolyCompose podstawiający @f$c_i x_i@f$ za każdą zmienną
+ * @param[in] data : dane wejściowe
+ */
+static void benchCompose(BenchDataT *data) {
+    Poly res = PolyCompose(&data->p, data->nvars, data->substs);
+    PolyDestroy(&res);
+}
+
+/**
+ * Mierzy PolyPermute odwracający kolejność zmiennych
+ * @param[in] data : dane wejściowe
+ */
+static void benchPermute(BenchDataT *data) {
+    Poly res = PolyPermute(&data->p, data->nvars, data->reversed);
+    PolyDestroy(&res);
+}
+
+/**
+ * Mierzy PolyBestOrder
+ * @param[in] data : dane wejściowe
+ */
+static void benchBestOrder(BenchDataT *data) {
+    sink += (long) PolyBestOrder(&data->p, data->order);
+}
+
+/**
+ * Mierzy PolyClone
+ * @param[in] data : dane wejściowe
+ */
+static void benchClone(BenchDataT *data) {
+    Poly res = PolyClone(&data->p);
+    PolyDestroy(&res);
+}
+
+/**
+ * Mierzy PolyIsEq dla równych wielomianów, czyli w najgorszym przypadku
+ * @param[in] data : dane wejściowe
+ */
+static void benchIsEq(BenchDataT *data) {
+    sink += PolyIsEq(&data->p, &data->pCopy);
+}
+
+/**
+ * Mierzy parsowanie zapisu tekstowego wielomianu
+ * @param[in] data : dane wejściowe
+ */
+static void benchParse(BenchDataT *data) {
+    CommandT comm;
+    memcpy(data->line, data->text, data->textLen + 1);
+    parseLine(data->line, (ssize_t) data->textLen, 1, &comm);
+    if (comm.kind == COMM_POLY) PolyDestroy(&comm.p);
+}
+
+/**
+ * Mierzy wypisywanie wielomianu
+ * @param[in] data : dane wejściowe
+ */
+static void benchPrint(BenchDataT *data) {
+    PrintPoly(data->devNull, &data->p);
+    fputc('\n', data->devNull);
+}
+
+/** Mierzone operacje
+ */
+static const BenchT benches[] = {
+        {"add", benchAdd},
+        {"sub", benchSub},
+        {"sub_in_place", benchSubInPlace},
+        {"mul", benchMul},
+        {"mul_mono", benchMulMono},
+        {"mul_mono_in_place", benchMulMonoInPlace},
+        {"mul_trunc", benchMulTrunc},
+        {"div", benchDiv},
+        {"add_monos", benchAddMonos},
+        {"at", benchAt},
+        {"eval_batch", benchEvalBatch},
+        {"compose", benchCompose},
+        {"permute", benchPermute},
+        {"best_order", benchBestOrder},
+        {"clone", benchClone},
+        {"is_eq", benchIsEq},
+        {"parse", benchParse},
+        {"print", benchPrint},
+};
+
+/**
+ * Zwraca bieżący czas w nanosekundach
+ * @return : czas w nanosekundach
+ */
+static uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Wykonuje operację zadaną liczbę razy
+ * @param[in] bench : operacja
+ * @param[in] data : dane wejściowe
+ * @param[in] iters : liczba wykonań
+ * @return : czas wykonania w nanosekundach
+ */
+static uint64_t runIters(const BenchT *bench, BenchDataT *data, size_t iters) {
+    uint64_t start = nowNs();
+    for (size_t i = 0; i < iters; ++i) bench->run(data);
+    return nowNs() - start;
+}
+
+/**
+ * Porównuje dwie liczby na potrzeby qsort
+ * @param[in] a : wskaźnik na pierwszą liczbę
+ * @param[in] b : wskaźnik na drugą liczbę
+ * @return : wynik porównania
+ */
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Wynik pomiaru jednej operacji
+ */
+typedef struct ResultT {
+    size_t iters;       ///< liczba wykonań w jednym pomiarze
+    double median;      ///< mediana czasu operacji w nanosekundach
+    double min;         ///< najkrótszy czas operacji w nanosekundach
+    double allocs;      ///< średnia liczba alokacji na operację
+} ResultT;
+
+/**
+ * Mierzy operację. Liczba wykonań jest podwajana, dopóki wykonanie nie
+ * trwa co najmniej @p minTimeNs, co jednocześnie rozgrzewa pamięć
+ * podręczną i alokator.
+ * @param[in] bench : operacja
+ * @param[in] data : dane wejściowe
+ * @param[in] repeats : liczba pomiarów
+ * @param[in] minTimeNs : minimalny czas pomiaru
+ * @return : wynik pomiaru
+ */
+static ResultT measure(const BenchT *bench, BenchDataT *data, size_t repeats,
+                       uint64_t minTimeNs) {
+    ResultT res = {.iters = 1};
+    while (runIters(bench, data, res.iters) < minTimeNs) res.iters *= 2;
+
+    double times[MAX_REPEATS];
+    size_t allocsBefore = allocationCount();
+    for (size_t i = 0; i < repeats; ++i)
+        times[i] = (double) runIters(bench, data, res.iters) / res.iters;
+    res.allocs = (double) (allocationCount() - allocsBefore) /
+                 ((double) res.iters * repeats);
+
+    qsort(times, repeats, sizeof(double), compareDoubles);
+    res.median = times[repeats / 2];
+    res.min = times[0];
+    return res;
+}
+
+/** Opcje programu
+ */
+static const struct option options[] = {
+        {"seed", required_argument, NULL, 's'},
+        {"repeats", required_argument, NULL, 'r'},
+        {"min-time", required_argument, NULL, 't'},
+        {"json", no_argument, NULL, 'j'},
+        {NULL, 0, NULL, 0}
+};
+
+int main(int argc, char **argv) {
+    uint64_t seed = DEFAULT_SEED, minTimeNs = DEFAULT_MIN_TIME_MS * NS_PER_MS;
+    size_t repeats = DEFAULT_REPEATS;
+    bool json = false;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        if (opt == 's') {
+            seed = strtoull(optarg, NULL, 10);
+        } else if (opt == 'r') {
+            repeats = strtoull(optarg, NULL, 10);
+            if (repeats == 0 || repeats > MAX_REPEATS) {
+                fprintf(stderr, "ERROR WRONG VALUE %s\n", optarg);
+                return 1;
+            }
+        } else if (opt == 't') {
+            minTimeNs = strtoull(optarg, NULL, 10) * NS_PER_MS;
+        } else if (opt == 'j') {
+            json = true;
+        } else {
+            return 1;
+        }
+    }
+    const char *filter = optind < argc ? argv[optind] : NULL;
+
+    if (json)
+        printf("{\n  \"seed\": %" PRIu64 ",\n  \"repeats\": %zu,\n"
+               "  \"results\": [", seed, repeats);
+    else
+        printf("%-20s %12s %14s %14s %10s\n", "benchmark", "iterations",
+               "ns/op", "min ns/op", "allocs/op");
+
+    bool first = true;
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); ++s) {
+        // Każdy kształt ma własne ziarno, więc dane nie zależą od filtra
+        rngState = seed + s;
+        BenchDataT data;
+        initData(&shapes[s], &data);
+
+        for (size_t b = 0; b < sizeof(benches) / sizeof(benches[0]); ++b) {
+            char name[64];
+            snprintf(name, sizeof(name), "%s/%s", benches[b].name,
+                     shapes[s].name);
+            if (filter != NULL && strstr(name, filter) == NULL) continue;
+
+            ResultT res = measure(&benches[b], &data, repeats, minTimeNs);
+            if (json)
+                printf("%s\n    {\"name\": \"%s\", \"iterations\": %zu, "
+                       "\"ns_per_op\": %.1f, \"min_ns_per_op\": %.1f, "
+                       "\"allocs_per_op\": %.2f}", first ? "" : ",", name,
+                       res.iters, res.median, res.min, res.allocs);
+            else
+                printf("%-20s %12zu %14.1f %14.1f %10.2f\n", name, res.iters,
+                       res.median, res.min, res.allocs);
+            fflush(stdout);
+            first = false;
+        }
+        destroyData(&data);
+    }
+
+    if (json) printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,140 @@
+/** @file
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#include <stdint.h>
+#include "poly_eval.h"
+#include "input.h"
+
+/**
+ * Stan obliczania wartości jednego bloku punktów
+ */
+typedef struct EvalT {
+    size_t levels;      ///< liczba zmiennych o wartościach w @p xs
+    uint64_t *xs;       ///< wartości zmiennych w punktach bloku, kolumnami
+    uint64_t *scratch;  ///< dwa bufory na każdy poziom drzewa
+} EvalT;
+
+/**
+ * Mnoży wartości przez potęgę zmiennej, podnosząc do potęgi metodą
+ * szybkiego potęgowania, z tymi samymi krokami dla wszystkich punktów
+ * @param[in,out] res : wartości w punktach bloku
+ * @param[in] x : wartości zmiennej w punktach bloku
+ * @param[in] exp : wykładnik
+ * @param[out] pw : bufor na potęgę
+ */
+static void mulPow(uint64_t res[EVAL_LANES], const uint64_t x[EVAL_LANES],
+                   poly_exp_t exp, uint64_t pw[EVAL_LANES]) {
+    if (exp == 0) return;
+    if (exp == 1) {
+        for (size_t l = 0; l < EVAL_LANES; ++l) res[l] *= x[l];
+        return;
+    }
+
+    int bit = 0;
+    while ((exp >> (bit + 1)) != 0) bit++;
+    for (size_t l = 0; l < EVAL_LANES; ++l) pw[l] = x[l];
+    while (bit-- > 0) {
+        for (size_t l = 0; l < EVAL_LANES; ++l) pw[l] *= pw[l];
+        if ((exp >> bit) & 1) {
+            for (size_t l = 0; l < EVAL_LANES; ++l) pw[l] *= x[l];
+        }
+    }
+    for (size_t l = 0; l < EVAL_LANES; ++l) res[l] *= pw[l];
+}
+
+/**
+ * Oblicza wartości wielomianu zmiennych @f$x_{var}, x_{var+1}, \ldots@f$
+ * w punktach bloku
+ * @param[in] ev : stan obliczania
+ * @param[in] p : wielomian
+ * @param[in] var : numer pierwszej zmiennej wielomianu
+ * @param[out] res : wartości w punktach bloku
+ */
+static void evalRec(const EvalT *ev, const Poly *p, size_t var,
+                    uint64_t res[EVAL_LANES]);
+
+/**
+ * Dodaje do wartości wartości współczynnika jednomianu. Współczynniki
+ * stałe, których w drzewie jest najwięcej, są dodawane bez rekurencji.
+ * @param[in] ev : stan obliczania
+ * @param[in] p : współczynnik jednomianu
+ * @param[in] var : numer pierwszej zmiennej współczynnika
+ * @param[in,out] res : wartości w punktach bloku
+ * @param[out] tmp : bufor na wartości współczynnika
+ */
+static void addCoeff(const EvalT *ev, const Poly *p, size_t var,
+                     uint64_t res[EVAL_LANES], uint64_t tmp[EVAL_LANES]) {
+    if (PolyIsCoeff(p)) {
+        uint64_t coeff = (uint64_t) p->coeff;
+        for (size_t l = 0; l < EVAL_LANES; ++l) res[l] += coeff;
+        return;
+    }
+    evalRec(ev, p, var, tmp);
+    for (size_t l = 0; l < EVAL_LANES; ++l) res[l] += tmp[l];
+}
+
+static void evalRec(const EvalT *ev, const Poly *p, size_t var,
+                    uint64_t res[EVAL_LANES]) {
+    if (PolyIsCoeff(p)) {
+        uint64_t coeff = (uint64_t) p->coeff;
+        for (size_t l = 0; l < EVAL_LANES; ++l) res[l] = coeff;
+        return;
+    }
+
+    // Zmienna bez wartości w punkcie jest równa 0, więc zostaje tylko
+    // współczynnik przy x^0
+    if (var >= ev->levels) {
+        if (p->arr[0].exp == 0) {
+            evalRec(ev, &p->arr[0].p, var + 1, res);
+        } else {
+            for (size_t l = 0; l < EVAL_LANES; ++l) res[l] = 0;
+        }
+        return;
+    }
+
+    const uint64_t *x = &ev->xs[var * EVAL_LANES];
+    uint64_t *tmp = &ev->scratch[2 * var * EVAL_LANES];
+    uint64_t *pw = tmp + EVAL_LANES;
+    evalRec(ev, &p->arr[p->size - 1].p, var + 1, res);
+    for (size_t i = p->size - 1; i-- > 0;) {
+        mulPow(res, x, p->arr[i + 1].exp - p->arr[i].exp, pw);
+        addCoeff(ev, &p->arr[i].p, var + 1, res, tmp);
+    }
+    mulPow(res, x, p->arr[0].exp, pw);
+}
+
+void PolyEvalBatch(const Poly *p, size_t nvars, const poly_coeff_t *points,
+                   size_t npoints, poly_coeff_t *out) {
+    if (npoints == 0) return;
+
+    // Zmienne głębiej niż drzewo nie wpływają na wartość
+    size_t depth = PolyDepth(p);
+    EvalT ev = {.levels = nvars < depth ? nvars : depth};
+    ev.xs = safeMalloc((ev.levels + 1) * EVAL_LANES * sizeof(uint64_t));
+    ev.scratch = safeMalloc((2 * ev.levels + 1) * EVAL_LANES *
+                            sizeof(uint64_t));
+    uint64_t values[EVAL_LANES];
+
+    for (size_t start = 0; start < npoints; start += EVAL_LANES) {
+        size_t lanes = npoints - start < EVAL_LANES ? npoints - start
+                                                    : EVAL_LANES;
+        // Ostatni blok jest dopełniany zerami
+        for (size_t v = 0; v < ev.levels; ++v) {
+            const poly_coeff_t *column = &points[v * npoints + start];
+            for (size_t l = 0; l < EVAL_LANES; ++l) {
+                ev.xs[v * EVAL_LANES + l] = l < lanes ? (uint64_t) column[l]
+                                                      : 0;
+            }
+        }
+
+        evalRec(&ev, p, 0, values);
+        for (size_t l = 0; l < lanes; ++l) {
+            out[start + l] = (poly_coeff_t) values[l];
+        }
+    }
+
+    safeFree(ev.xs);
+    safeFree(ev.scratch);
+}
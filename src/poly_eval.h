@@ -0,0 +1,49 @@
+/** @file
+ * Obliczanie wartości wielomianu w wielu punktach jednocześnie
+ *
+ * Punkty są podzielone na bloki po #EVAL_LANES. Dla każdego bloku drzewo
+ * wielomianu jest przechodzone raz, schematem Hornera, a każdy węzeł liczy
+ * wartości od razu dla wszystkich punktów bloku. Wartości zmiennych są
+ * przechowywane kolumnami (najpierw wszystkie wartości @f$x_0@f$, potem
+ * @f$x_1@f$ itd.), więc pętle po punktach bloku mają stałą długość i ciągły
+ * dostęp do pamięci, co pozwala kompilatorowi użyć instrukcji wektorowych
+ * (np. przy kompilacji z opcją POLY_NATIVE). Obliczenia nie tworzą
+ * pośrednich wielomianów.
+ *
+ * Arytmetyka jest modulo @f$2^{64}@f$ (z reprezentacją uzupełnień do dwóch),
+ * więc wynik jest zgodny z kolejnymi wywołaniami PolyAt, jeśli żaden wynik
+ * pośredni nie przekracza zakresu poly_coeff_t.
+ *
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#ifndef POLYNOMIALS_POLY_EVAL_H
+#define POLYNOMIALS_POLY_EVAL_H
+
+#include "poly.h"
+
+// Eksportowane z biblioteki dzielonej (zob. poly.h)
+#pragma GCC visibility push(default)
+
+/** Liczba punktów liczonych jednocześnie w jednym przejściu drzewa
+ */
+#define EVAL_LANES 64
+
+/**
+ * Oblicza wartości wielomianu w punktach @f$(x_0, \ldots, x_{nvars-1})@f$.
+ * Zmienne o indeksach od @p nvars w górę mają wartość 0. Wartość zmiennej
+ * @f$x_v@f$ w punkcie @f$i@f$ to @p points[v * npoints + i].
+ * @param[in] p : wielomian
+ * @param[in] nvars : liczba zmiennych w punkcie
+ * @param[in] points : wartości zmiennych, kolumnami
+ * @param[in] npoints : liczba punktów
+ * @param[out] out : wartości wielomianu w kolejnych punktach
+ */
+extern void PolyEvalBatch(const Poly *p, size_t nvars,
+                          const poly_coeff_t *points, size_t npoints,
+                          poly_coeff_t *out);
+
+#pragma GCC visibility pop
+
+#endif //POLYNOMIALS_POLY_EVAL_H
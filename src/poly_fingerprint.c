@@ -0,0 +1,156 @@
+/** @file
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#include "poly_fingerprint.h"
+
+/** Stała złotego podziału używana do rozpraszania ziarna
+ */
+#define GOLDEN_GAMMA UINT64_C(0x9E3779B97F4A7C15)
+
+/**
+ * Mnoży liczby modulo #FINGERPRINT_PRIME. Iloczyn liczb mniejszych od
+ * @f$P@f$ ma postać @f$h 2^{61} + l@f$, gdzie @f$h, l < P@f$, a
+ * @f$2^{61} \equiv 1@f$, więc wystarczy dodać @f$h@f$ i @f$l@f$.
+ * @param[in] a : czynnik mniejszy od #FINGERPRINT_PRIME
+ * @param[in] b : czynnik mniejszy od #FINGERPRINT_PRIME
+ * @return : @f$ab \bmod P@f$
+ */
+static uint64_t mulMod(uint64_t a, uint64_t b) {
+    unsigned __int128 prod = (unsigned __int128) a * b;
+    uint64_t res = ((uint64_t) prod & FINGERPRINT_PRIME) +
+                   (uint64_t) (prod >> 61);
+    return res >= FINGERPRINT_PRIME ? res - FINGERPRINT_PRIME : res;
+}
+
+/**
+ * Dodaje liczby modulo #FINGERPRINT_PRIME
+ * @param[in] a : składnik mniejszy od #FINGERPRINT_PRIME
+ * @param[in] b : składnik mniejszy od #FINGERPRINT_PRIME
+ * @return : @f$(a + b) \bmod P@f$
+ */
+static uint64_t addMod(uint64_t a, uint64_t b) {
+    uint64_t res = a + b;
+    return res >= FINGERPRINT_PRIME ? res - FINGERPRINT_PRIME : res;
+}
+
+/**
+ * Podnosi liczbę do potęgi modulo #FINGERPRINT_PRIME
+ * @param[in] base : podstawa mniejsza od #FINGERPRINT_PRIME
+ * @param[in] exp : nieujemny wykładnik
+ * @return : @f$base^{exp} \bmod P@f$
+ */
+static uint64_t powMod(uint64_t base, poly_exp_t exp) {
+    uint64_t res = 1;
+    for (; exp > 0; exp >>= 1) {
+        if (exp & 1) res = mulMod(res, base);
+        base = mulMod(base, base);
+    }
+    return res;
+}
+
+/**
+ * Zwraca resztę z liczby modulo #FINGERPRINT_PRIME bez dzielenia, korzystając
+ * z tego, że @f$2^{61} \equiv 1@f$
+ * @param[in] num : liczba
+ * @return : reszta z przedziału @f$[0, P)@f$
+ */
+static uint64_t reduce(uint64_t num) {
+    uint64_t res = (num & FINGERPRINT_PRIME) + (num >> 61);
+    return res >= FINGERPRINT_PRIME ? res - FINGERPRINT_PRIME : res;
+}
+
+/**
+ * Wyznacza pseudolosową wartość zmiennej (funkcja mieszająca splitmix64)
+ * @param[in] seed : ziarno punktów
+ * @param[in] round : numer rundy
+ * @param[in] var : numer zmiennej
+ * @return : wartość zmiennej z przedziału @f$[0, P)@f$
+ */
+static uint64_t point(uint64_t seed, size_t round, size_t var) {
+    uint64_t z = seed + (var * FINGERPRINT_ROUNDS + round + 1) * GOLDEN_GAMMA;
+    z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+    return reduce(z ^ (z >> 31));
+}
+
+/**
+ * Zwraca wartość współczynnika: 64 bity współczynnika dzielone są na
+ * połówki @f$h@f$ i @f$l@f$ mniejsze od @f$2^{32}@f$, a współczynnik
+ * odpowiada wielomianowi @f$l + h t@f$ dodatkowej zmiennej @f$t@f$. Różne
+ * współczynniki dają różne wielomiany, bo @f$h, l < P@f$.
+ * @param[in] coeff : współczynnik
+ * @param[in] t : wartość zmiennej @f$t@f$
+ * @return : wartość z przedziału @f$[0, P)@f$
+ */
+static uint64_t coeffValue(poly_coeff_t coeff, uint64_t t) {
+    uint64_t bits = (uint64_t) coeff;
+    return addMod(bits & UINT32_MAX, mulMod(bits >> 32, t));
+}
+
+/**
+ * Liczy odcisk wielomianu zmiennych @f$x_{var}, x_{var+1}, \ldots@f$
+ * we wszystkich rundach jednocześnie, przechodząc drzewo raz
+ * @param[in] p : wielomian
+ * @param[in] seed : ziarno punktów
+ * @param[in] t : wartości zmiennej współczynników w kolejnych rundach
+ * @param[in] var : numer pierwszej zmiennej wielomianu
+ * @param[out] res : wartości wielomianu w kolejnych rundach
+ */
+static void fingerprintRec(const Poly *p, uint64_t seed,
+                           const uint64_t t[FINGERPRINT_ROUNDS], size_t var,
+                           uint64_t res[FINGERPRINT_ROUNDS]) {
+    if (PolyIsCoeff(p)) {
+        for (size_t r = 0; r < FINGERPRINT_ROUNDS; ++r) {
+            res[r] = coeffValue(p->coeff, t[r]);
+        }
+        return;
+    }
+
+    // Jednomiany są posortowane rosnąco, więc potęgę zmiennej wystarczy
+    // domnażać o różnicę kolejnych wykładników
+    uint64_t x[FINGERPRINT_ROUNDS], xPow[FINGERPRINT_ROUNDS];
+    for (size_t r = 0; r < FINGERPRINT_ROUNDS; ++r) {
+        x[r] = point(seed, r, var);
+        xPow[r] = 1;
+        res[r] = 0;
+    }
+
+    poly_exp_t prevExp = 0;
+    for (size_t i = 0; i < p->size; ++i) {
+        assert(p->arr[i].exp >= prevExp);
+        uint64_t coeff[FINGERPRINT_ROUNDS];
+        fingerprintRec(&p->arr[i].p, seed, t, var + 1, coeff);
+        poly_exp_t step = p->arr[i].exp - prevExp;
+        for (size_t r = 0; r < FINGERPRINT_ROUNDS; ++r) {
+            if (step != 0)
+                xPow[r] = mulMod(xPow[r],
+                                 step == 1 ? x[r] : powMod(x[r], step));
+            res[r] = addMod(res[r], mulMod(coeff[r], xPow[r]));
+        }
+        prevExp = p->arr[i].exp;
+    }
+}
+
+void PolyFingerprint(const Poly *p, uint64_t seed,
+                     uint64_t fingerprint[FINGERPRINT_ROUNDS]) {
+    // Zmienna współczynników ma numer, którego nie ma żadna zmienna
+    // wielomianu
+    uint64_t t[FINGERPRINT_ROUNDS];
+    for (size_t r = 0; r < FINGERPRINT_ROUNDS; ++r) {
+        t[r] = point(seed, r, SIZE_MAX);
+    }
+    fingerprintRec(p, seed, t, 0, fingerprint);
+}
+
+bool PolyFingerprintEq(const Poly *p, const Poly *q, uint64_t seed) {
+    uint64_t pPrint[FINGERPRINT_ROUNDS], qPrint[FINGERPRINT_ROUNDS];
+    PolyFingerprint(p, seed, pPrint);
+    PolyFingerprint(q, seed, qPrint);
+
+    for (size_t r = 0; r < FINGERPRINT_ROUNDS; ++r) {
+        if (pPrint[r] != qPrint[r]) return false;
+    }
+    return true;
+}
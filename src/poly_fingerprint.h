@@ -0,0 +1,71 @@
+/** @file
+ * Probabilistyczne porównywanie wielomianów
+ *
+ * Odcisk wielomianu to jego wartości w #FINGERPRINT_ROUNDS pseudolosowych
+ * punktach ciała @f$\mathbb{Z}_P@f$, @f$P = 2^{61} - 1@f$. Wartość zmiennej
+ * @f$x_i@f$ w rundzie @f$r@f$ jest wyznaczana z ziarna, @f$r@f$ oraz @f$i@f$,
+ * więc nie trzeba jej przechowywać, a liczenie odcisku niczego nie alokuje.
+ *
+ * Współczynnik @f$c@f$ nie jest brany modulo @f$P@f$, bo różne
+ * współczynniki mogłyby dać tę samą resztę. Zamiast tego jego starsze
+ * i młodsze 32 bity @f$h@f$ i @f$l@f$ są współczynnikami wielomianu
+ * @f$l + h t@f$ dodatkowej zmiennej @f$t@f$, której wartość też zależy od
+ * ziarna i rundy. Każdy wielomian ma więc inny obraz w
+ * @f$\mathbb{Z}_P[x_0, x_1, \ldots, t]@f$, o stopniu większym najwyżej o 1.
+ *
+ * Różne odciski oznaczają na pewno różne wielomiany. Jeśli wielomiany
+ * @f$p \neq q@f$ mają stopnie (PolyDeg) co najwyżej @f$D@f$, to z lematu
+ * Schwartza-Zippla jedna runda nie odróżnia ich z prawdopodobieństwem
+ * co najwyżej @f$(D + 1) / P@f$, a wszystkie rundy z prawdopodobieństwem
+ * co najwyżej @f$((D + 1) / P)^{R}@f$, gdzie @f$R@f$ to #FINGERPRINT_ROUNDS.
+ * Dla @f$D < 2^{31}@f$ daje to co najwyżej @f$2^{-60}@f$. Oszacowanie zakłada
+ * losowe punkty, więc nie dotyczy wielomianów dobranych do znanego ziarna.
+ *
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#ifndef POLYNOMIALS_POLY_FINGERPRINT_H
+#define POLYNOMIALS_POLY_FINGERPRINT_H
+
+#include <stdint.h>
+#include "poly.h"
+
+// Eksportowane z biblioteki dzielonej (zob. poly.h)
+#pragma GCC visibility push(default)
+
+/** Liczba pierwsza, modulo której liczone są odciski (@f$2^{61} - 1@f$)
+ */
+#define FINGERPRINT_PRIME ((UINT64_C(1) << 61) - 1)
+
+/** Liczba niezależnych punktów, w których liczony jest odcisk
+ */
+#define FINGERPRINT_ROUNDS 2
+
+/** Domyślne ziarno punktów
+ */
+#define FINGERPRINT_DEFAULT_SEED 2021
+
+/**
+ * Liczy odcisk wielomianu
+ * @param[in] p : wielomian
+ * @param[in] seed : ziarno punktów
+ * @param[out] fingerprint : wartości wielomianu w kolejnych rundach
+ */
+extern void PolyFingerprint(const Poly *p, uint64_t seed,
+                            uint64_t fingerprint[FINGERPRINT_ROUNDS]);
+
+/**
+ * Sprawdza, czy wielomiany mają równe odciski. Fałsz oznacza, że wielomiany
+ * na pewno są różne, a prawda, że są równe z prawdopodobieństwem opisanym
+ * na początku pliku.
+ * @param[in] p : wielomian
+ * @param[in] q : wielomian
+ * @param[in] seed : ziarno punktów
+ * @return : czy odciski są równe
+ */
+extern bool PolyFingerprintEq(const Poly *p, const Poly *q, uint64_t seed);
+
+#pragma GCC visibility pop
+
+#endif //POLYNOMIALS_POLY_FINGERPRINT_H
@@ -0,0 +1,42 @@
+/** @file
+ * Funkcje pomocnicze z poly.c używane przez kalkulator. Nie należą do
+ * interfejsu biblioteki libpoly, więc nie są eksportowane z biblioteki
+ * dzielonej.
+ *
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#ifndef POLYNOMIALS_POLY_INTERNAL_H
+#define POLYNOMIALS_POLY_INTERNAL_H
+
+#include "poly.h"
+
+/**
+ * Sprawdza czy wielomian jest stałą liczbą zapisaną w formie wielomianu
+ * @param[in] p : wielomian
+ * @return : czy wielomian jest stałą
+ */
+extern bool isPolyCoeffRec(const Poly *p);
+
+/**
+ * Zwraca w postaci liczby stałą, którą jest wielomian
+ * @param[in] p : wielomian
+ * @return liczba którą jest wielomian
+ */
+extern poly_coeff_t getCoeff(const Poly *p);
+
+/**
+ * Zamienia przekazany wielomian na wielomian przeciwny
+ * @param[in] p : wielomian
+ */
+extern void PolyNegHelp(Poly *p);
+
+/**
+ * Zwieksza dwukrotnie liczbę alokowanej pamięci przez tablicę Monosow
+ * @param monosSize : obecny rozmiar tablicy Monosow
+ * @param monosArr : tablica Monosow
+ */
+extern void ExpandMonoArr(unsigned long int *monosSize, Mono **monosArr);
+
+#endif //POLYNOMIALS_POLY_INTERNAL_H
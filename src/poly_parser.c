@@ -8,6 +8,9 @@
 #include <string.h>
 #include "poly_parser.h"
 #include "input.h"
+#include "poly_internal.h"
+#include "stats.h"
+#include "trace.h"
 
 /** Kod ASCII oznaczający 0
  */
@@ -21,6 +24,60 @@
  */
 #define INIT_MONOS_SIZE 16
 
+/** Niepoprawny char
+*/
+#define INVALID_CHAR '@'
+
+/** Znak oznaczający komentarz
+ */
+#define COMMENT_CHAR '#'
+
+/** Znak oznaczjący nową linie
+ */
+#define NEW_LINE_CHAR '\n'
+
+/**
+ * Odpowiednik funkcji strtoll, który zamiast ustawiać errno zwraca
+ * informację o przekroczeniu zakresu
+ * @param[in] str : tablica charów
+ * @param[out] endPtr : wskaźnik za ostatnią cyfrą liczby
+ * @param[out] res : wczytana liczba
+ * @return : czy liczba mieści się w zakresie long long
+ */
+static bool strToLL(const char *str, char **endPtr, long long *res) {
+    while (isspace(*str)) str++;
+    bool negative = *str == '-';
+    if (*str == '-' || *str == '+') str++;
+
+    unsigned long long limit = negative ? -(unsigned long long) LLONG_MIN
+                                        : LLONG_MAX;
+    unsigned long long num = 0;
+    bool inRange = true;
+    for (; *str >= ASCII_0 && *str <= ASCII_9; ++str) {
+        unsigned digit = *str - ASCII_0;
+        if (num > (limit - digit) / 10) inRange = false;
+        else num = num * 10 + digit;
+    }
+
+    *endPtr = (char *) str;
+    *res = negative ? (long long) -num : (long long) num;
+    return inRange;
+}
+
+bool strToULL(const char *str, char **endPtr, unsigned long long *res) {
+    unsigned long long num = 0;
+    bool inRange = true;
+    for (; *str >= ASCII_0 && *str <= ASCII_9; ++str) {
+        unsigned digit = *str - ASCII_0;
+        if (num > (ULLONG_MAX - digit) / 10) inRange = false;
+        else num = num * 10 + digit;
+    }
+
+    *endPtr = (char *) str;
+    *res = num;
+    return inRange;
+}
+
 
 /**
  * Sprawdza czy tablica charów zawiera tylko chary wyrażające liczby
@@ -28,8 +85,8 @@
  * @return : czy @str jest tożsamościowy równy liczbie
  */
 static bool containsOnlyNums(char *str) {
-    char c;
-    str = strtok(str, "\n");
+    char c, *savePtr;
+    str = strtok_r(str, "\n", &savePtr);
 
     if (str == NULL) return false;
 
@@ -43,84 +100,317 @@ static bool containsOnlyNums(char *str) {
 }
 
 /**
- * Sprawdza poprawność parametru przy wczytywaniu komendy AT i jeśli parametr
- * jest poprawny wykonuje komendę AT
+ * Ustawia komendę oznaczającą błąd w danej linii
+ * @param[out] comm : komenda
+ * @param[in] error : komunikat o błędzie
+ */
+static void setError(CommandT *comm, const char *error) {
+    STAT_INC(STAT_PARSE_ERRORS);
+    comm->kind = COMM_ERROR;
+    comm->error = error;
+}
+
+/**
+ * Sprawdza poprawność parametru przy wczytywaniu komendy AT
  * @param[in] str : wczytywana linia
  * @param[in] lineLen : długość wczytywanej linii
- * @param[in] w : nr wczytywanej linii
- * @param[in] stack : stos
+ * @param[out] comm : odczytana komenda
+ */
+static void parseAtComm(char *str, ssize_t lineLen, CommandT *comm) {
+    char *str_end;
+    if (lineLen > 4 && containsOnlyNums(&str[3]) && str[2] == ' ' &&
+        strToLL(&str[3], &str_end, &comm->x))
+        comm->kind = COMM_AT;
+    else
+        setError(comm, "AT WRONG VALUE");
+}
+
+/**
+ * Sprawdza poprawność parametru przy wczytywaniu komendy DEG_BY
+ * @param[in] str : wczytywana linia
+ * @param[in] lineLen : długość wczytywanej linii
+ * @param[out] comm : odczytana komenda
+ */
+static void parseDegByComm(char *str, ssize_t lineLen, CommandT *comm) {
+    char *str_end;
+    if (lineLen >= 8 && containsOnlyNums(&str[7]) && str[6] == ' ' &&
+        str[7] != '-' && strToULL(&str[7], &str_end, &comm->idx))
+        comm->kind = COMM_DEG_BY;
+    else
+        setError(comm, "DEG BY WRONG VARIABLE");
+}
+
+/**
+ * Sprawdza poprawność parametru przy wczytywaniu komendy COMPOSE
+ * @param[in] str : wczytywana linia
+ * @param[in] lineLen : długość wczytywanej linii
+ * @param[out] comm : odczytana komenda
+ */
+static void parseComposeComm(char *str, ssize_t lineLen, CommandT *comm) {
+    char *str_end;
+    if (lineLen >= 9 && str[7] == ' ' && isdigit(str[8]) &&
+        strToULL(&str[8], &str_end, &comm->k) && *str_end == '\0')
+        comm->kind = COMM_COMPOSE;
+    else
+        setError(comm, "COMPOSE WRONG PARAMETER");
+}
+
+/**
+ * Sprawdza poprawność parametrów przy wczytywaniu komendy MUL_TRUNC. Stopień
+ * większy niż największy wykładnik nie ogranicza iloczynu, więc jest
+ * zamieniany na #INT_MAX.
+ * @param[in] str : wczytywana linia
+ * @param[in] lineLen : długość wczytywanej linii
+ * @param[out] comm : odczytana komenda
+ */
+static void parseMulTruncComm(char *str, ssize_t lineLen, CommandT *comm) {
+    char *str_end;
+    unsigned long long deg;
+    if (lineLen < 11 || str[9] != ' ' || !isdigit(str[10]) ||
+        !strToULL(&str[10], &str_end, &deg) ||
+        (*str_end != '\0' && *str_end != ' ')) {
+        setError(comm, "MUL TRUNC WRONG DEGREE");
+        return;
+    }
+
+    comm->trunc.deg = deg > INT_MAX ? INT_MAX : (poly_exp_t) deg;
+    comm->trunc.byVar = *str_end == ' ';
+    if (comm->trunc.byVar &&
+        (!isdigit(str_end[1]) ||
+         !strToULL(&str_end[1], &str_end, &comm->trunc.idx) ||
+         *str_end != '\0')) {
+        setError(comm, "MUL TRUNC WRONG VARIABLE");
+        return;
+    }
+    comm->kind = COMM_MUL_TRUNC;
+}
+
+/**
+ * Sprawdza poprawność parametrów przy wczytywaniu komendy EVAL_BATCH, której
+ * parametrami są liczba zmiennych @f$n@f$ i wartości zmiennych kolejnych
+ * punktów (po @f$n@f$ dla każdego punktu). Wartości są zapisywane kolumnami
+ * (zob. PolyEvalBatch).
+ * @param[in] str : wczytywana linia
+ * @param[in] lineLen : długość wczytywanej linii
+ * @param[out] comm : odczytana komenda
  */
-static void parseAtComm(char *str, ssize_t lineLen, size_t w, StackT *stack) {
-    if (lineLen > 4 && containsOnlyNums(&str[3]) && str[2] == ' ') {
-        char *str_end;
-        poly_coeff_t x = strtol(&str[3], &str_end, 10);
-        if (errno == ERANGE) {
-            fprintf(stderr, "ERROR %zu AT WRONG VALUE\n", w);
+static void parseEvalBatchComm(char *str, ssize_t lineLen, CommandT *comm) {
+    char *str_end;
+    unsigned long long nvars;
+    if (lineLen < 14 || str[10] != ' ' || !isdigit(str[11]) ||
+        !strToULL(&str[11], &str_end, &nvars) || nvars == 0 ||
+        *str_end != ' ') {
+        setError(comm, "EVAL BATCH WRONG POINTS");
+        return;
+    }
+
+    size_t count = 0;
+    for (const char *c = str_end; *c != '\0'; ++c) {
+        if (*c == ' ') count++;
+    }
+    if (count % nvars != 0) {
+        setError(comm, "EVAL BATCH WRONG POINTS");
+        return;
+    }
+
+    size_t npoints = count / nvars;
+    poly_coeff_t *points = safeMalloc(count * sizeof(poly_coeff_t));
+    for (size_t k = 0; k < count; ++k) {
+        const char *num = &str_end[1];
+        char sep = k + 1 < count ? ' ' : '\0';
+        long long x;
+        if (!(isdigit(num[0]) || (num[0] == '-' && isdigit(num[1]))) ||
+            !strToLL(num, &str_end, &x) || *str_end != sep) {
+            safeFree(points);
+            setError(comm, "EVAL BATCH WRONG POINTS");
             return;
         }
-        At(stack, w, x);
-    } else {
-        fprintf(stderr, "ERROR %zu AT WRONG VALUE\n", w);
+        points[(k % nvars) * npoints + k / nvars] = x;
     }
+
+    comm->kind = COMM_EVAL_BATCH;
+    comm->eval.nvars = nvars;
+    comm->eval.npoints = npoints;
+    comm->eval.points = points;
 }
 
 /**
- * Sprawdza poprawność parametru przy wczytywaniu komendy DEG_BY
- * i jeśli parametr jest poprawny wykonuje komendę DEG_BY
+ * Sprawdza poprawność parametrów przy wczytywaniu komendy PERMUTE, której
+ * parametrami są kolejne wartości permutacji liczb @f$0, \ldots, n - 1@f$
  * @param[in] str : wczytywana linia
  * @param[in] lineLen : długość wczytywanej linii
- * @param[in] w : nr wczytywanej linii
- * @param[in] stack : stos
+ * @param[out] comm : odczytana komenda
  */
-static void
-parseDegByComm(char *str, ssize_t lineLen, size_t w, StackT *stack) {
-    if (lineLen >= 8 && containsOnlyNums(&str[7]) && str[6] == ' ' &&
-        str[7] != '-') {
-        char *str_end;
-        size_t idx = strtoul(&str[7], &str_end, 10);
-        if (errno == ERANGE) {
-            fprintf(stderr, "ERROR %zu DEG BY WRONG VARIABLE\n", w);
+static void parsePermuteComm(char *str, ssize_t lineLen, CommandT *comm) {
+    if (lineLen < 9 || str[7] != ' ') {
+        setError(comm, "PERMUTE WRONG PERMUTATION");
+        return;
+    }
+
+    size_t n = 0;
+    for (const char *c = &str[7]; *c != '\0'; ++c) {
+        if (*c == ' ') n++;
+    }
+
+    size_t *perm = safeMalloc(n * sizeof(size_t));
+    bool *seen = safeCalloc(n, sizeof(bool));
+    char *str_end = &str[7];
+    for (size_t i = 0; i < n; ++i) {
+        const char *num = &str_end[1];
+        char sep = i + 1 < n ? ' ' : '\0';
+        unsigned long long x;
+        if (!isdigit(num[0]) || !strToULL(num, &str_end, &x) ||
+            *str_end != sep || x >= n || seen[x]) {
+            safeFree(perm);
+            safeFree(seen);
+            setError(comm, "PERMUTE WRONG PERMUTATION");
             return;
         }
-        DegBy(stack, w, idx);
+        seen[x] = true;
+        perm[i] = x;
+    }
+    safeFree(seen);
+
+    comm->kind = COMM_PERMUTE;
+    comm->permute.n = n;
+    comm->permute.perm = perm;
+}
+
+/**
+ * Sprawdza, czy linia jest komendą z parametrami o podanej nazwie, czyli
+ * czy po nazwie jest spacja albo koniec linii. Inne słowa zaczynające się
+ * od tej nazwy (np. DUMPX) są błędną komendą, a nie tą komendą z błędnym
+ * parametrem.
+ * @param[in] command : wczytywana linia bez znaku końca linii
+ * @param[in] name : nazwa komendy
+ * @return : czy linia jest komendą @p name
+ */
+static bool isCommand(const char *command, const char *name) {
+    size_t len = strlen(name);
+    return strncmp(command, name, len) == 0 &&
+           (command[len] == '\0' || command[len] == ' ');
+}
+
+/**
+ * Sprawdza poprawność parametru przy wczytywaniu komend, których parametrem
+ * jest ścieżka do pliku. Ścieżka jest kopiowana, bo linia wejścia może
+ * zostać nadpisana, zanim komenda zostanie wykonana.
+ * @param[in] str : wczytywana linia
+ * @param[in] lineLen : długość wczytywanej linii
+ * @param[in] nameLen : długość nazwy komendy
+ * @param[in] kind : rodzaj komendy
+ * @param[in] error : komunikat o błędzie
+ * @param[out] comm : odczytana komenda
+ */
+static void parseFileComm(char *str, ssize_t lineLen, ssize_t nameLen,
+                          CommandKindT kind, const char *error,
+                          CommandT *comm) {
+    if (lineLen > nameLen + 1 && str[nameLen] == ' ' &&
+        str[nameLen + 1] != '\0') {
+        size_t pathLen = strlen(&str[nameLen + 1]);
+        comm->kind = kind;
+        comm->path = safeMalloc(pathLen + 1);
+        memcpy(comm->path, &str[nameLen + 1], pathLen + 1);
     } else {
-        fprintf(stderr, "ERROR %zu DEG BY WRONG VARIABLE\n", w);
+        setError(comm, error);
     }
 }
 
-void parseCommand(StackT *stack, size_t currLine, char *str, ssize_t lineLen) {
-    char *command = strtok(str, "\n");
-
-    if (strcmp(command, "ZERO") == 0) Zero(stack);
-    else if (strcmp(command, "IS_COEFF") == 0)
-        isCoeff(stack, currLine);
-    else if (strcmp(command, "IS_ZERO") == 0)
-        isZero(stack, currLine);
-    else if (strcmp(command, "CLONE") == 0)
-        Clone(stack, currLine);
-    else if (strcmp(command, "ADD") == 0)
-        Add(stack, currLine);
-    else if (strcmp(command, "MUL") == 0)
-        Mul(stack, currLine);
-    else if (strcmp(command, "SUB") == 0)
-        Sub(stack, currLine);
-    else if (strcmp(command, "NEG") == 0)
-        Neg(stack, currLine);
-    else if (strcmp(command, "POP") == 0)
-        PopInstr(stack, currLine);
-    else if (strcmp(command, "IS_EQ") == 0)
-        isEq(stack, currLine);
-    else if (strcmp(command, "DEG") == 0)
-        Deg(stack, currLine);
-    else if (strcmp(command, "PRINT") == 0)
-        PrintStack(stack, currLine);
-    else if (strncmp(command, "AT", 2) == 0)
-        parseAtComm(str, lineLen, currLine, stack);
+/** Komendy bez parametrów
+ */
+static const struct {
+    const char *name;   ///< nazwa komendy
+    CommandKindT kind;  ///< rodzaj komendy
+} simpleCommands[] = {
+        {"ZERO", COMM_ZERO},
+        {"IS_COEFF", COMM_IS_COEFF},
+        {"IS_ZERO", COMM_IS_ZERO},
+        {"CLONE", COMM_CLONE},
+        {"ADD", COMM_ADD},
+        {"MUL", COMM_MUL},
+        {"SUB", COMM_SUB},
+        {"NEG", COMM_NEG},
+        {"POP", COMM_POP},
+        {"IS_EQ", COMM_IS_EQ},
+        {"IS_EQ_FAST", COMM_IS_EQ_FAST},
+        {"DEG", COMM_DEG},
+        {"PRINT", COMM_PRINT},
+        {"STATS", COMM_STATS},
+        {"PERMUTE_AUTO", COMM_PERMUTE_AUTO},
+        {"DIV", COMM_DIV},
+};
+
+_Static_assert(COMMAND_KINDS <= STATS_MAX_COMMANDS,
+               "too many command kinds for statistics");
+
+const char *const CommandNames[COMMAND_KINDS] = {
+        [COMM_NONE] = "NONE", [COMM_END] = "END", [COMM_ERROR] = "ERROR",
+        [COMM_POLY] = "POLY", [COMM_ZERO] = "ZERO",
+        [COMM_IS_COEFF] = "IS_COEFF", [COMM_IS_ZERO] = "IS_ZERO",
+        [COMM_CLONE] = "CLONE", [COMM_ADD] = "ADD", [COMM_MUL] = "MUL",
+        [COMM_SUB] = "SUB", [COMM_NEG] = "NEG", [COMM_POP] = "POP",
+        [COMM_IS_EQ] = "IS_EQ", [COMM_IS_EQ_FAST] = "IS_EQ_FAST",
+        [COMM_DEG] = "DEG", [COMM_PRINT] = "PRINT",
+        [COMM_STATS] = "STATS", [COMM_AT] = "AT", [COMM_DEG_BY] = "DEG_BY",
+        [COMM_MUL_TRUNC] = "MUL_TRUNC", [COMM_EVAL_BATCH] = "EVAL_BATCH",
+        [COMM_COMPOSE] = "COMPOSE", [COMM_PERMUTE] = "PERMUTE",
+        [COMM_PERMUTE_AUTO] = "PERMUTE_AUTO", [COMM_DIV] = "DIV",
+        [COMM_DUMP] = "DUMP", [COMM_LOAD] = "LOAD",
+        [COMM_SAVE_STACK] = "SAVE_STACK", [COMM_LOAD_STACK] = "LOAD_STACK",
+};
+
+const char *CommandName(CommandKindT kind) {
+    return CommandNames[kind];
+}
+
+/**
+ * Odczytuje komendę zapisaną w linii
+ * @param[in] str : wczytywana linia
+ * @param[in] lineLen : długość wczytywanej linii
+ * @param[out] comm : odczytana komenda
+ */
+static void decodeCommand(char *str, ssize_t lineLen, CommandT *comm) {
+    char *savePtr;
+    char *command = strtok_r(str, "\n", &savePtr);
+
+    for (size_t i = 0; i < sizeof(simpleCommands) / sizeof(simpleCommands[0]);
+         ++i) {
+        if (strcmp(command, simpleCommands[i].name) == 0) {
+            comm->kind = simpleCommands[i].kind;
+            return;
+        }
+    }
+
+    if (strncmp(command, "AT", 2) == 0)
+        parseAtComm(str, lineLen, comm);
     else if (strncmp(command, "DEG_BY", 6) == 0)
-        parseDegByComm(str, lineLen, currLine, stack);
+        parseDegByComm(str, lineLen, comm);
+    else if (isCommand(command, "MUL_TRUNC"))
+        parseMulTruncComm(str, lineLen, comm);
+    else if (isCommand(command, "EVAL_BATCH"))
+        parseEvalBatchComm(str, lineLen, comm);
+    else if (isCommand(command, "COMPOSE"))
+        parseComposeComm(str, lineLen, comm);
+    else if (isCommand(command, "PERMUTE"))
+        parsePermuteComm(str, lineLen, comm);
+    else if (isCommand(command, "DUMP"))
+        parseFileComm(str, lineLen, 4, COMM_DUMP, "DUMP WRONG FILE", comm);
+    else if (isCommand(command, "LOAD_STACK"))
+        parseFileComm(str, lineLen, 10, COMM_LOAD_STACK,
+                      "LOAD STACK WRONG FILE", comm);
+    else if (isCommand(command, "LOAD"))
+        parseFileComm(str, lineLen, 4, COMM_LOAD, "LOAD WRONG FILE", comm);
+    else if (isCommand(command, "SAVE_STACK"))
+        parseFileComm(str, lineLen, 10, COMM_SAVE_STACK,
+                      "SAVE STACK WRONG FILE", comm);
     else
-        fprintf(stderr, "ERROR %ld WRONG COMMAND\n", currLine);
+        setError(comm, "WRONG COMMAND");
+}
 
+void parseCommand(StackT *stack, size_t currLine, char *str, ssize_t lineLen) {
+    CommandT comm = {.line = currLine};
+    decodeCommand(str, lineLen, &comm);
+    executeCommand(stack, &comm);
 }
 
 /**
@@ -171,12 +461,14 @@ static bool corrPolyInput(char *buffer, ssize_t lineLen) {
     for (ssize_t i = 0; i < lineLen; ++i) {
         c = buffer[i];
         char *endPtr;
+        long long num;
 
         if (c == ',') {
             if (i == lineLen - 1) return false;
             if (!isdigit(buffer[i + 1])) return false;
-            unsigned long idx = strtoul(&buffer[i + 1], &endPtr, 10);
-            if (errno == ERANGE || idx > INT_MAX) return false;
+            unsigned long long idx;
+            if (!strToULL(&buffer[i + 1], &endPtr, &idx) || idx > INT_MAX)
+                return false;
         }
         if (c == '+') {
             if (i == lineLen - 1 || i == 0) return false;
@@ -185,8 +477,7 @@ static bool corrPolyInput(char *buffer, ssize_t lineLen) {
         if (c == '-') {
             if (i == lineLen - 1) return false;
             if (buffer[i + 1] < ASCII_0 || buffer[i + 1] > ASCII_9) return false;
-            strtoll(&buffer[i], &endPtr, 10);
-            if (errno == ERANGE) return false;
+            if (!strToLL(&buffer[i], &endPtr, &num)) return false;
         }
         if (c == ')') {
             if (i <= lineLen - 3 && buffer[i + 1] == ',' &&
@@ -200,10 +491,9 @@ static bool corrPolyInput(char *buffer, ssize_t lineLen) {
             if (buffer[i + 1] == '+' || buffer[i + 1] == ',' ||
                 buffer[i + 1] == ')')
                 return false;
-            if (buffer[i + 1] != '(' && buffer[i + 1] != '-') {
-                strtoll(&buffer[i + 1], &endPtr, 10);
-                if (errno == ERANGE) return false;
-            }
+            if (buffer[i + 1] != '(' && buffer[i + 1] != '-' &&
+                !strToLL(&buffer[i + 1], &endPtr, &num))
+                return false;
         }
     }
     return true;
@@ -226,10 +516,13 @@ static Poly convertStrToPoly(char *str, ssize_t strSize, ssize_t *strIndex) {
 
         if (str[i] == '(' && str[i + 1] == '(') {
 
+            if (monosSize == nextFreeInd) ExpandMonoArr(&monosSize, &monos);
+
             *strIndex = i + 1;
             Poly p = convertStrToPoly(str, strSize, strIndex);
-            poly_exp_t exp = (poly_exp_t) strtol(&str[*strIndex], &endPtr, 10);
-            Mono m = {.p = p, .exp = exp};
+            long long exp;
+            strToLL(&str[*strIndex], &endPtr, &exp);
+            Mono m = {.p = p, .exp = (poly_exp_t) exp};
             monos[nextFreeInd++] = m;
             i = *strIndex;
 
@@ -237,13 +530,14 @@ static Poly convertStrToPoly(char *str, ssize_t strSize, ssize_t *strIndex) {
 
             if (monosSize == nextFreeInd) ExpandMonoArr(&monosSize, &monos);
 
-            poly_coeff_t coeff = strtol(&str[i + 1], &endPtr, 10);
-            poly_exp_t exp = (poly_exp_t) strtol((endPtr + 1), &endPtr, 10);
+            long long coeff, exp;
+            strToLL(&str[i + 1], &endPtr, &coeff);
+            strToLL(endPtr + 1, &endPtr, &exp);
             i += (int) (endPtr - &(str[i])) - 1;
 
-            Poly p = PolyFromCoeff(coeff);
+            Poly p = PolyFromCoeff((poly_coeff_t) coeff);
             if (coeff != 0) {
-                Mono m = MonoFromPoly(&p, exp);
+                Mono m = MonoFromPoly(&p, (poly_exp_t) exp);
                 monos[nextFreeInd++] = m;
             }
         } else if ((str[i] == ')' && i == strSize - 1)
@@ -253,36 +547,253 @@ static Poly convertStrToPoly(char *str, ssize_t strSize, ssize_t *strIndex) {
             monosSize = nextFreeInd;
             *strIndex = i + 2;
             res = PolyAddMonos(monosSize, monos);
-            free(monos);
+            safeFree(monos);
             return res;
         }
     }
     return res;
 }
 
-void parsePoly(StackT *stack, size_t currLine, char *buffer, ssize_t lineLen) {
+/**
+ * Odczytuje wielomian zapisany w linii
+ * @param[in] buffer : wczytywana linia
+ * @param[in] lineLen : długość wczytywanej linii
+ * @param[out] comm : odczytana komenda
+ */
+static void decodePoly(char *buffer, ssize_t lineLen, CommandT *comm) {
 
     // Sprawdzam czy wielomian jest poprawny
     if (!containsPolyChars(buffer, lineLen) ||
         !corrPolyInput(buffer, lineLen)) {
-        fprintf(stderr, "ERROR %zu WRONG POLY\n", currLine);
+        setError(comm, "WRONG POLY");
         return;
     }
 
     // Jeśli wielomian jest stałą
     if (buffer[0] != '(') {
         char *endPtr;
-        long long coeff = strtoll(&buffer[0], &endPtr, 10);
-        if (errno == ERANGE) {
-            fprintf(stderr, "ERROR %zu WRONG POLY\n", currLine);
+        long long coeff;
+        if (!strToLL(&buffer[0], &endPtr, &coeff)) {
+            setError(comm, "WRONG POLY");
+            return;
         }
-        Push(stack, PolyFromCoeff(coeff));
+        STAT_INC(STAT_PARSED_POLYS);
+        comm->kind = COMM_POLY;
+        comm->p = PolyFromCoeff(coeff);
         return;
     }
     // Jeśli jest jednomianem lub sumą jednomianów
     ssize_t strInd = 0;
     if (buffer[lineLen - 1] == '\n') {
-        Poly p = convertStrToPoly(buffer, lineLen - 1, &strInd);
-        Push(stack, p);
+        STAT_INC(STAT_PARSED_POLYS);
+        comm->kind = COMM_POLY;
+        comm->p = convertStrToPoly(buffer, lineLen - 1, &strInd);
     }
-}
\ No newline at end of file
+}
+
+void parsePoly(StackT *stack, size_t currLine, char *buffer, ssize_t lineLen) {
+    CommandT comm = {.line = currLine};
+    decodePoly(buffer, lineLen, &comm);
+    executeCommand(stack, &comm);
+}
+
+void parseLine(char *buffer, ssize_t lineLen, size_t currLine,
+               CommandT *comm) {
+    *comm = (CommandT) {.kind = COMM_NONE, .line = currLine};
+
+    char c = buffer[0];
+    if (c == COMMENT_CHAR || c == NEW_LINE_CHAR) return;
+
+    STAT_INC(STAT_LINES);
+    STAT_TIME_START(start);
+    char *nullChar = memchr(buffer, '\0', lineLen);
+    if (nullChar != NULL) *nullChar = INVALID_CHAR;
+
+    // Jeśli zabraknie pamięci, częściowo sparsowany wielomian jest już
+    // zwolniony, a błąd zostanie wypisany przy wykonaniu komendy
+    MemTxnT txn;
+    MemTxnBegin(&txn);
+    if (setjmp(txn.env) == 0) {
+        TRACE_BEGIN(TRACE_PARSE, mark);
+        if (isalpha(buffer[0]))
+            decodeCommand(buffer, lineLen, comm);
+        else
+            decodePoly(buffer, lineLen, comm);
+        TRACE_END(TRACE_PARSE, mark);
+        MemTxnEnd(&txn);
+    } else {
+        TraceAbort();
+        setError(comm, "OUT OF MEMORY");
+    }
+    STAT_TIME_END(STAT_PARSE_NS, start);
+}
+
+/**
+ * Zwraca liczbę argumentów komendy zdejmowanych lub czytanych ze stosu
+ * @param[in] kind : rodzaj komendy
+ * @return : liczba argumentów
+ */
+static int commandArity(CommandKindT kind) {
+    switch (kind) {
+        case COMM_ADD: case COMM_MUL: case COMM_SUB: case COMM_IS_EQ:
+        case COMM_IS_EQ_FAST: case COMM_MUL_TRUNC: case COMM_DIV:
+            return 2;
+        case COMM_IS_COEFF: case COMM_IS_ZERO: case COMM_CLONE: case COMM_NEG:
+        case COMM_POP: case COMM_DEG: case COMM_PRINT: case COMM_AT:
+        case COMM_DEG_BY: case COMM_EVAL_BATCH: case COMM_COMPOSE:
+        case COMM_PERMUTE: case COMM_PERMUTE_AUTO: case COMM_DUMP:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Zwraca liczbę wielomianów z wierzchołka stosu, których komenda używa
+ * i które trzeba przed jej wykonaniem odczytać z pliku. POP nie odczytuje
+ * zdejmowanego wielomianu, a COMPOSE używa @p k wielomianów pod wierzchołkiem.
+ * @param[in] comm : komenda
+ * @return : liczba wielomianów
+ */
+static stackSizeT commandReads(const CommandT *comm) {
+    if (comm->kind == COMM_POP) return 0;
+    if (comm->kind == COMM_COMPOSE) return comm->k + 1;
+    return (stackSizeT) commandArity(comm->kind);
+}
+
+/**
+ * Opisuje argumenty komendy w zdarzeniu śledzenia
+ * @param[in] stack : stos
+ * @param[in] comm : komenda
+ * @param[out] trace : parametry komendy w zdarzeniu
+ */
+static void traceArgs(StackT *stack, CommandT *comm, TraceCommandT *trace) {
+    *trace = (TraceCommandT) {.name = CommandName(comm->kind),
+                              .line = comm->line, .argTerms = {-1, -1},
+                              .argDepth = {-1, -1}, .resultTerms = -1};
+
+    int arity = commandArity(comm->kind);
+    for (int i = 0; i < arity; ++i) {
+        const Poly *p = StackPeek(stack, i);
+        if (p != NULL) {
+            trace->argTerms[i] = TraceTerms(p);
+            trace->argDepth[i] = (long) PolyDepth(p);
+        }
+    }
+}
+
+/**
+ * Wykonuje komendę na stosie
+ * @param[in] stack : stos
+ * @param[in] comm : komenda
+ */
+static void dispatchCommand(StackT *stack, CommandT *comm) {
+    size_t w = comm->line;
+
+    if (comm->kind >= COMM_DUMP && stack->noFiles) {
+        PrintError(stack, w, "FILE ACCESS DENIED");
+        return;
+    }
+
+    switch (comm->kind) {
+        case COMM_NONE: case COMM_END: break;
+        case COMM_ERROR: PrintError(stack, w, comm->error); break;
+        case COMM_POLY: Push(stack, comm->p); break;
+        case COMM_ZERO: Zero(stack); break;
+        case COMM_IS_COEFF: isCoeff(stack, w); break;
+        case COMM_IS_ZERO: isZero(stack, w); break;
+        case COMM_CLONE: Clone(stack, w); break;
+        case COMM_ADD: Add(stack, w); break;
+        case COMM_MUL: Mul(stack, w); break;
+        case COMM_SUB: Sub(stack, w); break;
+        case COMM_NEG: Neg(stack, w); break;
+        case COMM_POP: PopInstr(stack, w); break;
+        case COMM_IS_EQ: isEq(stack, w); break;
+        case COMM_IS_EQ_FAST: isEqFast(stack, w); break;
+        case COMM_DEG: Deg(stack, w); break;
+        case COMM_PRINT: PrintStack(stack, w); break;
+        case COMM_STATS: Stats(stack); break;
+        case COMM_AT: At(stack, w, comm->x); break;
+        case COMM_DEG_BY: DegBy(stack, w, comm->idx); break;
+        case COMM_MUL_TRUNC:
+            MulTrunc(stack, w, comm->trunc.deg, comm->trunc.byVar,
+                     comm->trunc.idx);
+            break;
+        case COMM_EVAL_BATCH:
+            EvalBatch(stack, w, comm->eval.nvars, comm->eval.points,
+                      comm->eval.npoints);
+            break;
+        case COMM_COMPOSE: Compose(stack, w, comm->k); break;
+        case COMM_PERMUTE:
+            Permute(stack, w, comm->permute.n, comm->permute.perm);
+            break;
+        case COMM_PERMUTE_AUTO: PermuteAuto(stack, w); break;
+        case COMM_DIV: Div(stack, w); break;
+        case COMM_DUMP: Dump(stack, w, comm->path); break;
+        case COMM_LOAD: Load(stack, w, comm->path); break;
+        case COMM_SAVE_STACK: SaveStack(stack, w, comm->path); break;
+        case COMM_LOAD_STACK: LoadStack(stack, w, comm->path); break;
+    }
+}
+
+/**
+ * Wykonuje komendę w transakcji pamięci. Komenda, której zabrakło pamięci,
+ * jest wycofywana: jej pamięć jest zwalniana, a stos pozostaje bez zmian.
+ * Wielomiany wczytane z zapisanego stosu są przed wykonaniem komendy
+ * odczytywane z pliku; jeśli zapis któregoś jest uszkodzony, komenda nie
+ * jest wykonywana. Gdy na stosie brakuje wielomianów, komenda sama zgłasza
+ * STACK UNDERFLOW.
+ * @param[in] stack : stos
+ * @param[in] comm : komenda
+ */
+static void runCommand(StackT *stack, CommandT *comm) {
+    MemTxnT txn;
+    MemTxnBegin(&txn);
+    if (setjmp(txn.env) == 0) {
+        if (!StackMaterialize(stack, commandReads(comm)))
+            PrintError(stack, comm->line, "WRONG STACK POLY");
+        else
+            dispatchCommand(stack, comm);
+        MemTxnEnd(&txn);
+    } else {
+        TraceAbort();
+        if (comm->kind == COMM_POLY) PolyDestroy(&comm->p);
+        PrintError(stack, comm->line, "OUT OF MEMORY");
+    }
+}
+
+void executeCommand(StackT *stack, CommandT *comm) {
+    STAT_TIME_START(start);
+
+    TraceCommandT trace;
+    uint64_t traceStart = 0;
+    if (TraceOn() && comm->kind != COMM_END) {
+        traceArgs(stack, comm, &trace);
+        traceStart = TraceNow();
+    }
+
+    runCommand(stack, comm);
+    if (comm->kind == COMM_EVAL_BATCH) safeFree(comm->eval.points);
+    if (comm->kind == COMM_PERMUTE) safeFree(comm->permute.perm);
+    if (comm->kind >= COMM_DUMP) safeFree(comm->path);
+    STAT_COMMAND(comm->kind, start);
+
+    if (traceStart != 0) {
+        const Poly *top = StackPeek(stack, 0);
+        if (top != NULL) trace.resultTerms = TraceTerms(top);
+        TraceCommand(&trace, traceStart);
+    }
+}
+
+void parseInput(StackT *stack, InputT *input) {
+    size_t currLine = 1;
+    ssize_t lineLen;
+    char *buffer;
+    CommandT comm;
+
+    while ((lineLen = InputGetLine(input, &buffer)) != -1) {
+        parseLine(buffer, lineLen, currLine, &comm);
+        if (comm.kind != COMM_NONE) executeCommand(stack, &comm);
+        currLine++;
+    }
+}
@@ -7,9 +7,116 @@
 #define POLYNOMIALS_POLY_PARSER_H
 
 #include "stack_operations.h"
+#include "input.h"
 #include <stdio.h>
 #include <stdlib.h>
 
+/**
+ * Rodzaj komendy odczytanej z linii wejścia
+ */
+typedef enum CommandKindT {
+    COMM_NONE,          ///< linia pusta lub komentarz
+    COMM_END,           ///< koniec wejścia
+    COMM_ERROR,         ///< niepoprawna linia
+    COMM_POLY,          ///< wielomian do włożenia na stos
+    COMM_ZERO,          ///< ZERO
+    COMM_IS_COEFF,      ///< IS_COEFF
+    COMM_IS_ZERO,       ///< IS_ZERO
+    COMM_CLONE,         ///< CLONE
+    COMM_ADD,           ///< ADD
+    COMM_MUL,           ///< MUL
+    COMM_SUB,           ///< SUB
+    COMM_NEG,           ///< NEG
+    COMM_POP,           ///< POP
+    COMM_IS_EQ,         ///< IS_EQ
+    COMM_IS_EQ_FAST,    ///< IS_EQ_FAST
+    COMM_DEG,           ///< DEG
+    COMM_PRINT,         ///< PRINT
+    COMM_STATS,         ///< STATS
+    COMM_AT,            ///< AT x
+    COMM_DEG_BY,        ///< DEG_BY idx
+    COMM_MUL_TRUNC,     ///< MUL_TRUNC deg [idx]
+    COMM_EVAL_BATCH,    ///< EVAL_BATCH nvars x...
+    COMM_COMPOSE,       ///< COMPOSE k
+    COMM_PERMUTE,       ///< PERMUTE i...
+    COMM_PERMUTE_AUTO,  ///< PERMUTE_AUTO
+    COMM_DIV,           ///< DIV
+    COMM_DUMP,          ///< DUMP path (komendy z plikiem muszą być ostatnie)
+    COMM_LOAD,          ///< LOAD path
+    COMM_SAVE_STACK,    ///< SAVE_STACK path
+    COMM_LOAD_STACK,    ///< LOAD_STACK path
+} CommandKindT;
+
+/** Liczba rodzajów komend
+ */
+#define COMMAND_KINDS (COMM_LOAD_STACK + 1)
+
+/**
+ * Sparsowana linia wejścia gotowa do wykonania na stosie. Parsowanie nie
+ * zależy od stanu stosu, więc może odbywać się na innym wątku niż
+ * wykonywanie komend.
+ */
+typedef struct CommandT {
+    CommandKindT kind;              ///< rodzaj komendy
+    size_t line;                    ///< nr linii wejścia
+    union {
+        Poly p;                     ///< wielomian dla #COMM_POLY
+        long long x;                ///< parametr komendy AT
+        unsigned long long idx;     ///< parametr komendy DEG_BY
+        unsigned long long k;       ///< parametr komendy COMPOSE
+        struct {
+            poly_exp_t deg;         ///< ograniczenie stopnia
+            bool byVar;             ///< czy podano indeks zmiennej
+            unsigned long long idx; ///< indeks zmiennej
+        } trunc;                    ///< parametry komendy MUL_TRUNC
+        struct {
+            size_t nvars;           ///< liczba zmiennych w punkcie
+            size_t npoints;         ///< liczba punktów
+            poly_coeff_t *points;   ///< wartości zmiennych, kolumnami
+        } eval;                     ///< parametry komendy EVAL_BATCH
+        struct {
+            size_t n;               ///< liczba przestawianych zmiennych
+            size_t *perm;           ///< permutacja zmiennych
+        } permute;                  ///< parametry komendy PERMUTE
+        char *path;                 ///< ścieżka do pliku (kopia)
+        const char *error;          ///< komunikat o błędzie dla #COMM_ERROR
+    };
+} CommandT;
+
+/** Nazwy rodzajów komend
+ */
+extern const char *const CommandNames[COMMAND_KINDS];
+
+/**
+ * Zwraca nazwę rodzaju komendy
+ * @param[in] kind : rodzaj komendy
+ * @return : nazwa komendy
+ */
+extern const char *CommandName(CommandKindT kind);
+
+/**
+ * Parsuje linię wejścia do komendy. Linia może zostać zmodyfikowana. Jeśli
+ * zostanie przekroczony limit pamięci, zwraca komendę z błędem
+ * "OUT OF MEMORY".
+ * @param[in] buffer : wczytywana linia
+ * @param[in] lineLen : długość wczytywanej linii
+ * @param[in] currLine : nr wczytywanej linii
+ * @param[out] comm : sparsowana komenda
+ */
+extern void parseLine(char *buffer, ssize_t lineLen, size_t currLine,
+                      CommandT *comm);
+
+/**
+ * Wykonuje sparsowaną komendę na stosie. Stos przejmuje wielomian komendy,
+ * a ścieżka do pliku, punkty komendy EVAL_BATCH i permutacja komendy
+ * PERMUTE są zwalniane. Jeśli komenda przekroczy limit pamięci
+ * (zob. MemTxnT), jest wycofywana, stos pozostaje bez zmian i wypisywany
+ * jest błąd "OUT OF MEMORY".
+ * @param[in] stack : stos
+ * @param[in] comm : komenda
+ */
+extern void executeCommand(StackT *stack, CommandT *comm);
+
 /**
  * Sprawdza poprawność wczytywanej komendy, jeśli komenda jest poprawna
  * wykonuje ją
@@ -30,4 +137,22 @@ extern void parseCommand(StackT *stack, size_t currLine, char *buffer, ssize_t l
  */
 extern void parsePoly(StackT *stack, size_t currLine, char *buffer, ssize_t lineLen);
 
+/**
+ * Odpowiednik funkcji strtoull dla liczb bez znaku, który zamiast ustawiać
+ * errno zwraca informację o przekroczeniu zakresu
+ * @param[in] str : tablica charów zaczynająca się od cyfry
+ * @param[out] endPtr : wskaźnik za ostatnią cyfrą liczby
+ * @param[out] res : wczytana liczba
+ * @return : czy liczba mieści się w zakresie unsigned long long
+ */
+extern bool strToULL(const char *str, char **endPtr, unsigned long long *res);
+
+/**
+ * Wczytuje kolejne linie wejścia i wykonuje zapisane w nich komendy
+ * na stosie. Linie puste i zaczynające się od znaku '#' są pomijane.
+ * @param[in] stack : stos
+ * @param[in] input : źródło wejścia
+ */
+extern void parseInput(StackT *stack, InputT *input);
+
 #endif //POLYNOMIALS_POLY_PARSER_H
\ No newline at end of file
@@ -0,0 +1,295 @@
+/** @file
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include "poly_permute.h"
+#include "input.h"
+#include "stats.h"
+
+/**
+ * Wielomian spłaszczony do listy jednomianów o stałych współczynnikach
+ */
+typedef struct TermsT {
+    size_t count;           ///< liczba jednomianów
+    size_t width;           ///< liczba zmiennych
+    poly_exp_t *exps;       ///< wykładniki jednomianów, wierszami po @p width
+    poly_coeff_t *coeffs;   ///< współczynniki jednomianów
+} TermsT;
+
+/**
+ * Klucz jednomianu przy wyborze zmiennej kolejnego poziomu
+ */
+typedef struct KeyT {
+    size_t group;   ///< numer grupy jednomianów o równych wykładnikach
+                    ///< zmiennych wyższych poziomów
+    poly_exp_t exp; ///< wykładnik rozważanej zmiennej
+    size_t term;    ///< numer jednomianu
+} KeyT;
+
+/**
+ * Liczy jednomiany o stałych współczynnikach w rozwinięciu wielomianu
+ * @param[in] p : wielomian
+ * @return : liczba liści drzewa
+ */
+static size_t countTerms(const Poly *p) {
+    if (PolyIsCoeff(p)) return 1;
+
+    size_t res = 0;
+    for (size_t i = 0; i < p->size; ++i) res += countTerms(&p->arr[i].p);
+    return res;
+}
+
+/**
+ * Wypisuje jednomiany wielomianu do listy, zapisując wykładnik zmiennej
+ * poziomu @f$l@f$ w kolumnie @p col[l]
+ * @param[in] p : wielomian
+ * @param[in] level : poziom wielomianu
+ * @param[in] col : kolumny kolejnych poziomów
+ * @param[in,out] row : wykładniki zmiennych wyższych poziomów
+ * @param[in,out] t : lista jednomianów
+ */
+static void flatten(const Poly *p, size_t level, const size_t col[],
+                    poly_exp_t row[], TermsT *t) {
+    if (PolyIsCoeff(p)) {
+        memcpy(&t->exps[t->count * t->width], row,
+               t->width * sizeof(poly_exp_t));
+        t->coeffs[t->count++] = p->coeff;
+        return;
+    }
+
+    for (size_t i = 0; i < p->size; ++i) {
+        row[col[level]] = p->arr[i].exp;
+        flatten(&p->arr[i].p, level + 1, col, row, t);
+    }
+    row[col[level]] = 0;
+}
+
+/**
+ * Spłaszcza wielomian, który nie jest stałą, do listy jednomianów
+ * @param[in] p : wielomian
+ * @param[in] width : liczba zmiennych, co najmniej PolyDepth(p)
+ * @param[in] col : kolumny zmiennych kolejnych poziomów
+ * @return : lista jednomianów
+ */
+static TermsT termsOf(const Poly *p, size_t width, const size_t col[]) {
+    size_t count = countTerms(p);
+    TermsT t = {.width = width};
+    t.exps = safeMalloc(count * width * sizeof(poly_exp_t));
+    t.coeffs = safeMalloc(count * sizeof(poly_coeff_t));
+    poly_exp_t *row = safeCalloc(width, sizeof(poly_exp_t));
+    flatten(p, 0, col, row, &t);
+    safeFree(row);
+    return t;
+}
+
+/**
+ * Zwalnia listę jednomianów
+ * @param[in] t : lista jednomianów
+ */
+static void termsDestroy(TermsT *t) {
+    safeFree(t->exps);
+    safeFree(t->coeffs);
+}
+
+/**
+ * Porównuje leksykograficznie wykładniki dwóch jednomianów na potrzeby
+ * qsort_r
+ * @param[in] a : wskaźnik na numer pierwszego jednomianu
+ * @param[in] b : wskaźnik na numer drugiego jednomianu
+ * @param[in] arg : lista jednomianów
+ * @return : wynik porównania
+ */
+static int cmpTerms(const void *a, const void *b, void *arg) {
+    const TermsT *t = arg;
+    const poly_exp_t *x = &t->exps[*(const size_t *) a * t->width];
+    const poly_exp_t *y = &t->exps[*(const size_t *) b * t->width];
+    for (size_t i = 0; i < t->width; ++i) {
+        if (x[i] != y[i]) return x[i] < y[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * Buduje wielomian z jednomianów posortowanych leksykograficznie. Zmienna
+ * ma na danym poziomie węzeł tylko wtedy, gdy któryś z jednomianów ma
+ * niezerowy wykładnik tej zmiennej lub dalszych zmiennych.
+ * @param[in] t : lista jednomianów
+ * @param[in] order : numery jednomianów w porządku leksykograficznym
+ * @param[in] lo : początek przedziału w @p order
+ * @param[in] hi : koniec przedziału w @p order (bez niego)
+ * @param[in] level : poziom budowanego wielomianu
+ * @return : wielomian będący sumą jednomianów przedziału
+ */
+static Poly build(const TermsT *t, const size_t order[], size_t lo, size_t hi,
+                  size_t level) {
+    const poly_exp_t *first = &t->exps[order[lo] * t->width];
+    if (hi - lo == 1) {
+        size_t i = level;
+        while (i < t->width && first[i] == 0) i++;
+        if (i == t->width) return PolyFromCoeff(t->coeffs[order[lo]]);
+    }
+
+    size_t groups = 1;
+    for (size_t i = lo + 1; i < hi; ++i) {
+        if (t->exps[order[i] * t->width + level] !=
+            t->exps[order[i - 1] * t->width + level])
+            groups++;
+    }
+
+    Poly res = {.size = groups, .arr = MonoArrAlloc(groups)};
+    size_t start = lo, g = 0;
+    for (size_t i = lo + 1; i <= hi; ++i) {
+        poly_exp_t exp = t->exps[order[start] * t->width + level];
+        if (i < hi && t->exps[order[i] * t->width + level] == exp) continue;
+
+        res.arr[g++] = (Mono) {.p = build(t, order, start, i, level + 1),
+                               .exp = exp};
+        start = i;
+    }
+    return res;
+}
+
+Poly PolyPermute(const Poly *p, size_t n, const size_t perm[]) {
+    STAT_INC(STAT_POLY_PERMUTE);
+    if (PolyIsCoeff(p)) return PolyFromCoeff(p->coeff);
+
+    size_t depth = PolyDepth(p);
+    size_t width = depth > n ? depth : n;
+    size_t *col = safeMalloc(width * sizeof(size_t));
+    for (size_t i = 0; i < width; ++i) col[i] = i < n ? perm[i] : i;
+    TermsT t = termsOf(p, width, col);
+    safeFree(col);
+
+    size_t *order = safeMalloc(t.count * sizeof(size_t));
+    for (size_t i = 0; i < t.count; ++i) order[i] = i;
+    qsort_r(order, t.count, sizeof(size_t), cmpTerms, &t);
+    Poly res = build(&t, order, 0, t.count, 0);
+
+    safeFree(order);
+    termsDestroy(&t);
+    return res;
+}
+
+/**
+ * Porównuje klucze jednomianów na potrzeby qsort
+ * @param[in] a : wskaźnik na pierwszy klucz
+ * @param[in] b : wskaźnik na drugi klucz
+ * @return : wynik porównania
+ */
+static int cmpKeys(const void *a, const void *b) {
+    const KeyT *x = a, *y = b;
+    if (x->group != y->group) return x->group < y->group ? -1 : 1;
+    if (x->exp != y->exp) return x->exp < y->exp ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Liczy jednomiany poziomu, na którym zmienną główną jest @p var. Jednomiany
+ * o tych samych wykładnikach zmiennych wyższych poziomów tworzą grupę, która
+ * ma na tym poziomie węzeł, jeśli jest żywa. Węzeł ma tyle jednomianów, ile
+ * różnych wykładników @p var występuje w grupie.
+ * @param[in] t : lista jednomianów
+ * @param[in] group : grupy kolejnych jednomianów
+ * @param[in] alive : czy grupa ma niezerowy wykładnik zmiennej tego lub
+ * dalszych poziomów
+ * @param[in] var : zmienna poziomu
+ * @param[out] keys : klucze jednomianów posortowane według grupy i wykładnika
+ * @return : liczba jednomianów poziomu
+ */
+static size_t levelMonos(const TermsT *t, const size_t group[],
+                         const bool alive[], size_t var, KeyT keys[]) {
+    for (size_t i = 0; i < t->count; ++i) {
+        keys[i] = (KeyT) {.group = group[i],
+                          .exp = t->exps[i * t->width + var], .term = i};
+    }
+    qsort(keys, t->count, sizeof(KeyT), cmpKeys);
+
+    size_t res = 0;
+    for (size_t i = 0; i < t->count; ++i) {
+        if (alive[keys[i].group] && (i == 0 || cmpKeys(&keys[i - 1],
+                                                       &keys[i]) != 0))
+            res++;
+    }
+    return res;
+}
+
+/**
+ * Liczy jednomiany drzewa dla kolejności zmiennych, wybierając ją zachłannie
+ * albo używając podanej
+ * @param[in] t : lista jednomianów
+ * @param[in] greedy : czy wybierać zmienne zachłannie
+ * @param[in,out] order : zmienne kolejnych poziomów
+ * @return : liczba jednomianów drzewa
+ */
+static size_t orderMonos(const TermsT *t, bool greedy, size_t order[]) {
+    size_t *group = safeCalloc(t->count, sizeof(size_t));
+    bool *alive = safeMalloc(t->count * sizeof(bool));
+    bool *chosen = safeCalloc(t->width, sizeof(bool));
+    KeyT *keys = safeMalloc(t->count * sizeof(KeyT));
+
+    size_t res = 0;
+    for (size_t level = 0; level < t->width; ++level) {
+        memset(alive, 0, t->count * sizeof(bool));
+        for (size_t i = 0; i < t->count; ++i) {
+            for (size_t v = 0; v < t->width && !alive[group[i]]; ++v) {
+                if (!chosen[v] && t->exps[i * t->width + v] != 0)
+                    alive[group[i]] = true;
+            }
+        }
+
+        if (greedy) {
+            size_t best = SIZE_MAX;
+            for (size_t v = 0; v < t->width; ++v) {
+                if (chosen[v]) continue;
+                size_t monos = levelMonos(t, group, alive, v, keys);
+                if (monos < best) {
+                    best = monos;
+                    order[level] = v;
+                }
+            }
+        }
+
+        size_t var = order[level];
+        res += levelMonos(t, group, alive, var, keys);
+        chosen[var] = true;
+        size_t g = 0;
+        for (size_t i = 0; i < t->count; ++i) {
+            if (i > 0 && cmpKeys(&keys[i - 1], &keys[i]) != 0) g++;
+            group[keys[i].term] = g;
+        }
+    }
+
+    safeFree(group);
+    safeFree(alive);
+    safeFree(chosen);
+    safeFree(keys);
+    return res;
+}
+
+size_t PolyBestOrder(const Poly *p, size_t perm[]) {
+    size_t width = PolyDepth(p);
+    if (width == 0) return 0;
+
+    size_t *order = safeMalloc(width * sizeof(size_t));
+    for (size_t i = 0; i < width; ++i) order[i] = i;
+    TermsT t = termsOf(p, width, order);
+
+    size_t *greedy = safeMalloc(width * sizeof(size_t));
+    size_t res = orderMonos(&t, false, order);
+    size_t greedyMonos = orderMonos(&t, true, greedy);
+    if (greedyMonos < res) {
+        res = greedyMonos;
+        memcpy(order, greedy, width * sizeof(size_t));
+    }
+    for (size_t level = 0; level < width; ++level) perm[order[level]] = level;
+
+    safeFree(greedy);
+    safeFree(order);
+    termsDestroy(&t);
+    return res;
+}
@@ -0,0 +1,47 @@
+/** @file
+ * Zmiana kolejności zmiennych wielomianu
+ *
+ * Liczba jednomianów w drzewie wielomianu, a z nią koszt operacji na nim,
+ * zależy od tego, która zmienna jest zmienną główną na kolejnych poziomach.
+ * Przy zmianie kolejności wielomian jest spłaszczany do listy jednomianów
+ * o stałych współczynnikach, wykładniki w każdym jednomianie są
+ * przestawiane, a drzewo jest budowane od nowa z posortowanej listy.
+ *
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#ifndef POLYNOMIALS_POLY_PERMUTE_H
+#define POLYNOMIALS_POLY_PERMUTE_H
+
+#include "poly.h"
+
+// Eksportowane z biblioteki dzielonej (zob. poly.h)
+#pragma GCC visibility push(default)
+
+/**
+ * Przestawia zmienne wielomianu: zmienna @f$x_i@f$ staje się zmienną
+ * @f$x_{perm[i]}@f$ dla @f$i < n@f$, a pozostałe zmienne się nie zmieniają.
+ * Kolejność można przywrócić permutacją odwrotną.
+ * @param[in] p : wielomian
+ * @param[in] n : liczba przestawianych zmiennych
+ * @param[in] perm : permutacja liczb @f$0, 1, \ldots, n - 1@f$
+ * @return : wielomian po przestawieniu zmiennych
+ */
+extern Poly PolyPermute(const Poly *p, size_t n, const size_t perm[]);
+
+/**
+ * Wybiera heurystycznie kolejność zmiennych, w której drzewo wielomianu ma
+ * najmniej jednomianów. Poziomy są wybierane zachłannie od korzenia: na
+ * każdym wybierana jest zmienna, która daje na nim najmniej jednomianów.
+ * Jeśli tak wybrana kolejność nie jest lepsza od obecnej, wynikiem jest
+ * permutacja identycznościowa.
+ * @param[in] p : wielomian
+ * @param[out] perm : permutacja dla PolyPermute o PolyDepth(p) elementach
+ * @return : liczba jednomianów drzewa po przestawieniu zmiennych
+ */
+extern size_t PolyBestOrder(const Poly *p, size_t perm[]);
+
+#pragma GCC visibility pop
+
+#endif //POLYNOMIALS_POLY_PERMUTE_H
@@ -0,0 +1,354 @@
+/** @file
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#define _GNU_SOURCE
+
+#include "poly_serialize.h"
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "input.h"
+
+/** Początkowy rozmiar tablicy z długościami list jednomianów
+ */
+#define INIT_SIZES_SIZE 16
+
+/** Długość nagłówka pliku: #POLY_FILE_MAGIC i bajt wersji
+ */
+#define FILE_HEADER_SIZE (sizeof(POLY_FILE_MAGIC) - 1 + 1)
+
+/**
+ * Tablica długości (w bajtach) list jednomianów kolejnych, niestałych
+ * węzłów wielomianu w porządku pre-order
+ */
+typedef struct SizesT {
+    size_t *arr;    ///< długości list jednomianów
+    size_t size;    ///< rozmiar tablicy
+    size_t count;   ///< liczba zapisanych długości
+} SizesT;
+
+/**
+ * Koduje liczbę ze znakiem tak, by liczby o małej wartości bezwzględnej
+ * miały krótki zapis varint
+ * @param[in] num : liczba
+ * @return : liczba w kodowaniu zigzag
+ */
+static inline uint64_t zigzag(int64_t num) {
+    return ((uint64_t) num << 1) ^ (uint64_t) (num >> 63);
+}
+
+/**
+ * Odwrotność funkcji zigzag
+ * @param[in] num : liczba w kodowaniu zigzag
+ * @return : odkodowana liczba
+ */
+static inline int64_t unzigzag(uint64_t num) {
+    return (int64_t) ((num >> 1) ^ -(num & 1));
+}
+
+/**
+ * Zwraca długość zapisu varint liczby
+ * @param[in] num : liczba
+ * @return : liczba bajtów zapisu
+ */
+static inline size_t varintSize(uint64_t num) {
+    size_t res = 1;
+    while (num >= 0x80) {
+        num >>= 7;
+        res++;
+    }
+    return res;
+}
+
+/**
+ * Zapisuje liczbę w kodowaniu varint
+ * @param[in] num : liczba
+ * @param[out] buf : bufor
+ * @return : wskaźnik za ostatnim zapisanym bajtem
+ */
+static inline unsigned char *writeVarint(uint64_t num, unsigned char *buf) {
+    while (num >= 0x80) {
+        *buf++ = (unsigned char) (num | 0x80);
+        num >>= 7;
+    }
+    *buf++ = (unsigned char) num;
+    return buf;
+}
+
+/**
+ * Odczytuje liczbę w kodowaniu varint
+ * @param[in,out] pos : pozycja w buforze
+ * @param[in] end : koniec bufora
+ * @param[out] num : odczytana liczba
+ * @return : czy zapis był poprawny
+ */
+static inline bool readVarint(const unsigned char **pos,
+                              const unsigned char *end, uint64_t *num) {
+    if (*pos < end && **pos < 0x80) {
+        *num = *(*pos)++;
+        return true;
+    }
+
+    uint64_t res = 0;
+    for (unsigned shift = 0; shift < 64 && *pos < end; shift += 7) {
+        unsigned char byte = *(*pos)++;
+        if (shift == 63 && byte > 1) return false;
+        res |= (uint64_t) (byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            *num = res;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Sprawdza, czy współczynnik zmieści się w nagłówku węzła
+ * @param[in] zigzagCoeff : współczynnik w kodowaniu zigzag
+ * @return : czy współczynnik mieści się w nagłówku
+ */
+static inline bool fitsInHeader(uint64_t zigzagCoeff) {
+    return zigzagCoeff < (UINT64_C(1) << 63);
+}
+
+/**
+ * Liczy rozmiar zapisu wielomianu i zapamiętuje długości list jednomianów
+ * jego niestałych węzłów
+ * @param[in] p : wielomian
+ * @param[in,out] sizes : tablica długości list jednomianów
+ * @return : rozmiar zapisu wielomianu
+ */
+static size_t measurePoly(const Poly *p, SizesT *sizes) {
+    if (PolyIsCoeff(p)) {
+        uint64_t coeff = zigzag(p->coeff);
+        if (fitsInHeader(coeff)) return varintSize(coeff << 1);
+        return 1 + varintSize(coeff);
+    }
+
+    if (sizes->count == sizes->size) {
+        sizes->size *= 2;
+        sizes->arr = safeRealloc(sizes->arr, sizes->size * sizeof(size_t));
+    }
+    size_t slot = sizes->count++, payload = 0;
+    int64_t prevExp = 0;
+
+    for (size_t i = 0; i < p->size; ++i) {
+        payload += varintSize(zigzag(p->arr[i].exp - prevExp));
+        prevExp = p->arr[i].exp;
+        payload += measurePoly(&p->arr[i].p, sizes);
+    }
+    sizes->arr[slot] = payload;
+
+    return varintSize(2 * (uint64_t) p->size + 1) + varintSize(payload) +
+           payload;
+}
+
+/**
+ * Zapisuje wielomian do bufora korzystając z policzonych długości list
+ * jednomianów
+ * @param[in] p : wielomian
+ * @param[in] sizes : tablica długości list jednomianów
+ * @param[in,out] slot : indeks długości listy jednomianów węzła @p p
+ * @param[out] buf : bufor
+ * @return : wskaźnik za ostatnim zapisanym bajtem
+ */
+static unsigned char *writePoly(const Poly *p, const SizesT *sizes,
+                                size_t *slot, unsigned char *buf) {
+    if (PolyIsCoeff(p)) {
+        uint64_t coeff = zigzag(p->coeff);
+        if (fitsInHeader(coeff)) return writeVarint(coeff << 1, buf);
+        *buf++ = 1;
+        return writeVarint(coeff, buf);
+    }
+
+    buf = writeVarint(2 * (uint64_t) p->size + 1, buf);
+    buf = writeVarint(sizes->arr[(*slot)++], buf);
+    int64_t prevExp = 0;
+
+    for (size_t i = 0; i < p->size; ++i) {
+        buf = writeVarint(zigzag(p->arr[i].exp - prevExp), buf);
+        prevExp = p->arr[i].exp;
+        buf = writePoly(&p->arr[i].p, sizes, slot, buf);
+    }
+    return buf;
+}
+
+/**
+ * Odczytuje wielomian z bufora. Odczytany wielomian musi być w postaci
+ * kanonicznej, jak wyniki operacji z poly.h: wykładniki są nieujemne
+ * i rosnące, współczynniki jednomianów są niezerowe, a węzeł z jednym
+ * jednomianem @f$c x^0@f$, gdzie @f$c@f$ jest stałą, jest zapisany jako
+ * stała.
+ * @param[in,out] pos : pozycja w buforze
+ * @param[in] end : koniec bufora
+ * @param[in] depth : liczba węzłów nad odczytywanym wielomianem
+ * @param[out] p : odczytany wielomian
+ * @return : czy zapis był poprawny
+ */
+static bool readPoly(const unsigned char **pos, const unsigned char *end,
+                     size_t depth, Poly *p) {
+    uint64_t header, coeff, payload;
+
+    if (!readVarint(pos, end, &header)) return false;
+    if (header == 1) {
+        if (!readVarint(pos, end, &coeff)) return false;
+        // Współczynnik jednomianu nie może być zerem
+        if (depth > 0 && coeff == 0) return false;
+        *p = PolyFromCoeff(unzigzag(coeff));
+        return true;
+    }
+    if ((header & 1) == 0) {
+        if (depth > 0 && header == 0) return false;
+        *p = PolyFromCoeff(unzigzag(header >> 1));
+        return true;
+    }
+    if (depth >= POLY_MAX_DEPTH) return false;
+
+    // Każdy jednomian zajmuje co najmniej 2 bajty, co ogranicza rozmiar
+    // alokowanej tablicy dla uszkodzonych danych
+    uint64_t count = header >> 1;
+    if (!readVarint(pos, end, &payload) ||
+        payload > (uint64_t) (end - *pos) || count > payload / 2)
+        return false;
+
+    const unsigned char *payloadEnd = *pos + payload;
+    Mono *arr = MonoArrAlloc(count);
+    int64_t exp = 0;
+    uint64_t delta;
+
+    for (size_t i = 0; i < count; ++i) {
+        bool correct = readVarint(pos, payloadEnd, &delta);
+        if (correct) {
+            // Pierwszy wykładnik jest nieujemny, a kolejne rosną
+            int64_t step = unzigzag(delta);
+            correct = (i == 0 ? step >= 0 : step > 0) &&
+                      step <= INT_MAX - exp &&
+                      readPoly(pos, payloadEnd, depth + 1, &arr[i].p);
+            if (correct) exp += step;
+        }
+        if (!correct) {
+            for (size_t j = 0; j < i; ++j) MonoDestroy(&arr[j]);
+            MonoArrFree(arr);
+            return false;
+        }
+        arr[i].exp = (poly_exp_t) exp;
+    }
+
+    *p = (Poly) {.size = count, .arr = arr};
+    if (*pos != payloadEnd ||
+        (count == 1 && arr[0].exp == 0 && PolyIsCoeff(&arr[0].p))) {
+        PolyDestroy(p);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Liczy długości list jednomianów wielomianu
+ * @param[in] p : wielomian
+ * @param[out] sizes : tablica długości list jednomianów
+ * @return : rozmiar zapisu wielomianu
+ */
+static size_t initSizes(const Poly *p, SizesT *sizes) {
+    sizes->size = INIT_SIZES_SIZE;
+    sizes->count = 0;
+    sizes->arr = safeMalloc(sizes->size * sizeof(size_t));
+    return measurePoly(p, sizes);
+}
+
+size_t PolySerializedSize(const Poly *p) {
+    SizesT sizes;
+    size_t res = initSizes(p, &sizes);
+    safeFree(sizes.arr);
+    return res;
+}
+
+size_t PolySerialize(const Poly *p, unsigned char *buf) {
+    SizesT sizes;
+    size_t slot = 0;
+    initSizes(p, &sizes);
+    size_t res = writePoly(p, &sizes, &slot, buf) - buf;
+    safeFree(sizes.arr);
+    return res;
+}
+
+unsigned char *PolySerializeAlloc(const Poly *p, size_t *len) {
+    SizesT sizes;
+    size_t slot = 0;
+    *len = initSizes(p, &sizes);
+    unsigned char *buf = safeMalloc(*len);
+    writePoly(p, &sizes, &slot, buf);
+    safeFree(sizes.arr);
+    return buf;
+}
+
+void PolySerializeFree(unsigned char *buf) {
+    safeFree(buf);
+}
+
+size_t PolyDeserialize(const unsigned char *buf, size_t len, Poly *p) {
+    const unsigned char *pos = buf;
+    if (!readPoly(&pos, buf + len, 0, p)) return 0;
+    return pos - buf;
+}
+
+bool PolyWriteFile(const Poly *p, const char *path) {
+    if (PolyDepth(p) > POLY_MAX_DEPTH) return false;
+
+    // Zapis jest przygotowywany przed otwarciem pliku, żeby brak pamięci
+    // nie zostawił otwartego pliku
+    size_t len;
+    unsigned char *buf = PolySerializeAlloc(p, &len);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        safeFree(buf);
+        return false;
+    }
+
+    bool res = fwrite(POLY_FILE_MAGIC, 1, FILE_HEADER_SIZE - 1, file) ==
+               FILE_HEADER_SIZE - 1 &&
+               fputc(POLY_FILE_VERSION, file) != EOF &&
+               fwrite(buf, 1, len, file) == len;
+    safeFree(buf);
+
+    return fclose(file) == 0 && res;
+}
+
+bool PolyReadFile(const char *path, Poly *p) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    bool res = false;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        (size_t) st.st_size > FILE_HEADER_SIZE) {
+        unsigned char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                                   fd, 0);
+        if (data != MAP_FAILED) {
+            size_t len = st.st_size - FILE_HEADER_SIZE;
+            if (memcmp(data, POLY_FILE_MAGIC, FILE_HEADER_SIZE - 1) == 0 &&
+                data[FILE_HEADER_SIZE - 1] == POLY_FILE_VERSION) {
+                MemTxnT txn;
+                MemTxnBegin(&txn);
+                if (setjmp(txn.env) != 0) {
+                    munmap(data, st.st_size);
+                    close(fd);
+                    MemFail();
+                }
+                size_t readLen = PolyDeserialize(data + FILE_HEADER_SIZE, len,
+                                                 p);
+                MemTxnEnd(&txn);
+                res = readLen == len;
+                if (readLen != 0 && !res) PolyDestroy(p);
+            }
+            munmap(data, st.st_size);
+        }
+    }
+    close(fd);
+    return res;
+}
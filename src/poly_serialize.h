@@ -0,0 +1,107 @@
+/** @file
+ * Binarny format zapisu wielomianów
+ *
+ * Wielomian zapisywany jest w porządku pre-order. Każdy węzeł zaczyna się
+ * nagłówkiem będącym liczbą w kodowaniu varint (7 bitów na bajt):
+ * - nagłówek parzysty @f$2z@f$ oznacza wielomian stały o współczynniku
+ *   zakodowanym jako @f$z@f$ w kodowaniu zigzag,
+ * - nagłówek równy 1 oznacza wielomian stały, którego współczynnik (zigzag)
+ *   nie mieści się w nagłówku i zapisany jest w kolejnym varincie,
+ * - nagłówek nieparzysty @f$2n+1@f$, @f$n > 0@f$ oznacza wielomian
+ *   o @f$n@f$ jednomianach. Po nim następuje varint z długością w bajtach
+ *   listy jednomianów, a następnie jednomiany: różnica wykładnika
+ *   z wykładnikiem poprzedniego jednomianu (dla pierwszego sam wykładnik)
+ *   i zapisany rekurencyjnie współczynnik.
+ *
+ * Odczytywany zapis musi opisywać wielomian w postaci kanonicznej
+ * (rosnące, nieujemne wykładniki, niezerowe współczynniki jednomianów,
+ * stałe zapisane jako stałe) o co najwyżej #POLY_MAX_DEPTH poziomach.
+ *
+ * Plik z wielomianem zawiera nagłówek #POLY_FILE_MAGIC, bajt wersji
+ * formatu i zapis wielomianu.
+ *
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#ifndef POLYNOMIALS_POLY_SERIALIZE_H
+#define POLYNOMIALS_POLY_SERIALIZE_H
+
+#include "poly.h"
+
+// Eksportowane z biblioteki dzielonej (zob. poly.h)
+#pragma GCC visibility push(default)
+
+/** Nagłówek pliku z zapisanym wielomianem
+ */
+#define POLY_FILE_MAGIC "POLY"
+
+/** Wersja binarnego formatu zapisu wielomianów
+ */
+#define POLY_FILE_VERSION 1
+
+/** Największa liczba poziomów odczytywanego wielomianu
+ */
+#define POLY_MAX_DEPTH 1024
+
+/**
+ * Zwraca liczbę bajtów potrzebną do zapisania wielomianu
+ * @param[in] p : wielomian
+ * @return : rozmiar zapisu wielomianu w bajtach
+ */
+extern size_t PolySerializedSize(const Poly *p);
+
+/**
+ * Zapisuje wielomian do bufora, który musi mieć co najmniej
+ * PolySerializedSize(p) bajtów
+ * @param[in] p : wielomian
+ * @param[out] buf : bufor
+ * @return : liczba zapisanych bajtów
+ */
+extern size_t PolySerialize(const Poly *p, unsigned char *buf);
+
+/**
+ * Zapisuje wielomian do nowo zaalokowanego bufora dokładnie potrzebnego
+ * rozmiaru
+ * @param[in] p : wielomian
+ * @param[out] len : rozmiar zapisu wielomianu
+ * @return : bufor z zapisem, który należy zwolnić funkcją PolySerializeFree
+ */
+extern unsigned char *PolySerializeAlloc(const Poly *p, size_t *len);
+
+/**
+ * Zwalnia bufor zwrócony przez PolySerializeAlloc
+ * @param[in] buf : bufor lub NULL
+ */
+extern void PolySerializeFree(unsigned char *buf);
+
+/**
+ * Odczytuje wielomian z bufora. Sprawdza poprawność zapisu i to, czy
+ * wielomian jest w postaci kanonicznej, i nie czyta poza @p len bajtów.
+ * @param[in] buf : bufor
+ * @param[in] len : rozmiar bufora
+ * @param[out] p : odczytany wielomian
+ * @return : liczba przeczytanych bajtów lub 0, jeśli zapis jest niepoprawny
+ */
+extern size_t PolyDeserialize(const unsigned char *buf, size_t len, Poly *p);
+
+/**
+ * Zapisuje wielomian do pliku. Wielomian o więcej niż #POLY_MAX_DEPTH
+ * poziomach nie jest zapisywany, bo nie dałoby się go odczytać.
+ * @param[in] p : wielomian
+ * @param[in] path : ścieżka do pliku
+ * @return : czy zapis się powiódł
+ */
+extern bool PolyWriteFile(const Poly *p, const char *path);
+
+/**
+ * Odczytuje wielomian z pliku zapisanego przez PolyWriteFile
+ * @param[in] path : ścieżka do pliku
+ * @param[out] p : odczytany wielomian
+ * @return : czy odczyt się powiódł
+ */
+extern bool PolyReadFile(const char *path, Poly *p);
+
+#pragma GCC visibility pop
+
+#endif //POLYNOMIALS_POLY_SERIALIZE_H
@@ -3,9 +3,39 @@
  * @date 2021
  */
 
+#define _GNU_SOURCE
+
 #include "poly_stack.h"
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "input.h"
+#include "poly_serialize.h"
+#include "stats.h"
+
+/** Nagłówek pliku z zapisanym stosem
+ */
+#define STACK_FILE_MAGIC "PSTK"
+
+/** Wersja formatu pliku z zapisanym stosem
+ */
+#define STACK_FILE_VERSION 1
+
+/** Długość nagłówka pliku: nagłówek, wersja, wyrównanie i liczba wielomianów
+ */
+#define STACK_HEADER_SIZE 16
+
+/** Długość wpisu w tablicy wielomianów: przesunięcie i długość zapisu
+ */
+#define STACK_ENTRY_SIZE 16
+
+/** Przyrostek nazwy pliku tymczasowego używanego przy zapisie stosu
+ */
+#define STACK_TMP_SUFFIX ".tmp"
 
 /**
  * Zwraca nowy (dwukrotnie wiekszy) rozmiar stosu
@@ -17,12 +47,63 @@ static stackSizeT newSize(stackSizeT num) {
 }
 
 /**
- * Zwieksza dwukrotnie zaalokowana pamięć na stos
+ * Zwieksza dwukrotnie zaalokowana pamięć na stos. Rozmiar stosu jest
+ * zmieniany dopiero po powiększeniu obu tablic, więc po wycofaniu
+ * transakcji pamięci stos pozostaje poprawny.
  * @param[in] stack : stos
  */
 static void ExpandStack(StackT *stack) {
-    stack->size = newSize(stack->size);
-    stack->polyArr = realloc(stack->polyArr, stack->size * sizeof(Poly));
+    STAT_INC(STAT_STACK_EXPANSIONS);
+    stackSizeT size = newSize(stack->size);
+    stack->polyArr = safeRealloc(stack->polyArr, size * sizeof(Poly));
+    if (stack->lazyArr != NULL)
+        stack->lazyArr = safeRealloc(stack->lazyArr, size * sizeof(LazyPolyT));
+    stack->size = size;
+}
+
+/**
+ * Odczytuje do pamięci wielomian z podanego miejsca stosu, jeśli nie został
+ * jeszcze odczytany ze zmapowanego pliku. StackLoad sprawdza tylko nagłówek
+ * i tablicę wielomianów pliku, więc zapis wielomianu jest sprawdzany dopiero
+ * tutaj. Uszkodzony zapis zostaje na stosie nieodczytany. Odczytany
+ * wielomian zostaje na stosie nawet wtedy, gdy komenda, która go użyła,
+ * zostanie wycofana z braku pamięci.
+ * @param[in] stack : stos
+ * @param[in] i : indeks wielomianu
+ * @return : czy zapis wielomianu jest poprawny
+ */
+static bool Materialize(StackT *stack, stackSizeT i) {
+    if (stack->lazyArr == NULL || stack->lazyArr[i].data == NULL) return true;
+
+    STAT_INC(STAT_MATERIALIZED);
+    LazyPolyT lazy = stack->lazyArr[i];
+    Poly p;
+    MemTxnT txn;
+    MemTxnBegin(&txn);
+    if (setjmp(txn.env) != 0) MemFail();
+    size_t len = PolyDeserialize(lazy.data, lazy.len, &p);
+    if (len != lazy.len) {
+        if (len != 0) PolyDestroy(&p);
+        MemTxnEnd(&txn);
+        return false;
+    }
+    MemTxnKeep(&txn);
+
+    stack->polyArr[i] = p;
+    stack->lazyArr[i].data = NULL;
+    return true;
+}
+
+/**
+ * Odczytuje do pamięci wielomian z podanego miejsca stosu, który komenda
+ * odczytała już przez StackMaterialize
+ * @param[in] stack : stos
+ * @param[in] i : indeks wielomianu
+ */
+static void materializeChecked(StackT *stack, stackSizeT i) {
+    bool ok = Materialize(stack, i);
+    assert(ok);
+    (void) ok;
 }
 
 bool isEmpty(StackT stack) { return stack.nextFreeInd == 0; }
@@ -30,42 +111,275 @@ bool isEmpty(StackT stack) { return stack.nextFreeInd == 0; }
 bool has2Polys(StackT stack) { return stack.nextFreeInd > 1; }
 
 void Push(StackT *stack, Poly p) {
+    STAT_INC(STAT_PUSHES);
     if (stack->size == stack->nextFreeInd + 1) {
         ExpandStack(stack);
     }
 
+    // Internowanie nie alokuje pamięci z budżetu, więc wycofanie komendy
+    // nie może zwolnić wpisanej do tablicy internowanych tablicy
+    if (stack->hashCons) PolyIntern(&p);
+
+    if (stack->lazyArr != NULL) stack->lazyArr[stack->nextFreeInd].data = NULL;
     stack->polyArr[stack->nextFreeInd++] = p;
 }
 
-Poly Top(StackT stack) { return stack.polyArr[stack.nextFreeInd - 1]; }
+Poly Top(StackT stack) {
+    materializeChecked(&stack, stack.nextFreeInd - 1);
+    return stack.polyArr[stack.nextFreeInd - 1];
+}
 
 Poly Pop(StackT *stack) {
-    Poly tempPoly = PolyClone(&stack->polyArr[stack->nextFreeInd - 1]);
-    PolyDestroy(&stack->polyArr[stack->nextFreeInd - 1]);
+    STAT_INC(STAT_POPS);
+    materializeChecked(stack, stack->nextFreeInd - 1);
     stack->nextFreeInd--;
-    return tempPoly;
+    return stack->polyArr[stack->nextFreeInd];
 }
 
 Poly GetSecondPoly (StackT *stack){
-    Poly tempPoly = Pop(stack);
-    Poly res = Top(*stack);
-    Push(stack, tempPoly);
-    return res;
+    materializeChecked(stack, stack->nextFreeInd - 2);
+    return stack->polyArr[stack->nextFreeInd - 2];
+}
+
+bool StackMaterialize(StackT *stack, stackSizeT n) {
+    if (n > stack->nextFreeInd) return true;
+    for (stackSizeT i = 0; i < n; ++i) {
+        if (!Materialize(stack, stack->nextFreeInd - 1 - i)) return false;
+    }
+    return true;
+}
+
+void StackDrop(StackT *stack) {
+    STAT_INC(STAT_POPS);
+    stackSizeT ind = --stack->nextFreeInd;
+    if (stack->lazyArr == NULL || stack->lazyArr[ind].data == NULL)
+        PolyDestroy(&stack->polyArr[ind]);
+}
+
+stackSizeT StackSize(StackT stack) { return stack.nextFreeInd; }
+
+Poly StackGet(StackT *stack, stackSizeT i) {
+    assert(i < stack->nextFreeInd);
+    materializeChecked(stack, stack->nextFreeInd - 1 - i);
+    return stack->polyArr[stack->nextFreeInd - 1 - i];
+}
+
+const Poly *StackPeek(const StackT *stack, stackSizeT i) {
+    if (i >= stack->nextFreeInd) return NULL;
+
+    stackSizeT ind = stack->nextFreeInd - 1 - i;
+    if (stack->lazyArr != NULL && stack->lazyArr[ind].data != NULL)
+        return NULL;
+    return &stack->polyArr[ind];
 }
 
 StackT StackInit(stackSizeT size){
     StackT stack;
     stack.size = size;
     stack.polyArr = safeMalloc(stack.size * sizeof(Poly));
+    stack.lazyArr = NULL;
     stack.nextFreeInd = 0;
+    stack.images = NULL;
+    stack.out = stdout;
+    stack.err = stderr;
+    stack.output = NULL;
+    stack.hashCons = false;
+    stack.noFiles = false;
     return stack;
 }
 
 void StackDestroy(StackT *stack) {
     for (stackSizeT i = 0; i < stack->nextFreeInd; ++i) {
-        PolyDestroy(&stack->polyArr[i]);
+        if (stack->lazyArr == NULL || stack->lazyArr[i].data == NULL)
+            PolyDestroy(&stack->polyArr[i]);
+    }
+
+    while (stack->images != NULL) {
+        StackImageT *next = stack->images->next;
+        munmap(stack->images->data, stack->images->size);
+        safeFree(stack->images);
+        stack->images = next;
+    }
+
+    safeFree(stack->lazyArr);
+    safeFree(stack->polyArr);
+}
+
+/**
+ * Zapisuje liczbę w porządku little-endian
+ * @param[in] num : liczba
+ * @param[out] buf : bufor o rozmiarze 8 bajtów
+ */
+static void writeU64(uint64_t num, unsigned char *buf) {
+    for (int i = 0; i < 8; ++i) buf[i] = (unsigned char) (num >> (8 * i));
+}
+
+/**
+ * Odczytuje liczbę zapisaną w porządku little-endian
+ * @param[in] buf : bufor o rozmiarze 8 bajtów
+ * @return : odczytana liczba
+ */
+static uint64_t readU64(const unsigned char *buf) {
+    uint64_t res = 0;
+    for (int i = 0; i < 8; ++i) res |= (uint64_t) buf[i] << (8 * i);
+    return res;
+}
+
+bool StackSave(StackT *stack, const char *path) {
+    // Plik mógł zostać wcześniej zmapowany przez StackLoad, więc nie możemy
+    // go nadpisać - zapisujemy nowy plik i podmieniamy go na końcu
+    char *tmpPath = safeMalloc(strlen(path) + sizeof(STACK_TMP_SUFFIX));
+    strcpy(tmpPath, path);
+    strcat(tmpPath, STACK_TMP_SUFFIX);
+
+    FILE *file = fopen(tmpPath, "wb");
+    if (file == NULL) {
+        safeFree(tmpPath);
+        return false;
     }
 
-    free(stack->polyArr);
+    // Bez pamięci zamykamy i usuwamy niedokończony plik
+    MemTxnT txn;
+    MemTxnBegin(&txn);
+    if (setjmp(txn.env) != 0) {
+        fclose(file);
+        unlink(tmpPath);
+        MemFail();
+    }
+
+    stackSizeT count = stack->nextFreeInd;
+    size_t tableSize = STACK_ENTRY_SIZE * count;
+    unsigned char *table = safeMalloc(STACK_HEADER_SIZE + tableSize);
+    memset(table, 0, STACK_HEADER_SIZE);
+    memcpy(table, STACK_FILE_MAGIC, sizeof(STACK_FILE_MAGIC) - 1);
+    table[sizeof(STACK_FILE_MAGIC) - 1] = STACK_FILE_VERSION;
+    writeU64(count, table + 8);
+
+    // Najpierw rezerwujemy miejsce na tablicę, a zapisy wielomianów
+    // dopisujemy kolejno, nie trzymając w pamięci więcej niż jednego
+    bool res = fwrite(table, 1, STACK_HEADER_SIZE + tableSize, file) ==
+               STACK_HEADER_SIZE + tableSize;
+    uint64_t offset = STACK_HEADER_SIZE + tableSize;
+
+    for (stackSizeT i = 0; i < count && res; ++i) {
+        unsigned char *entry = table + STACK_HEADER_SIZE + STACK_ENTRY_SIZE * i;
+        size_t len;
+
+        if (stack->lazyArr != NULL && stack->lazyArr[i].data != NULL) {
+            len = stack->lazyArr[i].len;
+            res = fwrite(stack->lazyArr[i].data, 1, len, file) == len;
+        } else {
+            unsigned char *buf = PolySerializeAlloc(&stack->polyArr[i], &len);
+            res = fwrite(buf, 1, len, file) == len;
+            safeFree(buf);
+        }
+
+        writeU64(offset, entry);
+        writeU64(len, entry + 8);
+        offset += len;
+    }
+
+    res = res && fseek(file, STACK_HEADER_SIZE, SEEK_SET) == 0 &&
+          fwrite(table + STACK_HEADER_SIZE, 1, tableSize, file) == tableSize;
+    safeFree(table);
+    MemTxnEnd(&txn);
+
+    res = fclose(file) == 0 && res && rename(tmpPath, path) == 0;
+    if (!res) unlink(tmpPath);
+    safeFree(tmpPath);
+    return res;
 }
 
+/**
+ * Sprawdza nagłówek i tablicę wielomianów zmapowanego pliku ze stosem. Zapisy
+ * wielomianów nie są czytane, więc koszt nie zależy od ich rozmiaru; są
+ * sprawdzane przy odczycie (zob. StackMaterialize).
+ * @param[in] data : zmapowany plik
+ * @param[in] size : rozmiar pliku
+ * @return : czy plik jest poprawny
+ */
+static bool correctStackImage(const unsigned char *data, size_t size) {
+    if (size < STACK_HEADER_SIZE ||
+        memcmp(data, STACK_FILE_MAGIC, sizeof(STACK_FILE_MAGIC) - 1) != 0 ||
+        data[sizeof(STACK_FILE_MAGIC) - 1] != STACK_FILE_VERSION)
+        return false;
+
+    uint64_t count = readU64(data + 8);
+    if (count > (size - STACK_HEADER_SIZE) / STACK_ENTRY_SIZE) return false;
+
+    uint64_t payloadStart = STACK_HEADER_SIZE + STACK_ENTRY_SIZE * count;
+    for (uint64_t i = 0; i < count; ++i) {
+        const unsigned char *entry =
+                data + STACK_HEADER_SIZE + STACK_ENTRY_SIZE * i;
+        uint64_t offset = readU64(entry), len = readU64(entry + 8);
+        if (offset < payloadStart || offset > size || len == 0 ||
+            len > size - offset)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Alokuje pamięć potrzebną do wczytania zapisanego stosu, zanim stos
+ * zostanie zmieniony, więc bez pamięci stos zostaje bez zmian, a plik jest
+ * odmapowywany
+ * @param[in,out] stack : stos
+ * @param[in] data : zmapowany plik
+ * @param[in] size : rozmiar pliku
+ * @param[in] count : liczba wielomianów w pliku
+ * @return : opis zmapowanego pliku do dodania do stosu
+ */
+static StackImageT *reserveImage(StackT *stack, unsigned char *data,
+                                 size_t size, uint64_t count) {
+    MemTxnT txn;
+    MemTxnBegin(&txn);
+    if (setjmp(txn.env) != 0) {
+        munmap(data, size);
+        MemFail();
+    }
+
+    while (stack->size <= stack->nextFreeInd + count) ExpandStack(stack);
+    LazyPolyT *lazyArr = stack->lazyArr;
+    if (lazyArr == NULL) {
+        lazyArr = safeMalloc(stack->size * sizeof(LazyPolyT));
+        for (stackSizeT i = 0; i < stack->nextFreeInd; ++i)
+            lazyArr[i].data = NULL;
+    }
+    StackImageT *image = safeMalloc(sizeof(StackImageT));
+    MemTxnEnd(&txn);
+
+    stack->lazyArr = lazyArr;
+    return image;
+}
+
+bool StackLoad(StackT *stack, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    unsigned char *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    if (!correctStackImage(data, st.st_size)) {
+        munmap(data, st.st_size);
+        return false;
+    }
+
+    uint64_t count = readU64(data + 8);
+    StackImageT *image = reserveImage(stack, data, st.st_size, count);
+    *image = (StackImageT) {.data = data, .size = st.st_size,
+                            .next = stack->images};
+    stack->images = image;
+
+    for (uint64_t i = 0; i < count; ++i) {
+        const unsigned char *entry =
+                data + STACK_HEADER_SIZE + STACK_ENTRY_SIZE * i;
+        Push(stack, PolyZero());
+        stack->lazyArr[stack->nextFreeInd - 1] = (LazyPolyT) {
+                .data = data + readU64(entry), .len = readU64(entry + 8)};
+    }
+    return true;
+}
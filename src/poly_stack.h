@@ -7,21 +7,62 @@
 #define POLYNOMIALS_POLY_STACK_H
 
 #include "poly.h"
+#include <stdio.h>
+
+/** Początkowy rozmiar stosu
+ */
+#define INIT_STACK_SIZE 16
 
 /** Typ używany do przechoywania rozmiaru stosu
  */
 typedef unsigned long long int stackSizeT;
 
+/**
+ * Zmapowany do pamięci plik z zapisanym stosem. Pliki tworzą listę, która
+ * jest zwalniana razem ze stosem.
+ */
+typedef struct StackImageT {
+    unsigned char *data;        ///< zmapowany plik
+    size_t size;                ///< rozmiar pliku
+    struct StackImageT *next;   ///< następny zmapowany plik
+} StackImageT;
+
+/**
+ * Binarny zapis wielomianu ze zmapowanego pliku, który nie został jeszcze
+ * odczytany. Wielomian jest odczytywany do pamięci przy pierwszym użyciu,
+ * również takim, które go nie zmienia, i od tej chwili zajmuje pamięć jak
+ * każdy inny wielomian na stosie.
+ */
+typedef struct LazyPolyT {
+    const unsigned char *data;  ///< zapis wielomianu lub NULL jeśli wielomian jest już w pamięci
+    size_t len;                 ///< długość zapisu
+} LazyPolyT;
+
 /**
  * Struktura stosu (implementowanego na tablicy) wielomianów zawierająca
  * tablice wielomianów, rozmiar tablicy (stosu) oraz indeks na którym
- * powinniśmy zapisać następny wielomian
+ * powinniśmy zapisać następny wielomian. Jeśli na stos wczytano zapisany
+ * stos, tablica @p lazyArr przechowuje jeszcze nieodczytane wielomiany.
+ * Wyniki i komunikaty o błędach komend wykonywanych na stosie są wypisywane
+ * do strumieni @p out i @p err. Jeśli @p output nie jest równe NULL, wynik
+ * lub błąd komendy zamiast do strumieni trafia do @p output, skąd jest
+ * przekazywany do wątku wypisującego dopiero po zakończeniu komendy.
+ * Jeśli @p hashCons jest prawdą, wielomiany wkładane na stos są
+ * internowane (zob. PolyIntern). Jeśli @p noFiles jest prawdą, komendy
+ * czytające i zapisujące pliki są odrzucane.
  * @
  */
 typedef struct StackT {
     Poly *polyArr;
+    LazyPolyT *lazyArr;
     stackSizeT size;
     stackSizeT nextFreeInd;
+    StackImageT *images;
+    FILE *out;
+    FILE *err;
+    struct OutputT *output;
+    bool hashCons;
+    bool noFiles;
 } StackT;
 
 /**
@@ -66,6 +107,53 @@ extern Poly Pop(StackT *stack);
  */
 extern Poly GetSecondPoly (StackT *stack);
 
+/**
+ * Odczytuje do pamięci wielomiany z @p n miejsc od wierzchołka stosu, które
+ * nie zostały jeszcze odczytane ze zmapowanego pliku. Komenda musi odczytać
+ * w ten sposób wszystkie wielomiany, których używa, zanim pobierze je
+ * funkcjami Top, Pop, GetSecondPoly lub StackGet. Jeśli na stosie jest mniej
+ * niż @p n wielomianów, nic nie jest odczytywane, bo komenda zgłosi STACK
+ * UNDERFLOW.
+ * @param[in,out] stack : stos
+ * @param[in] n : liczba miejsc od wierzchołka
+ * @return : czy zapisy wszystkich tych wielomianów są poprawne; jeśli nie,
+ * uszkodzone zapisy zostają na stosie nieodczytane
+ */
+extern bool StackMaterialize(StackT *stack, stackSizeT n);
+
+/**
+ * Zdejmuje wielomian z wierzchołka stosu i go zwalnia, nie odczytując go
+ * z pliku, więc można w ten sposób usunąć wielomian o uszkodzonym zapisie
+ * @param[in,out] stack : niepusty stos
+ */
+extern void StackDrop(StackT *stack);
+
+/**
+ * Zwraca liczbę wielomianów na stosie
+ * @param[in] stack : stos
+ * @return : liczba wielomianów na stosie
+ */
+extern stackSizeT StackSize(StackT stack);
+
+/**
+ * Zwraca wielomian z podanego miejsca stosu, w razie potrzeby odczytując go
+ * z pliku
+ * @param[in] stack : stos
+ * @param[in] i : odległość od wierzchołka (0 to wierzchołek), mniejsza niż
+ * liczba wielomianów na stosie
+ * @return : wielomian
+ */
+extern Poly StackGet(StackT *stack, stackSizeT i);
+
+/**
+ * Zwraca wielomian z podanego miejsca stosu bez odczytywania go z pliku
+ * @param[in] stack : stos
+ * @param[in] i : odległość od wierzchołka (0 to wierzchołek)
+ * @return : wielomian lub NULL, jeśli miejsce jest puste lub wielomian nie
+ * został jeszcze odczytany z pliku
+ */
+extern const Poly *StackPeek(const StackT *stack, stackSizeT i);
+
 /**
  * Zwalnia zaalokowaną na stos pamięć
  * @param[in] stack : stos
@@ -73,11 +161,33 @@ extern Poly GetSecondPoly (StackT *stack);
 extern void StackDestroy(StackT *stack);
 
 /**
- * Inicjalizuje stos o podanym rozmiarze
+ * Inicjalizuje stos o podanym rozmiarze, wypisujący wyniki na standardowe
+ * wyjście, a błędy na standardowe wyjście błędów
  * @param[in] size : rozmiar inicjalizowanego stosu
  * @return : zainicjalizowany stos
  */
 extern StackT StackInit(stackSizeT size);
 
+/**
+ * Zapisuje cały stos do pliku. Wielomiany, które nie zostały jeszcze
+ * odczytane z innego pliku, są kopiowane bez odczytywania.
+ * @param[in] stack : stos
+ * @param[in] path : ścieżka do pliku
+ * @return : czy zapis się powiódł
+ */
+extern bool StackSave(StackT *stack, const char *path);
+
+/**
+ * Mapuje do pamięci plik zapisany przez StackSave i wkłada zapisane
+ * wielomiany na stos (wielomian z wierzchołka zapisanego stosu trafia na
+ * wierzchołek). Sprawdzane są tylko nagłówek i tablica wielomianów, więc
+ * plik z błędną tablicą nie zmienia stosu, a koszt wczytania nie zależy od
+ * rozmiaru zapisów. Wielomiany są odczytywane do pamięci i sprawdzane
+ * dopiero przy pierwszym użyciu (zob. StackMaterialize).
+ * @param[in] stack : stos
+ * @param[in] path : ścieżka do pliku
+ * @return : czy plik jest poprawny
+ */
+extern bool StackLoad(StackT *stack, const char *path);
 
 #endif //POLYNOMIALS_POLY_STACK_H
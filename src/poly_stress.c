@@ -0,0 +1,705 @@
+/** @file
+ * Wielowątkowy test obciążeniowy funkcji z poly.h. Wątki wykonują losowe
+ * operacje na wspólnych wielomianach tylko do odczytu i porównują wyniki
+ * z wynikami policzonymi wcześniej przez jeden wątek albo przez proste,
+ * wolne implementacje z tego pliku, a także sprawdzają tożsamości
+ * algebraiczne na własnych wielomianach. Połowa wątków używa alokatora
+ * płytowego, a pozostałe internują wyniki we wspólnej tablicy. Program
+ * kończy się kodem 1, jeśli któryś wynik się nie zgadza.
+ *
+ * Użycie: poly_stress [--threads N] [--iterations N] [--seed N]
+ *
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include "poly.h"
+#include "poly_eval.h"
+#include "poly_permute.h"
+#include "allocator.h"
+#include "input.h"
+
+/** Domyślne ziarno generatora liczb losowych
+ */
+#define DEFAULT_SEED 2021
+
+/** Domyślna liczba wątków
+ */
+#define DEFAULT_THREADS 8
+
+/** Domyślna liczba iteracji każdego wątku
+ */
+#define DEFAULT_ITERATIONS 2000
+
+/** Liczba wspólnych par wielomianów
+ */
+#define SHARED_PAIRS 4
+
+/** Liczba punktów, w których liczymy wartości wspólnych wielomianów
+ */
+#define AT_POINTS 5
+
+/** Liczba zmiennych, dla których liczymy stopnie wspólnych wielomianów
+ */
+#define DEG_VARS 4
+
+/** Największa liczba punktów dla PolyEvalBatch; więcej niż dwa bloki
+ */
+#define EVAL_POINTS (2 * EVAL_LANES + 1)
+
+/** Największa liczba wielomianów podstawianych przez PolyCompose
+ */
+#define COMPOSE_MAX_K 8
+
+/** Największy stopień wielomianu składanego przez PolyCompose; podstawiane
+ * wielomiany mają sumę modułów współczynników co najwyżej 2, więc
+ * współczynniki wyniku nie przekraczają zakresu poly_coeff_t
+ */
+#define COMPOSE_MAX_DEG 48
+
+/** Największa liczba zmiennych wspólnych wielomianów
+ */
+#define MAX_DEPTH 6
+
+/** Największa liczba wątków
+ */
+#define MAX_THREADS 256
+
+/**
+ * Parametry generowanych wielomianów
+ */
+typedef struct ShapeT {
+    int depth;          ///< liczba zmiennych
+    size_t width;       ///< liczba jednomianów na każdym poziomie
+    int maxGap;         ///< największa różnica sąsiednich wykładników
+} ShapeT;
+
+/** Kształty wspólnych wielomianów
+ */
+static const ShapeT shapes[SHARED_PAIRS] = {
+        {3, 5, 1000}, {1, 64, 1}, {6, 2, 3}, {2, 12, 2},
+};
+
+/**
+ * Wspólna para wielomianów i wyniki operacji policzone przez jeden wątek
+ */
+typedef struct SharedT {
+    Poly p;                             ///< pierwszy argument
+    Poly q;                             ///< drugi argument
+    Poly sum;                           ///< p + q
+    Poly diff;                          ///< p - q
+    Poly prod;                          ///< p * q
+    Poly neg;                           ///< -p
+    Poly at[AT_POINTS];                 ///< p(x) dla x od -2 do 2
+    poly_exp_t deg;                     ///< stopień p
+    poly_exp_t degBy[DEG_VARS];         ///< stopnie p względem zmiennych
+    bool eq;                            ///< czy p = q
+} SharedT;
+
+/**
+ * Stan wątku testującego
+ */
+typedef struct WorkerT {
+    pthread_t thread;       ///< wątek
+    uint64_t rng;           ///< stan generatora liczb losowych
+    size_t iterations;      ///< liczba iteracji
+    bool slab;              ///< czy wątek używa alokatora płytowego
+    size_t checks;          ///< liczba sprawdzonych wyników
+    size_t failures;        ///< liczba niezgodnych wyników
+} WorkerT;
+
+/** Wspólne wielomiany
+ */
+static SharedT shared[SHARED_PAIRS];
+
+/**
+ * Generator liczb pseudolosowych splitmix64
+ * @param[in,out] state : stan generatora
+ * @return : kolejna liczba losowa
+ */
+static uint64_t nextRandom(uint64_t *state) {
+    uint64_t z = (*state += UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
+
+/**
+ * Losuje liczbę z przedziału [0, n)
+ * @param[in,out] state : stan generatora
+ * @param[in] n : długość przedziału
+ * @return : wylosowana liczba
+ */
+static uint64_t randomBelow(uint64_t *state, uint64_t n) {
+    return nextRandom(state) % n;
+}
+
+/**
+ * Generuje wielomian o zadanym kształcie i dodatnich współczynnikach, więc
+ * różny od zera
+ * @param[in,out] state : stan generatora
+ * @param[in] shape : kształt wielomianu
+ * @param[in] depth : liczba pozostałych zmiennych
+ * @return : wygenerowany wielomian
+ */
+static Poly genPoly(uint64_t *state, const ShapeT *shape, int depth) {
+    if (depth == 0)
+        return PolyFromCoeff((poly_coeff_t) randomBelow(state, 9) + 1);
+
+    Mono *monos = safeMalloc(shape->width * sizeof(Mono));
+    for (size_t i = 0; i < shape->width; ++i) {
+        Poly p = genPoly(state, shape, depth - 1);
+        poly_exp_t exp = (poly_exp_t) randomBelow(state, shape->maxGap);
+        monos[i] = MonoFromPoly(&p, exp);
+    }
+    Poly res = PolyAddMonos(shape->width, monos);
+    safeFree(monos);
+    return res;
+}
+
+/**
+ * Tworzy wspólne wielomiany i liczy wyniki operacji na nich
+ * @param[in] seed : ziarno generatora liczb losowych
+ */
+static void initShared(uint64_t seed) {
+    for (size_t i = 0; i < SHARED_PAIRS; ++i) {
+        uint64_t state = seed + i;
+        SharedT *s = &shared[i];
+        s->p = genPoly(&state, &shapes[i], shapes[i].depth);
+        s->q = genPoly(&state, &shapes[i], shapes[i].depth);
+        s->sum = PolyAdd(&s->p, &s->q);
+        s->diff = PolySub(&s->p, &s->q);
+        s->prod = PolyMul(&s->p, &s->q);
+        s->neg = PolyNeg(&s->p);
+        for (int x = 0; x < AT_POINTS; ++x)
+            s->at[x] = PolyAt(&s->p, x - AT_POINTS / 2);
+        s->deg = PolyDeg(&s->p);
+        for (size_t var = 0; var < DEG_VARS; ++var)
+            s->degBy[var] = PolyDegBy(&s->p, var);
+        s->eq = PolyIsEq(&s->p, &s->q);
+    }
+}
+
+/**
+ * Zwalnia wspólne wielomiany
+ */
+static void destroyShared(void) {
+    for (size_t i = 0; i < SHARED_PAIRS; ++i) {
+        SharedT *s = &shared[i];
+        PolyDestroy(&s->p);
+        PolyDestroy(&s->q);
+        PolyDestroy(&s->sum);
+        PolyDestroy(&s->diff);
+        PolyDestroy(&s->prod);
+        PolyDestroy(&s->neg);
+        for (int x = 0; x < AT_POINTS; ++x) PolyDestroy(&s->at[x]);
+    }
+}
+
+/**
+ * Zapisuje wynik sprawdzenia
+ * @param[in,out] worker : stan wątku
+ * @param[in] ok : czy wynik jest poprawny
+ * @param[in] what : nazwa sprawdzanej operacji
+ */
+static void check(WorkerT *worker, bool ok, const char *what) {
+    worker->checks++;
+    if (!ok) {
+        worker->failures++;
+        fprintf(stderr, "FAIL %s\n", what);
+    }
+}
+
+/**
+ * Sprawdza, czy wynik jest równy oczekiwanemu, i go zwalnia
+ * @param[in,out] worker : stan wątku
+ * @param[in] res : wynik
+ * @param[in] expected : oczekiwany wynik
+ * @param[in] what : nazwa sprawdzanej operacji
+ */
+static void checkPoly(WorkerT *worker, Poly res, const Poly *expected,
+                      const char *what) {
+    check(worker, PolyIsEq(&res, expected), what);
+    PolyDestroy(&res);
+}
+
+/**
+ * Usuwa z wielomianu jednomiany stopnia łącznego większego niż @p deg,
+ * przechodząc całe drzewo
+ * @param[in] p : wielomian
+ * @param[in] deg : ograniczenie stopnia łącznego
+ * @return : wielomian bez jednomianów stopnia większego niż @p deg
+ */
+static Poly truncDeg(const Poly *p, poly_exp_t deg) {
+    if (PolyIsCoeff(p)) return PolyClone(p);
+
+    Mono *monos = safeMalloc(p->size * sizeof(Mono));
+    size_t count = 0;
+    for (size_t i = 0; i < p->size; ++i) {
+        poly_exp_t exp = p->arr[i].exp;
+        if (exp > deg) continue;
+        Poly child = truncDeg(&p->arr[i].p, deg - exp);
+        if (PolyIsZero(&child)) PolyDestroy(&child);
+        else monos[count++] = MonoFromPoly(&child, exp);
+    }
+    Poly res = PolyAddMonos(count, monos);
+    safeFree(monos);
+    return res;
+}
+
+/**
+ * Usuwa z wielomianu jednomiany, w których zmienna o indeksie @p var
+ * występuje w potędze większej niż @p deg
+ * @param[in] p : wielomian
+ * @param[in] var : indeks zmiennej
+ * @param[in] deg : ograniczenie stopnia ze względu na zmienną
+ * @return : wielomian bez jednomianów stopnia większego niż @p deg
+ */
+static Poly truncDegBy(const Poly *p, size_t var, poly_exp_t deg) {
+    if (PolyIsCoeff(p)) return PolyClone(p);
+
+    Mono *monos = safeMalloc(p->size * sizeof(Mono));
+    size_t count = 0;
+    for (size_t i = 0; i < p->size; ++i) {
+        if (var == 0 && p->arr[i].exp > deg) continue;
+        Poly child = var == 0 ? PolyClone(&p->arr[i].p)
+                              : truncDegBy(&p->arr[i].p, var - 1, deg);
+        if (PolyIsZero(&child)) PolyDestroy(&child);
+        else monos[count++] = MonoFromPoly(&child, p->arr[i].exp);
+    }
+    Poly res = PolyAddMonos(count, monos);
+    safeFree(monos);
+    return res;
+}
+
+/**
+ * Podnosi liczbę do potęgi modulo @f$2^{64}@f$
+ * @param[in] x : podstawa
+ * @param[in] exp : wykładnik
+ * @return : @f$x^{exp}@f$ modulo @f$2^{64}@f$
+ */
+static uint64_t powWrap(uint64_t x, poly_exp_t exp) {
+    uint64_t res = 1;
+    for (; exp > 0; exp >>= 1) {
+        if (exp & 1) res *= x;
+        x *= x;
+    }
+    return res;
+}
+
+/**
+ * Oblicza wartość wielomianu modulo @f$2^{64}@f$ jako sumę wartości
+ * jednomianów, bez schematu Hornera
+ * @param[in] p : wielomian
+ * @param[in] var : indeks zmiennej pierwszego poziomu @p p
+ * @param[in] nvars : liczba zmiennych w punkcie
+ * @param[in] point : wartości zmiennych; pozostałe mają wartość 0
+ * @return : wartość wielomianu w punkcie
+ */
+static uint64_t evalNaive(const Poly *p, size_t var, size_t nvars,
+                          const uint64_t point[]) {
+    if (PolyIsCoeff(p)) return (uint64_t) p->coeff;
+
+    uint64_t x = var < nvars ? point[var] : 0, res = 0;
+    for (size_t i = 0; i < p->size; ++i)
+        res += powWrap(x, p->arr[i].exp) *
+               evalNaive(&p->arr[i].p, var + 1, nvars, point);
+    return res;
+}
+
+/**
+ * Dodaje wielomian do sumy i go zwalnia
+ * @param[in,out] sum : suma
+ * @param[in] p : dodawany wielomian
+ */
+static void addTo(Poly *sum, Poly p) {
+    Poly next = PolyAdd(sum, &p);
+    PolyDestroy(sum);
+    PolyDestroy(&p);
+    *sum = next;
+}
+
+/**
+ * Tworzy jednomian @f$c x_{var}^{exp}@f$
+ * @param[in] var : indeks zmiennej
+ * @param[in] exp : wykładnik
+ * @param[in] coeff : współczynnik @f$c@f$
+ * @return : jednomian jako wielomian
+ */
+static Poly varPow(size_t var, poly_exp_t exp, poly_coeff_t coeff) {
+    Poly p = PolyFromCoeff(coeff);
+    for (size_t level = var + 1; level-- > 0;) {
+        Mono m = MonoFromPoly(&p, level == var ? exp : 0);
+        p = PolyAddMonos(1, &m);
+    }
+    return p;
+}
+
+/**
+ * Generuje wielomian do podstawienia: sumę dwóch jednomianów
+ * @f$\pm x_j^e@f$ o małych @f$j@f$ i @f$e@f$
+ * @param[in,out] state : stan generatora
+ * @return : wygenerowany wielomian, być może zerowy
+ */
+static Poly genSubst(uint64_t *state) {
+    Poly res = PolyZero();
+    for (int i = 0; i < 2; ++i) {
+        size_t var = randomBelow(state, 3);
+        poly_exp_t exp = (poly_exp_t) randomBelow(state, 3);
+        addTo(&res, varPow(var, exp, randomBelow(state, 2) == 0 ? 1 : -1));
+    }
+    return res;
+}
+
+/**
+ * Składa wielomiany jak PolyCompose, ale każdy jednomian liczy osobno,
+ * a potęgi kolejnymi mnożeniami
+ * @param[in] p : wielomian
+ * @param[in] var : indeks zmiennej pierwszego poziomu @p p
+ * @param[in] k : liczba podstawianych wielomianów
+ * @param[in] q : podstawiane wielomiany
+ * @return : @f$p(q_0, \ldots, q_{k-1}, 0, \ldots)@f$
+ */
+static Poly composeNaive(const Poly *p, size_t var, size_t k,
+                         const Poly q[]) {
+    if (PolyIsCoeff(p)) return PolyClone(p);
+
+    Poly res = PolyZero(), zero = PolyZero();
+    const Poly *base = var < k ? &q[var] : &zero;
+    for (size_t i = 0; i < p->size; ++i) {
+        Poly term = composeNaive(&p->arr[i].p, var + 1, k, q);
+        for (poly_exp_t e = 0; e < p->arr[i].exp; ++e) {
+            Poly next = PolyMul(&term, base);
+            PolyDestroy(&term);
+            term = next;
+        }
+        addTo(&res, term);
+    }
+    return res;
+}
+
+/**
+ * Liczy jednomiany we wszystkich węzłach drzewa wielomianu
+ * @param[in] p : wielomian
+ * @return : liczba jednomianów
+ */
+static size_t countMonos(const Poly *p) {
+    if (PolyIsCoeff(p)) return 0;
+
+    size_t res = p->size;
+    for (size_t i = 0; i < p->size; ++i) res += countMonos(&p->arr[i].p);
+    return res;
+}
+
+/**
+ * Przestawia zmienne jak PolyPermute, ale dodaje do wyniku osobno każdy
+ * jednomian, zbudowany z przestawionych zmiennych mnożeniem
+ * @param[in] p : wielomian
+ * @param[in] var : indeks zmiennej pierwszego poziomu @p p
+ * @param[in] n : liczba przestawianych zmiennych
+ * @param[in] perm : permutacja
+ * @param[in] prefix : iloczyn zmiennych z wyższych poziomów
+ * @param[in,out] res : suma, do której są dodawane jednomiany
+ */
+static void permuteNaive(const Poly *p, size_t var, size_t n,
+                         const size_t perm[], const Poly *prefix,
+                         Poly *res) {
+    if (PolyIsCoeff(p)) {
+        addTo(res, PolyMul(prefix, p));
+        return;
+    }
+
+    for (size_t i = 0; i < p->size; ++i) {
+        Poly x = varPow(var < n ? perm[var] : var, p->arr[i].exp, 1);
+        Poly next = PolyMul(prefix, &x);
+        permuteNaive(&p->arr[i].p, var + 1, n, perm, &next, res);
+        PolyDestroy(&next);
+        PolyDestroy(&x);
+    }
+}
+
+/**
+ * Wykonuje losową operację na wspólnych wielomianach
+ * @param[in,out] worker : stan wątku
+ */
+static void runShared(WorkerT *worker) {
+    const SharedT *s = &shared[randomBelow(&worker->rng, SHARED_PAIRS)];
+    switch (randomBelow(&worker->rng, 12)) {
+        case 0:
+            checkPoly(worker, PolyAdd(&s->p, &s->q), &s->sum, "add");
+            break;
+        case 1: {
+            checkPoly(worker, PolySub(&s->p, &s->q), &s->diff, "sub");
+            // Kopia współdzieli tablice z innymi wątkami, więc odejmowanie
+            // w miejscu musi skopiować te, które zmienia
+            Poly diff = PolyClone(&s->p);
+            PolySubInPlace(&diff, &s->q);
+            checkPoly(worker, diff, &s->diff, "sub_in_place");
+            break;
+        }
+        case 2: {
+            checkPoly(worker, PolyMul(&s->p, &s->q), &s->prod, "mul");
+            if (PolyIsCoeff(&s->q)) break;
+            // Mnożenie w miejscu przez pierwszy jednomian q zmienia kopię p,
+            // która współdzieli tablice z innymi wątkami
+            Mono m = MonoClone(&s->q.arr[0]);
+            Poly mono = PolyAddMonos(1, &m);
+            Poly expected = PolyMul(&s->p, &mono);
+            Poly prod = PolyClone(&s->p);
+            PolyMulByMonoInPlace(&prod, &s->q.arr[0]);
+            checkPoly(worker, prod, &expected, "mul_mono_in_place");
+            PolyDestroy(&expected);
+            PolyDestroy(&mono);
+            break;
+        }
+        case 3:
+            checkPoly(worker, PolyNeg(&s->p), &s->neg, "neg");
+            break;
+        case 4: {
+            int x = (int) randomBelow(&worker->rng, AT_POINTS);
+            checkPoly(worker, PolyAt(&s->p, x - AT_POINTS / 2), &s->at[x],
+                      "at");
+            break;
+        }
+        case 5: {
+            size_t var = randomBelow(&worker->rng, DEG_VARS);
+            check(worker, PolyDeg(&s->p) == s->deg, "deg");
+            check(worker, PolyDegBy(&s->p, var) == s->degBy[var], "deg_by");
+            break;
+        }
+        case 6:
+            check(worker, PolyIsEq(&s->p, &s->q) == s->eq, "is_eq");
+            break;
+        case 7: {
+            // Wynik obciętego mnożenia porównujemy z obciętym pełnym
+            // iloczynem, także dla ograniczeń większych niż jego stopień
+            poly_exp_t deg = (poly_exp_t) randomBelow(
+                    &worker->rng, (uint64_t) PolyDeg(&s->prod) + 2);
+            Poly expected = truncDeg(&s->prod, deg);
+            checkPoly(worker, PolyMulTrunc(&s->p, &s->q, deg), &expected,
+                      "mul_trunc");
+            PolyDestroy(&expected);
+
+            size_t var = randomBelow(&worker->rng, DEG_VARS);
+            deg = (poly_exp_t) randomBelow(
+                    &worker->rng, (uint64_t) PolyDegBy(&s->prod, var) + 2);
+            expected = truncDegBy(&s->prod, var, deg);
+            checkPoly(worker, PolyMulTruncBy(&s->p, &s->q, var, deg),
+                      &expected, "mul_trunc_by");
+            PolyDestroy(&expected);
+            break;
+        }
+        case 8: {
+            // Dowolne wartości, bo obie wersje liczą modulo 2^64; liczba
+            // punktów obejmuje niepełne bloki, a liczba zmiennych także
+            // zmienne, które mają wartość 0
+            size_t npoints = 1 + randomBelow(&worker->rng, EVAL_POINTS);
+            size_t nvars = randomBelow(&worker->rng, DEG_VARS + 3);
+            poly_coeff_t *points =
+                    safeMalloc((nvars * npoints + 1) * sizeof(poly_coeff_t));
+            poly_coeff_t out[EVAL_POINTS];
+            for (size_t i = 0; i < nvars * npoints; ++i)
+                points[i] = (poly_coeff_t) nextRandom(&worker->rng);
+            PolyEvalBatch(&s->p, nvars, points, npoints, out);
+
+            bool ok = true;
+            for (size_t i = 0; i < npoints; ++i) {
+                uint64_t point[DEG_VARS + 2];
+                for (size_t v = 0; v < nvars; ++v)
+                    point[v] = (uint64_t) points[v * npoints + i];
+                ok &= (uint64_t) out[i] == evalNaive(&s->p, 0, nvars, point);
+            }
+            check(worker, ok, "eval_batch");
+            safeFree(points);
+            break;
+        }
+        case 9: {
+            // Losowa permutacja, być może krótsza niż liczba zmiennych
+            size_t n = randomBelow(&worker->rng, MAX_DEPTH + 1);
+            size_t perm[MAX_DEPTH], inverse[MAX_DEPTH];
+            for (size_t i = 0; i < n; ++i) perm[i] = i;
+            for (size_t i = n; i > 1; --i) {
+                size_t j = randomBelow(&worker->rng, i), tmp = perm[i - 1];
+                perm[i - 1] = perm[j];
+                perm[j] = tmp;
+            }
+            for (size_t i = 0; i < n; ++i) inverse[perm[i]] = i;
+
+            Poly expected = PolyZero(), one = PolyFromCoeff(1);
+            permuteNaive(&s->p, 0, n, perm, &one, &expected);
+            Poly permuted = PolyPermute(&s->p, n, perm);
+            check(worker, PolyIsEq(&permuted, &expected), "permute");
+            checkPoly(worker, PolyPermute(&permuted, n, inverse), &s->p,
+                      "permute_inverse");
+            PolyDestroy(&permuted);
+            PolyDestroy(&expected);
+
+            n = PolyDepth(&s->p);
+            size_t monos = PolyBestOrder(&s->p, perm);
+            for (size_t i = 0; i < n; ++i) inverse[perm[i]] = i;
+            permuted = PolyPermute(&s->p, n, perm);
+            check(worker, monos == countMonos(&permuted) &&
+                          monos <= countMonos(&s->p), "best_order");
+            checkPoly(worker, PolyPermute(&permuted, n, inverse), &s->p,
+                      "best_order_inverse");
+            PolyDestroy(&permuted);
+            break;
+        }
+        case 10: {
+            // Iloczyn dzieli się przez każdy z czynników; po dodaniu
+            // jedynki już nie, bo współczynniki q są dodatnie i q != 1
+            Poly quot;
+            bool ok = PolyDivExact(&s->prod, &s->q, &quot);
+            check(worker, ok, "div_exact");
+            if (ok) checkPoly(worker, quot, &s->p, "div_exact_quot");
+            ok = PolyDivExact(&s->prod, &s->p, &quot);
+            check(worker, ok, "div_exact");
+            if (ok) checkPoly(worker, quot, &s->q, "div_exact_quot");
+
+            Poly one = PolyFromCoeff(1), zero = PolyZero();
+            Poly prod1 = PolyAdd(&s->prod, &one);
+            bool exact = PolyDivExact(&prod1, &s->q, &quot);
+            if (exact) PolyDestroy(&quot);
+            check(worker, !exact, "div_not_exact");
+            exact = PolyDivExact(&s->prod, &zero, &quot);
+            if (exact) PolyDestroy(&quot);
+            check(worker, !exact, "div_by_zero");
+            PolyDestroy(&prod1);
+            break;
+        }
+        default:
+            checkPoly(worker, PolyClone(&s->p), &s->p, "clone");
+            break;
+    }
+}
+
+/**
+ * Sprawdza tożsamości algebraiczne na wielomianach wątku
+ * @param[in,out] worker : stan wątku
+ */
+static void runLocal(WorkerT *worker) {
+    const ShapeT *shape = &shapes[randomBelow(&worker->rng, SHARED_PAIRS)];
+    Poly a = genPoly(&worker->rng, shape, shape->depth);
+    Poly b = genPoly(&worker->rng, shape, shape->depth);
+
+    Poly sum = PolyAdd(&a, &b);
+    checkPoly(worker, PolySub(&sum, &b), &a, "add_sub");
+    Poly ab = PolyMul(&a, &b);
+    checkPoly(worker, PolyMul(&b, &a), &ab, "mul_commutative");
+    Poly quot;
+    bool exact = PolyDivExact(&ab, &b, &quot);
+    check(worker, exact, "mul_div");
+    if (exact) checkPoly(worker, quot, &a, "mul_div_quot");
+
+    Poly negA = PolyNeg(&a);
+    Poly zero = PolyZero();
+    checkPoly(worker, PolyAdd(&a, &negA), &zero, "add_neg");
+
+    // Internowane tablice mogą zwalniać inne wątki, więc internują tylko
+    // wątki z alokatorem systemowym
+    if (!worker->slab) {
+        Poly ab2 = PolyMul(&a, &b), ba2 = PolyMul(&b, &a);
+        PolyIntern(&ab2);
+        PolyIntern(&ba2);
+        check(worker, ab2.arr == ba2.arr, "intern_shared");
+        checkPoly(worker, ab2, &ab, "intern_eq");
+        PolyDestroy(&ba2);
+    }
+
+    // Podstawiane wielomiany są małe, więc porównanie z wolną wersją
+    // ma sens tylko dla wielomianów niskiego stopnia
+    if (PolyDeg(&a) <= COMPOSE_MAX_DEG) {
+        size_t k = randomBelow(&worker->rng, COMPOSE_MAX_K + 1);
+        Poly q[COMPOSE_MAX_K];
+        for (size_t i = 0; i < k; ++i) q[i] = genSubst(&worker->rng);
+        Poly expected = composeNaive(&a, 0, k, q);
+        checkPoly(worker, PolyCompose(&a, k, q), &expected, "compose");
+        PolyDestroy(&expected);
+        for (size_t i = 0; i < k; ++i) PolyDestroy(&q[i]);
+    }
+
+    // PolyAddMonos przejmuje a, b i kopię sumy na własność
+    Mono monos[2] = {MonoFromPoly(&a, 1), MonoFromPoly(&b, 1)};
+    Poly sumCopy = PolyClone(&sum);
+    Poly expected = PolyAddMonos(1, (Mono[]) {MonoFromPoly(&sumCopy, 1)});
+    checkPoly(worker, PolyAddMonos(2, monos), &expected, "add_monos");
+
+    PolyDestroy(&sum);
+    PolyDestroy(&ab);
+    PolyDestroy(&negA);
+    PolyDestroy(&expected);
+}
+
+/**
+ * Główna funkcja wątku testującego
+ * @param[in] arg : stan wątku
+ * @return : NULL
+ */
+static void *runWorker(void *arg) {
+    WorkerT *worker = arg;
+    if (worker->slab) AllocatorSet(&SlabAllocator);
+
+    for (size_t i = 0; i < worker->iterations; ++i) {
+        if (randomBelow(&worker->rng, 4) == 0) runLocal(worker);
+        else runShared(worker);
+    }
+    return NULL;
+}
+
+/** Opcje programu
+ */
+static const struct option options[] = {
+        {"threads", required_argument, NULL, 't'},
+        {"iterations", required_argument, NULL, 'i'},
+        {"seed", required_argument, NULL, 's'},
+        {NULL, 0, NULL, 0}
+};
+
+int main(int argc, char **argv) {
+    uint64_t seed = DEFAULT_SEED;
+    size_t threads = DEFAULT_THREADS, iterations = DEFAULT_ITERATIONS;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        if (opt == 't') {
+            threads = strtoull(optarg, NULL, 10);
+            if (threads == 0 || threads > MAX_THREADS) {
+                fprintf(stderr, "ERROR WRONG VALUE %s\n", optarg);
+                return 1;
+            }
+        } else if (opt == 'i') {
+            iterations = strtoull(optarg, NULL, 10);
+        } else if (opt == 's') {
+            seed = strtoull(optarg, NULL, 10);
+        } else {
+            return 1;
+        }
+    }
+
+    initShared(seed);
+
+    WorkerT workers[MAX_THREADS];
+    for (size_t i = 0; i < threads; ++i) {
+        workers[i] = (WorkerT) {.rng = seed + SHARED_PAIRS + i,
+                                .iterations = iterations, .slab = i % 2 == 1};
+        if (pthread_create(&workers[i].thread, NULL, runWorker,
+                           &workers[i]) != 0)
+            exit(1);
+    }
+
+    size_t checks = 0, failures = 0;
+    for (size_t i = 0; i < threads; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        checks += workers[i].checks;
+        failures += workers[i].failures;
+    }
+    destroyShared();
+
+    printf("%zu threads, %zu checks, %zu failures\n", threads, checks,
+           failures);
+    return failures == 0 ? 0 : 1;
+}
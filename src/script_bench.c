@@ -0,0 +1,396 @@
+/** @file
+ * Pomiar wydajności całego kalkulatora na skryptach. Program generuje
+ * skrypty o różnym charakterze (dużo parsowania, dużo mnożenia, dużo
+ * wyliczania wartości, głęboki stos) lub odtwarza nagrany skrypt i dla
+ * każdego z nich podaje liczbę linii na sekundę, największe zużycie pamięci
+ * oraz percentyle czasu wykonania poszczególnych komend. Każdy skrypt jest
+ * wykonywany w osobnym procesie, więc zużycie pamięci dotyczy tylko jego.
+ *
+ * Użycie: poly_script_bench [--seed N] [--lines N] [--json] [--replay PLIK]...
+ *                          [FILTR]
+ *
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#define _GNU_SOURCE
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "input.h"
+#include "poly_parser.h"
+
+/** Domyślne ziarno generatora liczb losowych
+ */
+#define DEFAULT_SEED 2021
+
+/** Domyślna liczba linii generowanego skryptu
+ */
+#define DEFAULT_LINES 200000
+
+/** Maksymalna liczba odtwarzanych skryptów
+ */
+#define MAX_REPLAYS 16
+
+/** Stan generatora liczb losowych
+ */
+static uint64_t rngState;
+
+/**
+ * Generator liczb pseudolosowych splitmix64
+ * @return : kolejna liczba losowa
+ */
+static uint64_t nextRandom(void) {
+    uint64_t z = (rngState += UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return z ^ (z >> 31);
+}
+
+/**
+ * Losuje liczbę z przedziału [0, n)
+ * @param[in] n : długość przedziału
+ * @return : wylosowana liczba
+ */
+static uint64_t randomBelow(uint64_t n) {
+    return nextRandom() % n;
+}
+
+/**
+ * Wypisuje losowy wielomian w formacie wejścia kalkulatora
+ * @param[in] out : strumień wyjściowy
+ * @param[in] depth : liczba zmiennych
+ * @param[in] width : liczba jednomianów na każdym poziomie
+ */
+static void writePoly(FILE *out, int depth, size_t width) {
+    if (depth == 0) {
+        fprintf(out, "%d", (int) randomBelow(19) - 9);
+        return;
+    }
+
+    unsigned exp = (unsigned) randomBelow(3);
+    for (size_t i = 0; i < width; ++i) {
+        if (i > 0) fputc('+', out);
+        fputc('(', out);
+        writePoly(out, depth - 1, width);
+        fprintf(out, ",%u)", exp);
+        exp += 1 + (unsigned) randomBelow(3);
+    }
+}
+
+/**
+ * Generuje skrypt złożony głównie z dużych wielomianów do sparsowania
+ * @param[in] out : strumień wyjściowy
+ * @param[in] lines : przybliżona liczba linii
+ */
+static void genParseHeavy(FILE *out, size_t lines) {
+    for (size_t i = 0; i < lines; i += 2) {
+        writePoly(out, 2, 8);
+        fputs("\nPOP\n", out);
+    }
+}
+
+/**
+ * Generuje skrypt złożony głównie z mnożeń
+ * @param[in] out : strumień wyjściowy
+ * @param[in] lines : przybliżona liczba linii
+ */
+static void genMulHeavy(FILE *out, size_t lines) {
+    for (size_t i = 0; i < lines; i += 7) {
+        writePoly(out, 2, 3);
+        fputc('\n', out);
+        writePoly(out, 2, 3);
+        fputs("\nMUL\nCLONE\nMUL\nDEG\nPOP\n", out);
+    }
+}
+
+/**
+ * Generuje skrypt złożony głównie z wyliczania wartości wielomianów
+ * @param[in] out : strumień wyjściowy
+ * @param[in] lines : przybliżona liczba linii
+ */
+static void genAtHeavy(FILE *out, size_t lines) {
+    for (size_t i = 0; i < lines; i += 26) {
+        writePoly(out, 3, 4);
+        fputc('\n', out);
+        for (int j = 0; j < 8; ++j)
+            fprintf(out, "CLONE\nAT %d\nPOP\n", (int) randomBelow(21) - 10);
+        fputs("POP\n", out);
+    }
+}
+
+/**
+ * Generuje skrypt, który wkłada na stos wszystkie wielomiany, zanim zacznie
+ * je sumować
+ * @param[in] out : strumień wyjściowy
+ * @param[in] lines : przybliżona liczba linii
+ */
+static void genDeepStack(FILE *out, size_t lines) {
+    size_t count = lines / 2;
+    for (size_t i = 0; i < count; ++i) {
+        writePoly(out, 1, 2);
+        fputc('\n', out);
+    }
+    for (size_t i = 1; i < count; ++i) fputs("ADD\n", out);
+    fputs("DEG\nPRINT\nPOP\n", out);
+}
+
+/**
+ * Generowany skrypt
+ */
+typedef struct CorpusT {
+    const char *name;                       ///< nazwa skryptu
+    void (*generate)(FILE *, size_t);       ///< generator skryptu
+} CorpusT;
+
+/** Generowane skrypty
+ */
+static const CorpusT corpora[] = {
+        {"parse-heavy", genParseHeavy},
+        {"mul-heavy", genMulHeavy},
+        {"at-heavy", genAtHeavy},
+        {"deep-stack", genDeepStack},
+};
+
+/**
+ * Czasy wykonania komend jednego rodzaju
+ */
+typedef struct LatenciesT {
+    uint64_t *arr;      ///< czasy w nanosekundach
+    size_t size;        ///< rozmiar tablicy
+    size_t count;       ///< liczba zapisanych czasów
+} LatenciesT;
+
+/**
+ * Zwraca bieżący czas w nanosekundach
+ * @return : czas w nanosekundach
+ */
+static uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Dopisuje czas wykonania komendy
+ * @param[in] lat : czasy wykonania komend danego rodzaju
+ * @param[in] ns : czas w nanosekundach
+ */
+static void addLatency(LatenciesT *lat, uint64_t ns) {
+    if (lat->count == lat->size) {
+        lat->size = 2 * lat->size + 16;
+        lat->arr = safeRealloc(lat->arr, lat->size * sizeof(uint64_t));
+    }
+    lat->arr[lat->count++] = ns;
+}
+
+/**
+ * Porównuje dwie liczby na potrzeby qsort
+ * @param[in] a : wskaźnik na pierwszą liczbę
+ * @param[in] b : wskaźnik na drugą liczbę
+ * @return : wynik porównania
+ */
+static int compareU64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Zwraca percentyl posortowanych czasów
+ * @param[in] lat : posortowane czasy
+ * @param[in] pct : percentyl
+ * @return : czas w nanosekundach
+ */
+static uint64_t percentile(const LatenciesT *lat, unsigned pct) {
+    return lat->arr[(lat->count - 1) * pct / 100];
+}
+
+/**
+ * Wykonuje skrypt, mierząc czas każdej komendy, i wypisuje raport.
+ * Wywoływana w procesie potomnym.
+ * @param[in] name : nazwa skryptu
+ * @param[in] path : ścieżka do skryptu
+ * @param[in] json : czy raport ma być w formacie JSON
+ * @param[in] first : czy to pierwszy raport
+ * @return : czy udało się otworzyć skrypt
+ */
+static bool runScript(const char *name, const char *path, bool json,
+                      bool first) {
+    InputT input;
+    if (!InputInit(&input, path)) return false;
+
+    StackT stack = StackInit(INIT_STACK_SIZE);
+    stack.out = stack.err = fopen("/dev/null", "w");
+    if (stack.out == NULL) exit(1);
+
+    LatenciesT lat[COMMAND_KINDS] = {{0}};
+    size_t currLine = 1;
+    ssize_t lineLen;
+    char *buffer;
+    CommandT comm;
+
+    uint64_t start = nowNs();
+    while ((lineLen = InputGetLine(&input, &buffer)) != -1) {
+        uint64_t commStart = nowNs();
+        parseLine(buffer, lineLen, currLine, &comm);
+        if (comm.kind != COMM_NONE) {
+            CommandKindT kind = comm.kind;
+            executeCommand(&stack, &comm);
+            addLatency(&lat[kind], nowNs() - commStart);
+        }
+        currLine++;
+    }
+    double seconds = (double) (nowNs() - start) / 1e9;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double linesPerSec = (double) (currLine - 1) / seconds;
+
+    if (json)
+        printf("%s\n    {\"name\": \"%s\", \"lines\": %zu, \"seconds\": %.3f, "
+               "\"lines_per_sec\": %.0f, \"peak_rss_kb\": %ld, "
+               "\"commands\": {", first ? "" : ",", name, currLine - 1,
+               seconds, linesPerSec, usage.ru_maxrss);
+    else
+        printf("%s: %zu lines in %.3f s, %.0f lines/s, peak RSS %ld KB\n"
+               "  %-12s %10s %10s %10s %10s %12s\n", name, currLine - 1,
+               seconds, linesPerSec, usage.ru_maxrss, "command", "count",
+               "p50 ns", "p90 ns", "p99 ns", "max ns");
+
+    bool firstKind = true;
+    for (int k = 0; k < COMMAND_KINDS; ++k) {
+        if (lat[k].count == 0) continue;
+        qsort(lat[k].arr, lat[k].count, sizeof(uint64_t), compareU64);
+        if (json)
+            printf("%s\"%s\": {\"count\": %zu, \"p50_ns\": %" PRIu64
+                   ", \"p90_ns\": %" PRIu64 ", \"p99_ns\": %" PRIu64
+                   ", \"max_ns\": %" PRIu64 "}",
+                   firstKind ? "" : ", ", CommandName(k), lat[k].count,
+                   percentile(&lat[k], 50), percentile(&lat[k], 90),
+                   percentile(&lat[k], 99), lat[k].arr[lat[k].count - 1]);
+        else
+            printf("  %-12s %10zu %10" PRIu64 " %10" PRIu64 " %10" PRIu64
+                   " %12" PRIu64 "\n", CommandName(k),
+                   lat[k].count, percentile(&lat[k], 50),
+                   percentile(&lat[k], 90), percentile(&lat[k], 99),
+                   lat[k].arr[lat[k].count - 1]);
+        firstKind = false;
+        safeFree(lat[k].arr);
+    }
+    if (json) printf("}}");
+    fflush(stdout);
+
+    fclose(stack.out);
+    InputDestroy(&input);
+    StackDestroy(&stack);
+    return true;
+}
+
+/**
+ * Wykonuje skrypt w procesie potomnym. Jeśli @p corpus nie jest równe
+ * NULL, proces potomny najpierw generuje skrypt do pliku tymczasowego.
+ * @param[in] name : nazwa skryptu
+ * @param[in] path : ścieżka do skryptu lub NULL dla skryptu generowanego
+ * @param[in] corpus : generator skryptu lub NULL
+ * @param[in] lines : liczba linii generowanego skryptu
+ * @param[in] json : czy raport ma być w formacie JSON
+ * @param[in] first : czy to pierwszy raport
+ * @return : czy skrypt został wykonany
+ */
+static bool benchScript(const char *name, const char *path,
+                        const CorpusT *corpus, size_t lines, bool json,
+                        bool first) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) return false;
+
+    if (pid == 0) {
+        char tmpPath[] = "/tmp/poly_script_bench_XXXXXX";
+        if (corpus != NULL) {
+            int fd = mkstemp(tmpPath);
+            FILE *file = fd < 0 ? NULL : fdopen(fd, "w");
+            if (file == NULL) _exit(1);
+            corpus->generate(file, lines);
+            if (fclose(file) != 0) _exit(1);
+            path = tmpPath;
+        }
+        bool res = runScript(name, path, json, first);
+        if (corpus != NULL) unlink(tmpPath);
+        _exit(res ? 0 : 1);
+    }
+
+    int status;
+    return waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+           WEXITSTATUS(status) == 0;
+}
+
+/** Opcje programu
+ */
+static const struct option options[] = {
+        {"seed", required_argument, NULL, 's'},
+        {"lines", required_argument, NULL, 'l'},
+        {"replay", required_argument, NULL, 'r'},
+        {"json", no_argument, NULL, 'j'},
+        {NULL, 0, NULL, 0}
+};
+
+int main(int argc, char **argv) {
+    uint64_t seed = DEFAULT_SEED;
+    size_t lines = DEFAULT_LINES, replayCount = 0;
+    const char *replays[MAX_REPLAYS];
+    bool json = false;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        if (opt == 's') {
+            seed = strtoull(optarg, NULL, 10);
+        } else if (opt == 'l') {
+            lines = strtoull(optarg, NULL, 10);
+        } else if (opt == 'r') {
+            if (replayCount == MAX_REPLAYS) {
+                fprintf(stderr, "ERROR TOO MANY REPLAYS\n");
+                return 1;
+            }
+            replays[replayCount++] = optarg;
+        } else if (opt == 'j') {
+            json = true;
+        } else {
+            return 1;
+        }
+    }
+    const char *filter = optind < argc ? argv[optind] : NULL;
+
+    if (json)
+        printf("{\n  \"seed\": %" PRIu64 ",\n  \"results\": [", seed);
+
+    bool first = true, res = true;
+    // Nagrane skrypty zastępują generowane
+    if (replayCount > 0) {
+        for (size_t i = 0; i < replayCount; ++i) {
+            if (benchScript(replays[i], replays[i], NULL, 0, json, first)) {
+                first = false;
+            } else {
+                fprintf(stderr, "ERROR CANNOT OPEN %s\n", replays[i]);
+                res = false;
+            }
+        }
+    } else {
+        for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); ++i) {
+            if (filter != NULL && strstr(corpora[i].name, filter) == NULL)
+                continue;
+            rngState = seed + i;
+            res = benchScript(corpora[i].name, NULL, &corpora[i], lines, json,
+                              first) && res;
+            first = false;
+        }
+    }
+
+    if (json) printf("\n  ]\n}\n");
+    return res ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+/** @file
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#define _GNU_SOURCE
+
+#include "server.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "input.h"
+#include "poly_parser.h"
+
+/**
+ * Ustawienia sesji, wspólne dla wszystkich połączeń
+ */
+typedef struct SessionConfigT {
+    size_t memLimit;            ///< limit pamięci sesji
+    unsigned idleTimeout;       ///< limit bezczynności sesji w sekundach
+    const char *restorePath;    ///< zapisany stos lub NULL
+} SessionConfigT;
+
+/** Ustawienia sesji, tylko do odczytu po uruchomieniu serwera
+ */
+static SessionConfigT sessionConfig;
+
+/** Czy serwer otrzymał sygnał zakończenia
+ */
+static volatile sig_atomic_t stopRequested;
+
+/**
+ * Obsługa sygnałów kończących działanie serwera
+ * @param[in] sig : numer sygnału
+ */
+static void requestStop(int sig) {
+    (void) sig;
+    stopRequested = 1;
+}
+
+/**
+ * Obsługuje jedną sesję: wykonuje komendy z gniazda na własnym stosie.
+ * Deskryptor gniazda jest przekazywany bezpośrednio w argumencie, dzięki
+ * czemu cała pamięć sesji jest alokowana i zwalniana przez jej wątek.
+ * @param[in] arg : deskryptor gniazda
+ * @return : NULL
+ */
+static void *sessionMain(void *arg) {
+    int fd = (int) (intptr_t) arg;
+
+    struct timeval timeout = {.tv_sec = sessionConfig.idleTimeout};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // Wyniki i błędy trafiają do klienta tym samym strumieniem, linia po linii
+    FILE *out = fdopen(dup(fd), "w");
+    if (out == NULL) {
+        close(fd);
+        return NULL;
+    }
+    setvbuf(out, NULL, _IOLBF, 0);
+
+    // Komenda przekraczająca limit pamięci sesji jest wycofywana, a sesja
+    // działa dalej
+    MemBudgetT budget;
+    MemBudgetInit(&budget, sessionConfig.memLimit);
+    MemBudgetAttach(&budget);
+
+    InputT input;
+    InputInitFd(&input, fd);
+    StackT stack = StackInit(INIT_STACK_SIZE);
+    stack.out = stack.err = out;
+    stack.noFiles = true;
+
+    if (sessionConfig.restorePath == NULL ||
+        StackLoad(&stack, sessionConfig.restorePath))
+        parseInput(&stack, &input);
+    else
+        fprintf(out, "ERROR CANNOT RESTORE %s\n", sessionConfig.restorePath);
+
+    StackDestroy(&stack);
+    InputDestroy(&input);
+    MemBudgetAttach(NULL);
+    fclose(out);
+    return NULL;
+}
+
+/**
+ * Uruchamia wątek obsługujący sesję
+ * @param[in] fd : deskryptor gniazda połączenia
+ */
+static void startSession(int fd) {
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, sessionMain, (void *) (intptr_t) fd) != 0)
+        close(fd);
+    pthread_attr_destroy(&attr);
+}
+
+/**
+ * Usuwa plik gniazda, jeśli istnieje. Pliki innego rodzaju zostają, więc
+ * pomyłka w ścieżce nie usunie np. zwykłego pliku.
+ * @param[in] path : ścieżka do gniazda
+ */
+static void unlinkSocket(const char *path) {
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+}
+
+bool runServer(const char *path, size_t memLimit, unsigned idleTimeout,
+               const char *restorePath) {
+    sessionConfig = (SessionConfigT) {.memLimit = memLimit,
+                                      .idleTimeout = idleTimeout,
+                                      .restorePath = restorePath};
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) return false;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    unlinkSocket(path);
+    // Połączyć się z gniazdem może tylko właściciel. Plik gniazda dostaje
+    // prawa już przy tworzeniu, a inne wątki jeszcze nie działają, więc
+    // zmiana maski procesu na czas bind niczego innego nie dotyczy.
+    mode_t mask = umask(S_IRWXG | S_IRWXO | S_IXUSR);
+    bool bound = bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0;
+    umask(mask);
+    if (!bound || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return false;
+    }
+
+    // Zapis do rozłączonego klienta nie może zakończyć całego serwera.
+    // Sygnały kończące są blokowane przed utworzeniem wątków sesji, które
+    // dziedziczą maskę, i odblokowywane tylko na czas ppoll, więc zawsze
+    // przerywają oczekiwanie na połączenie w głównym wątku.
+    sigset_t stopSignals, waitMask;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, &waitMask);
+    sigdelset(&waitMask, SIGINT);
+    sigdelset(&waitMask, SIGTERM);
+
+    struct sigaction action = {.sa_handler = requestStop};
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    struct pollfd listener = {.fd = fd, .events = POLLIN};
+    while (!stopRequested) {
+        if (ppoll(&listener, 1, NULL, &waitMask) < 0) {
+            if (errno != EINTR) break;
+            continue;
+        }
+        int client = accept(fd, NULL, NULL);
+        if (client >= 0) startSession(client);
+        else if (errno != EINTR && errno != ECONNABORTED) break;
+    }
+
+    close(fd);
+    unlinkSocket(path);
+    return true;
+}
@@ -0,0 +1,35 @@
+/** @file
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#ifndef POLYNOMIALS_SERVER_H
+#define POLYNOMIALS_SERVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Uruchamia kalkulator jako serwer nasłuchujący na gnieździe domeny Unix.
+ * Każde połączenie jest osobną sesją z własnym stosem, obsługiwaną przez
+ * osobny wątek. Sesja wczytuje komendy w tym samym formacie co kalkulator,
+ * a wyniki i komunikaty o błędach odsyła w kolejności wykonania komend.
+ * Sesja jest zamykana, gdy klient zamknie połączenie albo nie przyśle
+ * żadnych danych przez @p idleTimeout sekund. Komenda, która przekroczy
+ * limit pamięci sesji, jest wycofywana z błędem OUT OF MEMORY, a sesja
+ * działa dalej. Sesje nie mają dostępu do plików: komendy DUMP, LOAD,
+ * SAVE_STACK i LOAD_STACK kończą się błędem FILE ACCESS DENIED. Gniazdo
+ * jest tworzone z prawami dostępu tylko dla właściciela.
+ * Serwer kończy działanie po otrzymaniu sygnału SIGINT lub SIGTERM, które
+ * w wątkach sesji są zablokowane. Istniejący plik gniazda pod ścieżką
+ * @p path jest zastępowany, a plik innego rodzaju nie.
+ * @param[in] path : ścieżka do gniazda
+ * @param[in] memLimit : limit pamięci sesji w bajtach (0 oznacza brak limitu)
+ * @param[in] idleTimeout : limit bezczynności sesji w sekundach (0 oznacza brak limitu)
+ * @param[in] restorePath : zapisany stos wczytywany na początku sesji lub NULL
+ * @return : czy udało się utworzyć gniazdo
+ */
+extern bool runServer(const char *path, size_t memLimit, unsigned idleTimeout,
+                      const char *restorePath);
+
+#endif //POLYNOMIALS_SERVER_H
@@ -3,7 +3,48 @@
  * @date 2021
  */
 
+#define _GNU_SOURCE
+
 #include "stack_operations.h"
+#include "poly_fingerprint.h"
+#include "poly_internal.h"
+#include "poly_eval.h"
+#include "poly_permute.h"
+#include "poly_serialize.h"
+#include "pipeline.h"
+#include "stats.h"
+#include "trace.h"
+
+void PrintError(StackT *stack, size_t w, const char *error) {
+    if (stack->output != NULL) {
+        *stack->output = (OutputT) {.kind = OUT_ERROR, .line = w,
+                                    .error = error};
+    } else {
+        fprintf(stack->err, "ERROR %zu %s\n", w, error);
+    }
+}
+
+/**
+ * Zdejmuje wielomian z wierzchołka stosu i go usuwa
+ * @param[in] stack : stos
+ */
+static void popDestroy(StackT *stack) {
+    Poly p = Pop(stack);
+    PolyDestroy(&p);
+}
+
+/**
+ * Wypisuje wynik komendy będący liczbą
+ * @param[in] stack : stos
+ * @param[in] num : wynik
+ */
+static void printNumber(StackT *stack, long num) {
+    if (stack->output != NULL) {
+        *stack->output = (OutputT) {.kind = OUT_NUMBER, .num = num};
+    } else {
+        fprintf(stack->out, "%ld\n", num);
+    }
+}
 
 void Zero(StackT *stack) {
     Push(stack, PolyZero());
@@ -12,18 +53,18 @@ void Zero(StackT *stack) {
 void isCoeff(StackT *stack, size_t w) {
     if (!isEmpty(*stack)) {
         Poly p = Top(*stack);
-        fprintf(stdout, "%d\n", isPolyCoeffRec(&p));
+        printNumber(stack, isPolyCoeffRec(&p));
     } else {
-        fprintf(stderr, "ERROR %ld STACK UNDERFLOW\n", w);
+        PrintError(stack, w, "STACK UNDERFLOW");
     }
 }
 
 void isZero(StackT *stack, size_t w) {
     if (!isEmpty(*stack)) {
         Poly p = Top(*stack);
-        fprintf(stdout, "%d\n", isPolyZeroRec(&p));
+        printNumber(stack, isPolyZeroRec(&p));
     } else {
-        fprintf(stderr, "ERROR %ld STACK UNDERFLOW\n", w);
+        PrintError(stack, w, "STACK UNDERFLOW");
     }
 
 }
@@ -34,74 +75,232 @@ void Clone(StackT *stack, size_t w) {
         Poly res = PolyClone(&p);
         Push(stack, res);
     } else {
-        fprintf(stderr, "ERROR %ld STACK UNDERFLOW\n", w);
+        PrintError(stack, w, "STACK UNDERFLOW");
     }
 }
 
 void Add(StackT *stack, size_t w) {
     if (has2Polys(*stack)) {
-        Poly p1 = Pop(stack), p2 = Pop(stack);
+        Poly p1 = Top(*stack), p2 = GetSecondPoly(stack);
         Poly res = PolyAdd(&p1, &p2);
-        PolyDestroy(&p1);
-        PolyDestroy(&p2);
+        popDestroy(stack);
+        popDestroy(stack);
         Push(stack, res);
     } else {
-        fprintf(stderr, "ERROR %ld STACK UNDERFLOW\n", w);
+        PrintError(stack, w, "STACK UNDERFLOW");
     }
 }
 
+/**
+ * Sprawdza, czy wielomian jest pojedynczym jednomianem
+ * @param[in] p : wielomian
+ * @return : czy @p p jest pojedynczym jednomianem
+ */
+static bool isSingleMono(const Poly *p) {
+    return !PolyIsCoeff(p) && p->size == 1;
+}
+
 void Mul(StackT *stack, size_t w) {
     if (has2Polys(*stack)) {
-        Poly p1 = Pop(stack), p2 = Pop(stack);
+        // Bez limitu pamięci komenda nie może zostać wycofana, więc mnożenie
+        // przez jednomian może zmieniać drugi z wielomianów w miejscu
+        if (MemBudgetCurrent()->limit == 0) {
+            Poly p1 = Top(*stack), p2 = GetSecondPoly(stack);
+            if (isSingleMono(&p2)) {
+                p1 = Pop(stack);
+                PolyMulByMonoInPlace(&p1, &p2.arr[0]);
+                popDestroy(stack);
+                Push(stack, p1);
+                return;
+            }
+            if (isSingleMono(&p1)) {
+                p1 = Pop(stack);
+                p2 = Pop(stack);
+                PolyMulByMonoInPlace(&p2, &p1.arr[0]);
+                PolyDestroy(&p1);
+                Push(stack, p2);
+                return;
+            }
+        }
+        Poly p1 = Top(*stack), p2 = GetSecondPoly(stack);
         Poly res = PolyMul(&p1, &p2);
-        PolyDestroy(&p1);
-        PolyDestroy(&p2);
+        popDestroy(stack);
+        popDestroy(stack);
+        Push(stack, res);
+    } else {
+        PrintError(stack, w, "STACK UNDERFLOW");
+    }
+}
+
+void MulTrunc(StackT *stack, size_t w, poly_exp_t deg, bool byVar,
+              size_t idx) {
+    if (has2Polys(*stack)) {
+        Poly p1 = Top(*stack), p2 = GetSecondPoly(stack);
+        Poly res = byVar ? PolyMulTruncBy(&p1, &p2, idx, deg)
+                         : PolyMulTrunc(&p1, &p2, deg);
+        popDestroy(stack);
+        popDestroy(stack);
         Push(stack, res);
     } else {
-        fprintf(stderr, "ERROR %ld STACK UNDERFLOW\n", w);
+        PrintError(stack, w, "STACK UNDERFLOW");
     }
 }
 
+void Compose(StackT *stack, size_t w, unsigned long long k) {
+    if (k < StackSize(*stack)) {
+        Poly p = Top(*stack);
+        Poly *q = k > 0 ? safeMalloc(k * sizeof(Poly)) : NULL;
+        for (size_t i = 0; i < k; ++i) q[k - 1 - i] = StackGet(stack, i + 1);
+        Poly res = PolyCompose(&p, k, q);
+        safeFree(q);
+        for (size_t i = 0; i <= k; ++i) popDestroy(stack);
+        Push(stack, res);
+    } else {
+        PrintError(stack, w, "STACK UNDERFLOW");
+    }
+}
+
+void Permute(StackT *stack, size_t w, size_t n, const size_t *perm) {
+    if (!isEmpty(*stack)) {
+        Poly p1 = Top(*stack);
+        Poly res = PolyPermute(&p1, n, perm);
+        popDestroy(stack);
+        Push(stack, res);
+    } else {
+        PrintError(stack, w, "STACK UNDERFLOW");
+    }
+}
+
+void PermuteAuto(StackT *stack, size_t w) {
+    if (isEmpty(*stack)) {
+        PrintError(stack, w, "STACK UNDERFLOW");
+        return;
+    }
+
+    // Wielomian stały nie ma zmiennych do przestawienia, więc nie ma też
+    // czego wypisać
+    Poly p1 = Top(*stack);
+    size_t n = PolyDepth(&p1);
+    if (n == 0) return;
+
+    size_t *perm = safeMalloc(n * sizeof(size_t));
+    PolyBestOrder(&p1, perm);
+    Poly res = PolyPermute(&p1, n, perm);
+
+    // Strumień jest otwierany przed zmianą stosu, więc brak pamięci
+    // wycofuje komendę, nie zmieniając stosu
+    OutputT item = {.kind = OUT_NUMBERS};
+    size_t len;
+    FILE *out = stack->out;
+    if (stack->output != NULL) {
+        out = open_memstream(&item.text, &len);
+        if (out == NULL) MemFail();
+    }
+    popDestroy(stack);
+    Push(stack, res);
+
+    for (size_t i = 0; i < n; ++i) {
+        fprintf(out, i + 1 < n ? "%zu " : "%zu", perm[i]);
+    }
+    fputc('\n', out);
+    if (stack->output != NULL) {
+        fclose(out);
+        *stack->output = item;
+    }
+    safeFree(perm);
+}
+
 void Neg(StackT *stack, size_t w) {
     if (!isEmpty(*stack)) {
-        Poly p1 = Pop(stack);
+        Poly p1 = Top(*stack);
         Poly res = PolyNeg(&p1);
-        PolyDestroy(&p1);
+        popDestroy(stack);
         Push(stack, res);
     } else {
-        fprintf(stderr, "ERROR %ld STACK UNDERFLOW\n", w);
+        PrintError(stack, w, "STACK UNDERFLOW");
     }
 }
 
 void Sub(StackT *stack, size_t w) {
     if (has2Polys(*stack)) {
-        Poly p1 = Pop(stack), p2 = Pop(stack);
+        // Bez limitu pamięci komenda nie może zostać wycofana, więc można
+        // odejmować w miejscu, zmieniając wielomian z wierzchołka
+        if (MemBudgetCurrent()->limit == 0) {
+            Poly p1 = Pop(stack), p2 = Top(*stack);
+            PolySubInPlace(&p1, &p2);
+            popDestroy(stack);
+            Push(stack, p1);
+            return;
+        }
+        Poly p1 = Top(*stack), p2 = GetSecondPoly(stack);
         Poly res = PolySub(&p1, &p2);
-        PolyDestroy(&p1);
-        PolyDestroy(&p2);
+        popDestroy(stack);
+        popDestroy(stack);
         Push(stack, res);
         return;
     } else {
-        fprintf(stderr, "ERROR %ld STACK UNDERFLOW\n", w);
+        PrintError(stack, w, "STACK UNDERFLOW");
         return;
     }
 }
 
+void Div(StackT *stack, size_t w) {
+    if (!has2Polys(*stack)) {
+        PrintError(stack, w, "STACK UNDERFLOW");
+        return;
+    }
+
+    Poly p1 = Top(*stack), p2 = GetSecondPoly(stack), res;
+    if (PolyIsZero(&p2)) {
+        PrintError(stack, w, "DIV BY ZERO");
+    } else if (!PolyDivExact(&p1, &p2, &res)) {
+        PrintError(stack, w, "DIV NOT EXACT");
+    } else {
+        popDestroy(stack);
+        popDestroy(stack);
+        Push(stack, res);
+    }
+}
+
 void isEq(StackT *stack, size_t w) {
     if (has2Polys(*stack)) {
         Poly p1 = GetSecondPoly(stack), p2 = Top(*stack);
-        fprintf(stdout, "%d\n", PolyIsEq(&p1, &p2));
+        printNumber(stack, PolyIsEq(&p1, &p2));
+    } else {
+        PrintError(stack, w, "STACK UNDERFLOW");
+    }
+}
+
+/** Ziarno punktów komendy IS_EQ_FAST
+ */
+static uint64_t eqFastSeed = FINGERPRINT_DEFAULT_SEED;
+
+/** Czy komenda IS_EQ_FAST sprawdza równe odciski dokładnie
+ */
+static bool eqFastExact = false;
+
+void SetEqFastOptions(uint64_t seed, bool exact) {
+    eqFastSeed = seed;
+    eqFastExact = exact;
+}
+
+void isEqFast(StackT *stack, size_t w) {
+    if (has2Polys(*stack)) {
+        Poly p1 = GetSecondPoly(stack), p2 = Top(*stack);
+        bool eq = PolyFingerprintEq(&p1, &p2, eqFastSeed);
+        if (eq && eqFastExact) eq = PolyIsEq(&p1, &p2);
+        printNumber(stack, eq);
     } else {
-        fprintf(stderr, "ERROR %ld STACK UNDERFLOW\n", w);
+        PrintError(stack, w, "STACK UNDERFLOW");
     }
 }
 
 void Deg(StackT *stack, size_t w) {
     if (!isEmpty(*stack)) {
         Poly p = Top(*stack);
-        fprintf(stdout, "%d\n", PolyDeg(&p));
+        printNumber(stack, PolyDeg(&p));
     } else {
-        fprintf(stderr, "ERROR %ld STACK UNDERFLOW\n", w);
+        PrintError(stack, w, "STACK UNDERFLOW");
         return;
     }
 }
@@ -109,66 +308,92 @@ void Deg(StackT *stack, size_t w) {
 void DegBy(StackT *stack, size_t w, size_t idx) {
     if (!isEmpty(*stack)) {
         Poly p = Top(*stack);
-        fprintf(stdout, "%d\n", PolyDegBy(&p, idx));
+        printNumber(stack, PolyDegBy(&p, idx));
     } else {
-        fprintf(stderr, "ERROR %ld STACK UNDERFLOW\n", w);
+        PrintError(stack, w, "STACK UNDERFLOW");
         return;
     }
 }
 
 void At(StackT *stack, size_t w, long long x) {
     if (!isEmpty(*stack)) {
-        Poly p = Pop(stack);
+        Poly p = Top(*stack);
         Poly res = PolyAt(&p, x);
-        PolyDestroy(&p);
+        popDestroy(stack);
         Push(stack, res);
     } else {
-        fprintf(stderr, "ERROR %ld STACK UNDERFLOW\n", w);
+        PrintError(stack, w, "STACK UNDERFLOW");
         return;
     }
 }
 
+void EvalBatch(StackT *stack, size_t w, size_t nvars,
+               const poly_coeff_t *points, size_t npoints) {
+    if (isEmpty(*stack)) {
+        PrintError(stack, w, "STACK UNDERFLOW");
+        return;
+    }
+
+    Poly p = Top(*stack);
+    poly_coeff_t *values = safeMalloc(npoints * sizeof(poly_coeff_t));
+    PolyEvalBatch(&p, nvars, points, npoints, values);
+
+    OutputT item = {.kind = OUT_NUMBERS};
+    size_t len;
+    FILE *out = stack->out;
+    if (stack->output != NULL) {
+        out = open_memstream(&item.text, &len);
+        if (out == NULL) MemFail();
+    }
+    for (size_t i = 0; i < npoints; ++i) {
+        fprintf(out, "%ld\n", values[i]);
+    }
+    if (stack->output != NULL) {
+        fclose(out);
+        *stack->output = item;
+    }
+    safeFree(values);
+}
+
 /**
- * Wypisuje jednomian na standardowe wejście
+ * Wypisuje jednomian do strumienia
+ * @param[in] out : strumień wyjściowy
  * @param[in] m : jednomian
  */
-static void PrintMono(Mono *m);
+static void PrintMono(FILE *out, Mono *m);
 
 
-/**
- * Wypisuje wielomian na standardowe wejście
- * @param[in] p : wielomian
- */
-static void PrintPoly(Poly *p) {
+void PrintPoly(FILE *out, Poly *p) {
+    TRACE_BEGIN(TRACE_PRINT, mark);
     if (isPolyCoeffRec(p))
-        printf("%ld", getCoeff(p));
+        fprintf(out, "%ld", getCoeff(p));
     else {
         if (p->size == 1) {
-            PrintMono(&p->arr[0]);
-            return;
-        }
-        for (size_t i = 0; i < p->size; i++) {
-            PrintMono(&p->arr[i]);
-            if (i != p->size - 1 && p->size != 1)
-                printf("+");
+            PrintMono(out, &p->arr[0]);
+        } else {
+            for (size_t i = 0; i < p->size; i++) {
+                PrintMono(out, &p->arr[i]);
+                if (i != p->size - 1 && p->size != 1)
+                    fputc('+', out);
+            }
         }
     }
+    TRACE_END(TRACE_PRINT, mark);
 }
 
-static void PrintMono(Mono *m) {
-    printf("(");
-    PrintPoly(&m->p);
-    printf(",%d)", m->exp);
+static void PrintMono(FILE *out, Mono *m) {
+    fputc('(', out);
+    PrintPoly(out, &m->p);
+    fprintf(out, ",%d)", m->exp);
 }
 
 
 
 void PopInstr(StackT *stack, size_t w) {
     if (!isEmpty(*stack)) {
-        Poly p = Pop(stack);
-        PolyDestroy(&p);
+        StackDrop(stack);
     } else {
-        fprintf(stderr, "ERROR %ld STACK UNDERFLOW\n", w);
+        PrintError(stack, w, "STACK UNDERFLOW");
         return;
     }
 }
@@ -176,10 +401,55 @@ void PopInstr(StackT *stack, size_t w) {
 void PrintStack(StackT *stack, size_t w) {
     if (!isEmpty(*stack)) {
         Poly p = Top(*stack);
-        PrintPoly(&p);
-        printf("\n");
+        if (stack->output != NULL) {
+            Poly clone = PolyClone(&p);
+            *stack->output = (OutputT) {.kind = OUT_POLY, .p = clone};
+        } else {
+            PrintPoly(stack->out, &p);
+            fputc('\n', stack->out);
+        }
     } else {
-        fprintf(stderr, "ERROR %ld STACK UNDERFLOW\n", w);
+        PrintError(stack, w, "STACK UNDERFLOW");
         return;
     }
-}
\ No newline at end of file
+}
+
+void Dump(StackT *stack, size_t w, const char *path) {
+    if (!isEmpty(*stack)) {
+        Poly p = Top(*stack);
+        if (!PolyWriteFile(&p, path))
+            PrintError(stack, w, "DUMP WRONG FILE");
+    } else {
+        PrintError(stack, w, "STACK UNDERFLOW");
+    }
+}
+
+void Load(StackT *stack, size_t w, const char *path) {
+    Poly p;
+    if (PolyReadFile(path, &p)) Push(stack, p);
+    else PrintError(stack, w, "LOAD WRONG FILE");
+}
+
+void SaveStack(StackT *stack, size_t w, const char *path) {
+    if (!StackSave(stack, path))
+        PrintError(stack, w, "SAVE STACK WRONG FILE");
+}
+
+void LoadStack(StackT *stack, size_t w, const char *path) {
+    if (!StackLoad(stack, path))
+        PrintError(stack, w, "LOAD STACK WRONG FILE");
+}
+
+void Stats(StackT *stack) {
+    if (stack->output != NULL) {
+        OutputT item = {.kind = OUT_TEXT};
+        size_t len;
+        FILE *text = open_memstream(&item.text, &len);
+        if (text == NULL) MemFail();
+        StatsPrint(text, CommandNames, COMMAND_KINDS);
+        fclose(text);
+        *stack->output = item;
+    } else {
+        StatsPrint(stack->err, CommandNames, COMMAND_KINDS);
+    }
+}
@@ -6,9 +6,25 @@
 #ifndef POLYNOMIALS_STACK_OPERATIONS_H
 #define POLYNOMIALS_STACK_OPERATIONS_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include "poly_stack.h"
 
+/**
+ * Wypisuje komunikat o błędzie w danej linii
+ * @param[in] stack : stos
+ * @param[in] w : nr wczytywanej linii
+ * @param[in] error : komunikat o błędzie
+ */
+extern void PrintError(StackT *stack, size_t w, const char *error);
+
+/**
+ * Wypisuje wielomian do strumienia
+ * @param[in] out : strumień wyjściowy
+ * @param[in] p : wielomian
+ */
+extern void PrintPoly(FILE *out, Poly *p);
+
 /**
  * Wkłada na stos wielomian zerowy
  * @param[in] stack
@@ -55,6 +71,49 @@ extern void Add(StackT *stack, size_t w);
  */
 extern void Mul(StackT *stack, size_t w);
 
+/**
+ * Mnoży dwa wielomiany z wierzchu stosu, zachowując tylko jednomiany
+ * stopnia co najwyżej deg (łącznego albo ze względu na zmienną o indeksie
+ * idx), usuwa je i wstawia na wierzchołek stosu obcięty iloczyn;
+ * @param[in] stack : stos
+ * @param[in] w : nr wczytywanej linii
+ * @param[in] deg : ograniczenie stopnia
+ * @param[in] byVar : czy ograniczenie dotyczy jednej zmiennej
+ * @param[in] idx : indeks zmiennej (gdy @p byVar)
+ */
+extern void MulTrunc(StackT *stack, size_t w, poly_exp_t deg, bool byVar,
+                     size_t idx);
+
+/**
+ * Zdejmuje z wierzchołka stosu wielomian p, a potem wielomiany
+ * q[k - 1], ..., q[0] i wstawia na wierzchołek stosu ich złożenie
+ * (zob. PolyCompose);
+ * @param[in] stack : stos
+ * @param[in] w : nr wczytywanej linii
+ * @param[in] k : liczba podstawianych wielomianów
+ */
+extern void Compose(StackT *stack, size_t w, unsigned long long k);
+
+/**
+ * Zastępuje wielomian z wierzchołka stosu wielomianem z przestawionymi
+ * zmiennymi: zmienna x_i staje się zmienną x_perm[i] (zob. PolyPermute);
+ * @param[in] stack : stos
+ * @param[in] w : nr wczytywanej linii
+ * @param[in] n : liczba przestawianych zmiennych
+ * @param[in] perm : permutacja
+ */
+extern void Permute(StackT *stack, size_t w, size_t n, const size_t *perm);
+
+/**
+ * Przestawia zmienne wielomianu z wierzchołka stosu w kolejności wybranej
+ * przez PolyBestOrder i wypisuje na standardowe wyjście użytą permutację
+ * (w jednej linii, rozdzieloną spacjami). Dla wielomianu stałego nic się
+ * nie zmienia i nic nie jest wypisywane.
+ * @param[in] stack : stos
+ * @param[in] w : nr wczytywanej linii
+ */
+extern void PermuteAuto(StackT *stack, size_t w);
+
 /**
  * Neguje wielomian na wierzchołku stosu
  * @param[in] stack : stos
@@ -70,6 +129,16 @@ extern void Neg(StackT *stack, size_t w);
  */
 extern void Sub(StackT *stack, size_t w);
 
+/**
+ * Dzieli wielomian z wierzchołka przez wielomian pod wierzchołkiem, usuwa je
+ * i wstawia na wierzchołek stosu iloraz. Jeśli dzielnik jest zerowy lub
+ * dzielenie nie jest dokładne (zob. PolyDivExact), wypisuje błąd i nie
+ * zmienia stosu;
+ * @param[in] stack : stos
+ * @param[in] w : nr wczytywanej linii
+ */
+extern void Div(StackT *stack, size_t w);
+
 /**
  * Sprawdza, czy dwa wielomiany na wierzchu stosu są równe – wypisuje na
  * standardowe wyjście 0 lub 1;
@@ -78,6 +147,24 @@ extern void Sub(StackT *stack, size_t w);
  */
 extern void isEq(StackT *stack, size_t w);
 
+/**
+ * Sprawdza, czy dwa wielomiany na wierzchu stosu są równe, porównując ich
+ * odciski (zob. poly_fingerprint.h) – wypisuje na standardowe wyjście 0 lub
+ * 1. Wynik 0 jest zawsze poprawny, wynik 1 jest poprawny z dużym
+ * prawdopodobieństwem, chyba że włączono sprawdzanie dokładne.
+ * @param[in] stack : stos
+ * @param[in] w : nr wczytywanej linii
+ */
+extern void isEqFast(StackT *stack, size_t w);
+
+/**
+ * Ustawia parametry komendy IS_EQ_FAST dla wszystkich stosów. Należy je
+ * ustawić przed uruchomieniem innych wątków.
+ * @param[in] seed : ziarno punktów, w których liczone są odciski
+ * @param[in] exact : czy równe odciski sprawdzać dokładnie przez PolyIsEq
+ */
+extern void SetEqFastOptions(uint64_t seed, bool exact);
+
 /**
  * Wypisuje na standardowe wyjście stopień wielomianu
  * (−1 dla wielomianu tożsamościowo równego zeru);
@@ -95,6 +182,18 @@ extern void Deg(StackT *stack, size_t w);
  */
 extern void DegBy(StackT *stack, size_t w, size_t idx);
 
+/**
+ * Wypisuje na standardowe wyjście wartości wielomianu z wierzchołka stosu
+ * w kolejnych punktach, każdą w osobnej linii (zob. PolyEvalBatch);
+ * @param[in] stack : stos
+ * @param[in] w : nr wczytywanej linii
+ * @param[in] nvars : liczba zmiennych w punkcie
+ * @param[in] points : wartości zmiennych, kolumnami
+ * @param[in] npoints : liczba punktów
+ */
+extern void EvalBatch(StackT *stack, size_t w, size_t nvars,
+                      const poly_coeff_t *points, size_t npoints);
+
 /**
  * Wylicza wartość wielomianu w punkcie x, usuwa wielomian z wierzchołka
  * i wstawia na stos wynik operacji;
@@ -105,7 +204,9 @@ extern void DegBy(StackT *stack, size_t w, size_t idx);
 extern void At(StackT *stack, size_t w, long long x);
 
 /**
- * Usuwa wielomian z wierzchołka stosu.
+ * Usuwa wielomian z wierzchołka stosu. Wielomian wczytany komendą
+ * LOAD_STACK nie jest odczytywany z pliku, więc w ten sposób można usunąć
+ * także wielomian o uszkodzonym zapisie.
  * @param[in] stack : stos
  * @param[in] w : nr wczytywanej linii
  */
@@ -118,4 +219,45 @@ extern void PopInstr(StackT *stack, size_t w);
  */
 extern void PrintStack(StackT *stack, size_t w);
 
+/**
+ * Zapisuje wielomian z wierzchołka stosu do pliku w formacie binarnym
+ * @param[in] stack : stos
+ * @param[in] w : nr wczytywanej linii
+ * @param[in] path : ścieżka do pliku
+ */
+extern void Dump(StackT *stack, size_t w, const char *path);
+
+/**
+ * Wczytuje wielomian zapisany komendą DUMP i wstawia go na stos
+ * @param[in] stack : stos
+ * @param[in] w : nr wczytywanej linii
+ * @param[in] path : ścieżka do pliku
+ */
+extern void Load(StackT *stack, size_t w, const char *path);
+
+/**
+ * Zapisuje cały stos do pliku, stos pozostaje bez zmian
+ * @param[in] stack : stos
+ * @param[in] w : nr wczytywanej linii
+ * @param[in] path : ścieżka do pliku
+ */
+extern void SaveStack(StackT *stack, size_t w, const char *path);
+
+/**
+ * Wkłada na stos wielomiany ze stosu zapisanego komendą SAVE_STACK. Zapisy
+ * wielomianów są sprawdzane dopiero przy ich pierwszym użyciu; komenda,
+ * która użyłaby wielomianu o uszkodzonym zapisie, nie jest wykonywana
+ * i wypisuje błąd WRONG STACK POLY.
+ * @param[in] stack : stos
+ * @param[in] w : nr wczytywanej linii
+ * @param[in] path : ścieżka do pliku
+ */
+extern void LoadStack(StackT *stack, size_t w, const char *path);
+
+/**
+ * Wypisuje na standardowe wyjście błędów statystyki wykonania (zob. stats.h)
+ * @param[in] stack : stos
+ */
+extern void Stats(StackT *stack);
+
 #endif //POLYNOMIALS_STACK_OPERATIONS_H
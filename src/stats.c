@@ -0,0 +1,176 @@
+/** @file
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#define _GNU_SOURCE
+
+#include "stats.h"
+#include "input.h"
+
+/**
+ * Wypisuje zużycie pamięci z budżetu bieżącego wątku
+ * @param[in] out : strumień wyjściowy
+ */
+static void printMemory(FILE *out) {
+    MemBudgetT *budget = MemBudgetCurrent();
+    fprintf(out, "mem_used %zu\nmem_peak %zu\nmem_limit %zu\n",
+            atomic_load_explicit(&budget->used, memory_order_relaxed),
+            atomic_load_explicit(&budget->peak, memory_order_relaxed),
+            budget->limit);
+}
+
+#ifdef POLY_STATS
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** Nazwy liczników
+ */
+static const char *const statNames[STAT_COUNT] = {
+        [STAT_POLY_ADD] = "poly_add",
+        [STAT_POLY_MUL] = "poly_mul",
+        [STAT_POLY_MUL_TRUNC] = "poly_mul_trunc",
+        [STAT_POLY_ADD_MONOS] = "poly_add_monos",
+        [STAT_POLY_AT] = "poly_at",
+        [STAT_POLY_COMPOSE] = "poly_compose",
+        [STAT_COMPOSE_POW_HITS] = "compose_pow_hits",
+        [STAT_POLY_PERMUTE] = "poly_permute",
+        [STAT_POLY_DIV] = "poly_div",
+        [STAT_POLY_IS_EQ] = "poly_is_eq",
+        [STAT_POLY_CLONE] = "poly_clone_nodes",
+        [STAT_COW_COPIES] = "cow_copies",
+        [STAT_INTERNED] = "interned",
+        [STAT_INTERN_HITS] = "intern_hits",
+        [STAT_NODES_ALLOCATED] = "nodes_allocated",
+        [STAT_NODES_FREED] = "nodes_freed",
+        [STAT_SORTS] = "sorts",
+        [STAT_SORTED_MONOS] = "sorted_monos",
+        [STAT_MAX_SORT] = "max_sort",
+        [STAT_ALLOCS] = "allocs",
+        [STAT_FREES] = "frees",
+        [STAT_ALLOC_BYTES] = "alloc_bytes",
+        [STAT_PUSHES] = "stack_pushes",
+        [STAT_POPS] = "stack_pops",
+        [STAT_STACK_EXPANSIONS] = "stack_expansions",
+        [STAT_MATERIALIZED] = "stack_materialized",
+        [STAT_LINES] = "lines",
+        [STAT_PARSED_POLYS] = "parsed_polys",
+        [STAT_PARSE_ERRORS] = "parse_errors",
+        [STAT_PARSE_NS] = "parse_ns",
+};
+
+_Thread_local StatsT *threadStats;
+
+/** Liczniki wszystkich wątków, które kiedykolwiek je używały
+ */
+static StatsT *allStats;
+
+/** Liczniki zakończonych wątków gotowe do ponownego użycia
+ */
+static StatsT *freeStats;
+
+/** Chroni listy @p allStats i @p freeStats
+ */
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Klucz, którego destruktor oddaje liczniki kończącego się wątku
+ */
+static pthread_key_t statsKey;
+
+/** Zapewnia jednokrotne utworzenie @p statsKey
+ */
+static pthread_once_t statsKeyOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Oddaje liczniki kończącego się wątku do ponownego użycia
+ * @param[in] arg : liczniki wątku
+ */
+static void releaseStats(void *arg) {
+    StatsT *stats = arg;
+    pthread_mutex_lock(&statsMutex);
+    stats->nextFree = freeStats;
+    freeStats = stats;
+    pthread_mutex_unlock(&statsMutex);
+}
+
+/**
+ * Tworzy klucz wątku
+ */
+static void createKey(void) {
+    if (pthread_key_create(&statsKey, releaseStats) != 0) exit(1);
+}
+
+StatsT *StatsRegister(void) {
+    pthread_once(&statsKeyOnce, createKey);
+
+    pthread_mutex_lock(&statsMutex);
+    StatsT *stats = freeStats;
+    if (stats != NULL) {
+        freeStats = stats->nextFree;
+    } else {
+        // Liczniki nie mogą być liczone przez safeCalloc, który sam
+        // zwiększa liczniki
+        stats = calloc(1, sizeof(StatsT));
+        if (stats == NULL) exit(1);
+        stats->next = allStats;
+        allStats = stats;
+    }
+    pthread_mutex_unlock(&statsMutex);
+
+    threadStats = stats;
+    pthread_setspecific(statsKey, stats);
+    return stats;
+}
+
+uint64_t StatsNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void StatsPrint(FILE *out, const char *const *commandNames, size_t kinds) {
+    unsigned long long counters[STAT_COUNT] = {0};
+    unsigned long long calls[STATS_MAX_COMMANDS] = {0};
+    unsigned long long ns[STATS_MAX_COMMANDS] = {0};
+    if (kinds > STATS_MAX_COMMANDS) kinds = STATS_MAX_COMMANDS;
+
+    pthread_mutex_lock(&statsMutex);
+    for (StatsT *stats = allStats; stats != NULL; stats = stats->next) {
+        for (int i = 0; i < STAT_COUNT; ++i) {
+            unsigned long long value = atomic_load_explicit(
+                    &stats->counters[i], memory_order_relaxed);
+            if (i == STAT_MAX_SORT)
+                counters[i] = value > counters[i] ? value : counters[i];
+            else
+                counters[i] += value;
+        }
+        for (size_t i = 0; i < kinds; ++i) {
+            calls[i] += atomic_load_explicit(&stats->commandCalls[i],
+                                             memory_order_relaxed);
+            ns[i] += atomic_load_explicit(&stats->commandNs[i],
+                                          memory_order_relaxed);
+        }
+    }
+    pthread_mutex_unlock(&statsMutex);
+
+    for (int i = 0; i < STAT_COUNT; ++i)
+        fprintf(out, "%s %llu\n", statNames[i], counters[i]);
+    for (size_t i = 0; i < kinds; ++i) {
+        if (calls[i] > 0)
+            fprintf(out, "command %s %llu calls %llu ns\n", commandNames[i],
+                    calls[i], ns[i]);
+    }
+    printMemory(out);
+}
+
+#else
+
+void StatsPrint(FILE *out, const char *const *commandNames, size_t kinds) {
+    (void) commandNames;
+    (void) kinds;
+    printMemory(out);
+}
+
+#endif
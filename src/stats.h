@@ -0,0 +1,167 @@
+/** @file
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#ifndef POLYNOMIALS_STATS_H
+#define POLYNOMIALS_STATS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** Największa liczba rodzajów komend, dla których liczony jest czas
+ */
+#define STATS_MAX_COMMANDS 32
+
+/**
+ * Liczniki zbierane przez kalkulator
+ */
+typedef enum StatT {
+    STAT_POLY_ADD,          ///< wywołania PolyAdd
+    STAT_POLY_MUL,          ///< wywołania PolyMul
+    STAT_POLY_MUL_TRUNC,    ///< wywołania PolyMulTrunc i PolyMulTruncBy
+    STAT_POLY_ADD_MONOS,    ///< wywołania PolyAddMonos
+    STAT_POLY_AT,           ///< wywołania PolyAt
+    STAT_POLY_COMPOSE,      ///< wywołania PolyCompose
+    STAT_COMPOSE_POW_HITS,  ///< potęgi w PolyCompose wzięte z pamięci podręcznej
+    STAT_POLY_PERMUTE,      ///< wywołania PolyPermute
+    STAT_POLY_DIV,          ///< wywołania PolyDivExact
+    STAT_POLY_IS_EQ,        ///< wywołania PolyIsEq
+    STAT_POLY_CLONE,        ///< skopiowane niestałe wielomiany
+    STAT_COW_COPIES,        ///< prywatne kopie współdzielonych tablic jednomianów
+    STAT_INTERNED,          ///< tablice jednomianów wpisane do tablicy internowanych
+    STAT_INTERN_HITS,       ///< tablice jednomianów zastąpione internowanymi
+    STAT_NODES_ALLOCATED,   ///< zaalokowane tablice jednomianów
+    STAT_NODES_FREED,       ///< zwolnione tablice jednomianów
+    STAT_SORTS,             ///< wywołania qsort
+    STAT_SORTED_MONOS,      ///< łączna liczba sortowanych jednomianów
+    STAT_MAX_SORT,          ///< największa liczba sortowanych jednomianów
+    STAT_ALLOCS,            ///< alokacje pamięci
+    STAT_FREES,             ///< zwolnienia pamięci
+    STAT_ALLOC_BYTES,       ///< łączna liczba zaalokowanych bajtów
+    STAT_PUSHES,            ///< wielomiany włożone na stos
+    STAT_POPS,              ///< wielomiany zdjęte ze stosu
+    STAT_STACK_EXPANSIONS,  ///< powiększenia tablicy stosu
+    STAT_MATERIALIZED,      ///< wielomiany odczytane z zapisanego stosu
+    STAT_LINES,             ///< sparsowane linie (bez komentarzy)
+    STAT_PARSED_POLYS,      ///< sparsowane wielomiany
+    STAT_PARSE_ERRORS,      ///< linie z błędem
+    STAT_PARSE_NS,          ///< czas parsowania w nanosekundach
+    STAT_COUNT,             ///< liczba liczników
+} StatT;
+
+/**
+ * Liczniki jednego wątku. Każdy licznik zmienia tylko jego wątek, więc
+ * zwiększenie licznika to zwykły odczyt i zapis, a atomowość chroni tylko
+ * wątek odczytujący statystyki przed odczytem częściowo zapisanej wartości.
+ */
+typedef struct StatsT {
+    atomic_ullong counters[STAT_COUNT];                 ///< liczniki
+    atomic_ullong commandCalls[STATS_MAX_COMMANDS];     ///< wykonania komend
+    atomic_ullong commandNs[STATS_MAX_COMMANDS];        ///< czas wykonania komend
+    struct StatsT *next;                                ///< następne liczniki na liście wszystkich liczników
+    struct StatsT *nextFree;                            ///< następne liczniki na liście wolnych liczników
+} StatsT;
+
+#ifdef POLY_STATS
+
+/** Liczniki bieżącego wątku lub NULL, jeśli wątek jeszcze ich nie używał
+ */
+extern _Thread_local StatsT *threadStats;
+
+/**
+ * Rejestruje liczniki bieżącego wątku. Liczniki zakończonych wątków są
+ * używane ponownie przez nowe wątki, więc ich wartości nie giną.
+ * @return : liczniki bieżącego wątku
+ */
+extern StatsT *StatsRegister(void);
+
+/**
+ * Zwraca liczniki bieżącego wątku
+ * @return : liczniki bieżącego wątku
+ */
+static inline StatsT *StatsLocal(void) {
+    return threadStats != NULL ? threadStats : StatsRegister();
+}
+
+/**
+ * Zwiększa licznik wątku
+ * @param[in] counter : licznik
+ * @param[in] n : wartość, o którą zwiększamy licznik
+ */
+static inline void StatsBump(atomic_ullong *counter, unsigned long long n) {
+    atomic_store_explicit(counter, atomic_load_explicit(
+            counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+/**
+ * Zwiększa licznik, jeśli jego wartość jest mniejsza od podanej
+ * @param[in] counter : licznik
+ * @param[in] n : wartość
+ */
+static inline void StatsBumpMax(atomic_ullong *counter, unsigned long long n) {
+    if (atomic_load_explicit(counter, memory_order_relaxed) < n)
+        atomic_store_explicit(counter, n, memory_order_relaxed);
+}
+
+/**
+ * Zwraca bieżący czas w nanosekundach
+ * @return : czas w nanosekundach
+ */
+extern uint64_t StatsNow(void);
+
+/** Zwiększa licznik o podaną wartość
+ */
+#define STAT_ADD(stat, n) StatsBump(&StatsLocal()->counters[stat], (n))
+
+/** Zwiększa licznik o 1
+ */
+#define STAT_INC(stat) STAT_ADD(stat, 1)
+
+/** Zapamiętuje największą z podanych wartości
+ */
+#define STAT_MAX(stat, n) StatsBumpMax(&StatsLocal()->counters[stat], (n))
+
+/** Zapamiętuje bieżący czas w zmiennej @p var
+ */
+#define STAT_TIME_START(var) uint64_t var = StatsNow()
+
+/** Dodaje czas, który upłynął od STAT_TIME_START, do licznika
+ */
+#define STAT_TIME_END(stat, var) STAT_ADD(stat, StatsNow() - (var))
+
+/** Zapisuje wykonanie komendy danego rodzaju, która rozpoczęła się
+ * w chwili zapamiętanej przez STAT_TIME_START
+ */
+#define STAT_COMMAND(kind, var)                                         \
+  do {                                                                  \
+    StatsT *stats_ = StatsLocal();                                      \
+    StatsBump(&stats_->commandCalls[kind], 1);                          \
+    StatsBump(&stats_->commandNs[kind], StatsNow() - (var));            \
+  } while (0)
+
+#else
+
+#define STAT_ADD(stat, n) ((void) 0)
+#define STAT_INC(stat) ((void) 0)
+#define STAT_MAX(stat, n) ((void) 0)
+#define STAT_TIME_START(var) ((void) 0)
+#define STAT_TIME_END(stat, var) ((void) 0)
+#define STAT_COMMAND(kind, var) ((void) 0)
+
+#endif
+
+/**
+ * Wypisuje sumę liczników wszystkich wątków (jeśli statystyki nie są
+ * wyłączone przy kompilacji), a następnie bieżące i najwyższe zużycie pamięci
+ * oraz limit budżetu bieżącego wątku
+ * @param[in] out : strumień wyjściowy
+ * @param[in] commandNames : nazwy rodzajów komend
+ * @param[in] kinds : liczba rodzajów komend (co najwyżej #STATS_MAX_COMMANDS)
+ */
+extern void StatsPrint(FILE *out, const char *const *commandNames,
+                       size_t kinds);
+
+#endif //POLYNOMIALS_STATS_H
@@ -0,0 +1,219 @@
+/** @file
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#define _GNU_SOURCE
+
+#include "trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** Liczba zdarzeń buforowanych przez wątek przed zapisem do pliku
+ */
+#define TRACE_BUFFER_EVENTS 4096
+
+/** Znacznik fazy, która nie jest zapisywana, bo jest zagnieżdżona
+ */
+#define TRACE_SUPPRESSED 1
+
+/** Nazwy faz obliczeń
+ */
+static const char *const phaseNames[TRACE_PHASES] = {
+        [TRACE_MULTIPLY] = "multiply",
+        [TRACE_SORT] = "sort",
+        [TRACE_COMBINE] = "combine",
+        [TRACE_CANONICALISE] = "canonicalise",
+        [TRACE_PRINT] = "print",
+        [TRACE_PARSE] = "parse",
+};
+
+/**
+ * Zbuforowane zdarzenie: wykonanie komendy lub faza obliczeń
+ */
+typedef struct TraceEventT {
+    TraceCommandT comm;     ///< parametry komendy (name równe NULL dla fazy)
+    TracePhaseT phase;      ///< faza obliczeń
+    uint64_t start;         ///< czas rozpoczęcia
+    uint64_t end;           ///< czas zakończenia
+} TraceEventT;
+
+/**
+ * Bufor zdarzeń jednego wątku
+ */
+typedef struct TraceBufferT {
+    TraceEventT events[TRACE_BUFFER_EVENTS];    ///< zdarzenia
+    size_t count;                               ///< liczba zdarzeń
+    unsigned tid;                               ///< numer wątku w pliku
+    bool active[TRACE_PHASES];                  ///< czy faza jest zapisywana
+    unsigned suppressed;                        ///< liczba pominiętych otwartych faz
+} TraceBufferT;
+
+atomic_bool traceEnabled;
+
+/** Plik ze zdarzeniami lub NULL
+ */
+static FILE *traceFile;
+
+/** Czy do pliku nie zapisano jeszcze żadnego zdarzenia
+ */
+static bool firstEvent;
+
+/** Czas rozpoczęcia zapisu zdarzeń
+ */
+static uint64_t traceEpoch;
+
+/** Chroni plik ze zdarzeniami
+ */
+static pthread_mutex_t traceMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** Klucz, którego destruktor zapisuje zdarzenia kończącego się wątku
+ */
+static pthread_key_t traceKey;
+
+/** Numer kolejnego wątku
+ */
+static atomic_uint nextTid;
+
+/** Bufor zdarzeń bieżącego wątku
+ */
+static _Thread_local TraceBufferT *threadBuffer;
+
+uint64_t TraceNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Zapisuje zdarzenia z bufora do pliku i opróżnia bufor
+ * @param[in] buffer : bufor zdarzeń
+ */
+static void flushBuffer(TraceBufferT *buffer) {
+    pthread_mutex_lock(&traceMutex);
+    for (size_t i = 0; i < buffer->count && traceFile != NULL; ++i) {
+        TraceEventT *e = &buffer->events[i];
+        double ts = (double) (e->start - traceEpoch) / 1000.0;
+        double dur = (double) (e->end - e->start) / 1000.0;
+
+        fprintf(traceFile, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                           "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u",
+                firstEvent ? "" : ",",
+                e->comm.name != NULL ? e->comm.name : phaseNames[e->phase],
+                e->comm.name != NULL ? "command" : "phase", ts, dur,
+                buffer->tid);
+        if (e->comm.name != NULL)
+            fprintf(traceFile, ",\"args\":{\"line\":%zu,\"arg1_terms\":%ld,"
+                               "\"arg1_depth\":%ld,\"arg2_terms\":%ld,"
+                               "\"arg2_depth\":%ld,\"result_terms\":%ld}",
+                    e->comm.line, e->comm.argTerms[0], e->comm.argDepth[0],
+                    e->comm.argTerms[1], e->comm.argDepth[1],
+                    e->comm.resultTerms);
+        fputc('}', traceFile);
+        firstEvent = false;
+    }
+    pthread_mutex_unlock(&traceMutex);
+    buffer->count = 0;
+}
+
+/**
+ * Zapisuje zdarzenia kończącego się wątku i zwalnia jego bufor
+ * @param[in] arg : bufor zdarzeń wątku
+ */
+static void releaseBuffer(void *arg) {
+    flushBuffer(arg);
+    free(arg);
+}
+
+/**
+ * Zwraca bufor zdarzeń bieżącego wątku. Bufory nie są liczone przez
+ * safeMalloc, żeby śledzenie nie zmieniało limitów pamięci sesji.
+ * @return : bufor zdarzeń
+ */
+static TraceBufferT *localBuffer(void) {
+    if (threadBuffer == NULL) {
+        threadBuffer = calloc(1, sizeof(TraceBufferT));
+        if (threadBuffer == NULL) exit(1);
+        threadBuffer->tid = atomic_fetch_add(&nextTid, 1) + 1;
+        pthread_setspecific(traceKey, threadBuffer);
+    }
+    return threadBuffer;
+}
+
+/**
+ * Dodaje zdarzenie do bufora bieżącego wątku
+ * @param[in] event : zdarzenie
+ */
+static void addEvent(const TraceEventT *event) {
+    TraceBufferT *buffer = localBuffer();
+    if (buffer->count == TRACE_BUFFER_EVENTS) flushBuffer(buffer);
+    buffer->events[buffer->count++] = *event;
+}
+
+bool TraceStart(const char *path) {
+    traceFile = fopen(path, "w");
+    if (traceFile == NULL) return false;
+    if (pthread_key_create(&traceKey, releaseBuffer) != 0) exit(1);
+
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", traceFile);
+    firstEvent = true;
+    traceEpoch = TraceNow();
+    atomic_store(&traceEnabled, true);
+    return true;
+}
+
+void TraceStop(void) {
+    atomic_store(&traceEnabled, false);
+    if (threadBuffer != NULL) flushBuffer(threadBuffer);
+
+    pthread_mutex_lock(&traceMutex);
+    if (traceFile != NULL) {
+        fputs("\n]}\n", traceFile);
+        fclose(traceFile);
+        traceFile = NULL;
+    }
+    pthread_mutex_unlock(&traceMutex);
+}
+
+uint64_t TraceBegin(TracePhaseT phase) {
+    TraceBufferT *buffer = localBuffer();
+    if (buffer->suppressed > 0 || buffer->active[phase]) {
+        buffer->suppressed++;
+        return TRACE_SUPPRESSED;
+    }
+    buffer->active[phase] = true;
+    return TraceNow();
+}
+
+void TraceEnd(TracePhaseT phase, uint64_t mark) {
+    TraceBufferT *buffer = localBuffer();
+    if (mark == TRACE_SUPPRESSED) {
+        buffer->suppressed--;
+        return;
+    }
+
+    buffer->active[phase] = false;
+    TraceEventT event = {.phase = phase, .start = mark, .end = TraceNow()};
+    addEvent(&event);
+}
+
+void TraceAbort(void) {
+    if (threadBuffer == NULL) return;
+    for (int i = 0; i < TRACE_PHASES; ++i) threadBuffer->active[i] = false;
+    threadBuffer->suppressed = 0;
+}
+
+void TraceCommand(const TraceCommandT *comm, uint64_t start) {
+    TraceEventT event = {.comm = *comm, .start = start, .end = TraceNow()};
+    addEvent(&event);
+}
+
+long TraceTerms(const Poly *p) {
+    if (PolyIsCoeff(p)) return 1;
+
+    long res = 0;
+    for (size_t i = 0; i < p->size; ++i) res += TraceTerms(&p->arr[i].p);
+    return res;
+}
@@ -0,0 +1,117 @@
+/** @file
+ * @author Patryk Bundyra
+ * @date 2021
+ */
+
+#ifndef POLYNOMIALS_TRACE_H
+#define POLYNOMIALS_TRACE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "poly.h"
+
+/**
+ * Fazy obliczeń zapisywane jako zagnieżdżone przedziały czasu
+ */
+typedef enum TracePhaseT {
+    TRACE_MULTIPLY,         ///< mnożenie jednomianów w PolyMul
+    TRACE_SORT,             ///< sortowanie jednomianów w PolyAddMonos
+    TRACE_COMBINE,          ///< łączenie jednomianów o równych wykładnikach
+    TRACE_CANONICALISE,     ///< usuwanie zer i sprowadzanie do stałej
+    TRACE_PRINT,            ///< wypisywanie wielomianu
+    TRACE_PARSE,            ///< parsowanie linii wejścia
+    TRACE_PHASES,           ///< liczba faz
+} TracePhaseT;
+
+/**
+ * Parametry komendy zapisywane w zdarzeniu
+ */
+typedef struct TraceCommandT {
+    const char *name;   ///< nazwa komendy
+    size_t line;        ///< nr linii wejścia
+    long argTerms[2];   ///< liczba jednomianów argumentów lub -1
+    long argDepth[2];   ///< głębokość argumentów lub -1
+    long resultTerms;   ///< liczba jednomianów wyniku lub -1
+} TraceCommandT;
+
+/** Czy zdarzenia są zapisywane
+ */
+extern atomic_bool traceEnabled;
+
+/**
+ * Sprawdza, czy zdarzenia są zapisywane. Gdy zapis jest wyłączony, jest to
+ * cały koszt śledzenia.
+ * @return : czy zdarzenia są zapisywane
+ */
+static inline bool TraceOn(void) {
+    return atomic_load_explicit(&traceEnabled, memory_order_relaxed);
+}
+
+/**
+ * Rozpoczyna zapisywanie zdarzeń do pliku w formacie Trace Event (JSON),
+ * który można otworzyć w perfetto lub chrome://tracing
+ * @param[in] path : ścieżka do pliku
+ * @return : czy udało się otworzyć plik
+ */
+extern bool TraceStart(const char *path);
+
+/**
+ * Zapisuje zdarzenia zbuforowane przez wszystkie wątki i zamyka plik
+ */
+extern void TraceStop(void);
+
+/**
+ * Zwraca bieżący czas w nanosekundach
+ * @return : czas w nanosekundach
+ */
+extern uint64_t TraceNow(void);
+
+/**
+ * Rozpoczyna fazę obliczeń. Faza zagnieżdżona w tej samej fazie (np.
+ * rekurencyjne wywołanie PolyMul) nie jest zapisywana, podobnie jak
+ * wszystkie fazy w niej zawarte, więc liczba zdarzeń nie zależy od
+ * rozmiaru wielomianów.
+ * @param[in] phase : faza
+ * @return : znacznik, który należy przekazać do TraceEnd
+ */
+extern uint64_t TraceBegin(TracePhaseT phase);
+
+/**
+ * Kończy fazę obliczeń rozpoczętą przez TraceBegin
+ * @param[in] phase : faza
+ * @param[in] mark : znacznik zwrócony przez TraceBegin
+ */
+extern void TraceEnd(TracePhaseT phase, uint64_t mark);
+
+/**
+ * Zamyka bez zapisywania wszystkie fazy otwarte przez bieżący wątek, np. po
+ * wycofaniu komendy, której zabrakło pamięci
+ */
+extern void TraceAbort(void);
+
+/**
+ * Zapisuje zdarzenie wykonania komendy
+ * @param[in] comm : parametry komendy
+ * @param[in] start : czas rozpoczęcia komendy
+ */
+extern void TraceCommand(const TraceCommandT *comm, uint64_t start);
+
+/**
+ * Liczy jednomiany wielomianu na wszystkich poziomach
+ * @param[in] p : wielomian
+ * @return : liczba jednomianów
+ */
+extern long TraceTerms(const Poly *p);
+
+/** Rozpoczyna fazę obliczeń, jeśli zdarzenia są zapisywane
+ */
+#define TRACE_BEGIN(phase, var) \
+  uint64_t var = TraceOn() ? TraceBegin(phase) : 0
+
+/** Kończy fazę obliczeń rozpoczętą przez TRACE_BEGIN
+ */
+#define TRACE_END(phase, var) \
+  do { if (var != 0) TraceEnd(phase, var); } while (0)
+
+#endif //POLYNOMIALS_TRACE_H